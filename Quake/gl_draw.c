@@ -1090,6 +1090,7 @@ qboolean GL_Set2D (void)
 	if (screen_effects)
 	{
 		R_BeginDebugUtilsLabel ("Screen Effects");
+		R_BeginGPUScope (GPU_SCOPE_SCREEN_EFFECTS);
 
 		VkImageMemoryBarrier image_barriers[2];
 		image_barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -1176,6 +1177,7 @@ qboolean GL_Set2D (void)
 
 		vkCmdPipelineBarrier(vulkan_globals.command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, NULL, 0, NULL, 1, image_barriers);
 
+		R_EndGPUScope (GPU_SCOPE_SCREEN_EFFECTS);
 		R_EndDebugUtilsLabel ();
 	}
 	else
@@ -25,11 +25,201 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 ================================================================================
 
 	DEVICE MEMORY HEAP
-	Dumbest possible allocator for device memory.
+	Two level segregated fit allocator for device memory. Free nodes are kept in
+	size class lists indexed by a power of two (first level) and a linear split
+	of that range (second level). Bitmaps of non-empty lists make finding a
+	suitable block and freeing one O(1). Nodes come from a pool so allocating
+	doesn't hit malloc.
 
 ================================================================================
 */
 
+#define HEAP_NODE_POOL_CHUNK	1024
+
+static glheapnode_t * node_pool_free;
+
+/*
+===============
+GL_HeapLog2
+===============
+*/
+static inline int GL_HeapLog2(uint64_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+#else
+	return 63 - __builtin_clzll(value);
+#endif
+}
+
+/*
+===============
+GL_HeapFirstBit
+===============
+*/
+static inline int GL_HeapFirstBit(uint64_t value)
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward64(&index, value);
+	return (int)index;
+#else
+	return __builtin_ctzll(value);
+#endif
+}
+
+/*
+===============
+GL_AllocHeapNode
+===============
+*/
+static glheapnode_t * GL_AllocHeapNode(void)
+{
+	glheapnode_t * node;
+	int i;
+
+	if (!node_pool_free)
+	{
+		glheapnode_t * chunk = (glheapnode_t*) malloc(HEAP_NODE_POOL_CHUNK * sizeof(glheapnode_t));
+		if (!chunk)
+			Sys_Error("GL_AllocHeapNode: out of memory");
+		for (i = 0; i < HEAP_NODE_POOL_CHUNK; ++i)
+			chunk[i].next = (i + 1 < HEAP_NODE_POOL_CHUNK) ? &chunk[i + 1] : NULL;
+		node_pool_free = chunk;
+	}
+
+	node = node_pool_free;
+	node_pool_free = node->next;
+	memset(node, 0, sizeof(glheapnode_t));
+	return node;
+}
+
+/*
+===============
+GL_FreeHeapNode
+===============
+*/
+static void GL_FreeHeapNode(glheapnode_t * node)
+{
+	node->next = node_pool_free;
+	node_pool_free = node;
+}
+
+/*
+===============
+GL_HeapMapping
+
+Size class of a free block of the given size
+===============
+*/
+static void GL_HeapMapping(VkDeviceSize size, int * fl, int * sl)
+{
+	if (size < HEAP_SL_COUNT)
+	{
+		*fl = 0;
+		*sl = (int)size;
+	}
+	else
+	{
+		const int log2 = GL_HeapLog2(size);
+		*fl = log2 - HEAP_SL_LOG2 + 1;
+		*sl = (int)(size >> (log2 - HEAP_SL_LOG2)) & (HEAP_SL_COUNT - 1);
+	}
+}
+
+/*
+===============
+GL_HeapInsertFree
+===============
+*/
+static void GL_HeapInsertFree(glheap_t * heap, glheapnode_t * node)
+{
+	int fl, sl;
+	GL_HeapMapping(node->size, &fl, &sl);
+
+	node->free = true;
+	node->prev_free = NULL;
+	node->next_free = heap->free_lists[fl][sl];
+	if (node->next_free)
+		node->next_free->prev_free = node;
+	heap->free_lists[fl][sl] = node;
+
+	heap->fl_bitmap |= 1ULL << fl;
+	heap->sl_bitmap[fl] |= 1u << sl;
+	heap->free_size += node->size;
+	heap->num_free_nodes += 1;
+}
+
+/*
+===============
+GL_HeapRemoveFree
+===============
+*/
+static void GL_HeapRemoveFree(glheap_t * heap, glheapnode_t * node)
+{
+	int fl, sl;
+	GL_HeapMapping(node->size, &fl, &sl);
+
+	if (node->prev_free)
+		node->prev_free->next_free = node->next_free;
+	else
+		heap->free_lists[fl][sl] = node->next_free;
+	if (node->next_free)
+		node->next_free->prev_free = node->prev_free;
+
+	if (!heap->free_lists[fl][sl])
+	{
+		heap->sl_bitmap[fl] &= ~(1u << sl);
+		if (!heap->sl_bitmap[fl])
+			heap->fl_bitmap &= ~(1ULL << fl);
+	}
+
+	node->free = false;
+	node->prev_free = NULL;
+	node->next_free = NULL;
+	heap->free_size -= node->size;
+	heap->num_free_nodes -= 1;
+}
+
+/*
+===============
+GL_HeapFindFree
+
+Returns a free node of at least size bytes. The request is rounded up to the
+next size class so the head of any non-empty list at or above it fits.
+===============
+*/
+static glheapnode_t * GL_HeapFindFree(glheap_t * heap, VkDeviceSize size)
+{
+	int fl, sl;
+	uint32_t sl_map;
+	uint64_t fl_map;
+
+	if (size >= HEAP_SL_COUNT)
+	{
+		const VkDeviceSize round = ((VkDeviceSize)1 << (GL_HeapLog2(size) - HEAP_SL_LOG2)) - 1;
+		if (size + round < size)
+			return NULL;
+		size += round;
+	}
+	GL_HeapMapping(size, &fl, &sl);
+
+	sl_map = heap->sl_bitmap[fl] & (~0u << sl);
+	if (!sl_map)
+	{
+		fl_map = (fl + 1 < HEAP_FL_COUNT) ? (heap->fl_bitmap & (~0ULL << (fl + 1))) : 0;
+		if (!fl_map)
+			return NULL;
+		fl = GL_HeapFirstBit(fl_map);
+		sl_map = heap->sl_bitmap[fl];
+	}
+	sl = GL_HeapFirstBit(sl_map);
+
+	return heap->free_lists[fl][sl];
+}
+
 /*
 ===============
 GL_CreateHeap
@@ -38,6 +228,7 @@ GL_CreateHeap
 glheap_t * GL_CreateHeap(VkDeviceSize size, uint32_t memory_type_index, const char * name)
 {
 	glheap_t * heap = (glheap_t*) malloc(sizeof(glheap_t));
+	memset(heap, 0, sizeof(glheap_t));
 
 	VkMemoryAllocateInfo memory_allocate_info;
 	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
@@ -59,12 +250,11 @@ glheap_t * GL_CreateHeap(VkDeviceSize size, uint32_t memory_type_index, const ch
 
 	GL_SetObjectName((uint64_t)heap->memory, VK_OBJECT_TYPE_DEVICE_MEMORY, name);
 
-	heap->head = (glheapnode_t*) malloc(sizeof(glheapnode_t));
+	heap->size = size;
+	heap->head = GL_AllocHeapNode();
 	heap->head->offset = 0;
 	heap->head->size = size;
-	heap->head->prev = NULL;
-	heap->head->next = NULL;
-	heap->head->free = true;
+	GL_HeapInsertFree(heap, heap->head);
 
 	return heap;
 }
@@ -76,9 +266,16 @@ GL_DestroyHeap
 */
 void GL_DestroyHeap(glheap_t * heap)
 {
+	glheapnode_t * node;
+	glheapnode_t * next;
+
 	GL_WaitForDeviceIdle();
 	vkFreeMemory(vulkan_globals.device, heap->memory, NULL);
-	free(heap->head);
+	for (node = heap->head; node != NULL; node = next)
+	{
+		next = node->next;
+		GL_FreeHeapNode(node);
+	}
 	free(heap);
 }
 
@@ -89,60 +286,64 @@ GL_HeapAllocate
 */
 glheapnode_t * GL_HeapAllocate(glheap_t * heap, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize * aligned_offset)
 {
-	glheapnode_t * current_node;
-	glheapnode_t * best_fit_node = NULL;
-	VkDeviceSize best_fit_size = UINT64_MAX;
+	glheapnode_t * node;
+	VkDeviceSize align_mod, align_padding, aligned_size;
 
-	for (current_node = heap->head; current_node != NULL; current_node = current_node->next)
-	{
-		if (!current_node->free)
-			continue;
-
-		const VkDeviceSize align_mod = current_node->offset % alignment;
-		VkDeviceSize align_padding = (align_mod == 0) ? 0 : (alignment - align_mod);
-		VkDeviceSize aligned_size = size + align_padding;
+	if (alignment == 0)
+		alignment = 1;
 
-		if (current_node->size == aligned_size)
+	// Worst case padding is reserved up front so any block of the found class fits
+	node = GL_HeapFindFree(heap, size + alignment - 1);
+	if (node == NULL)
+	{
+		// Nothing in a larger class, blocks in the classes the rounding skipped may still fit
+		int fl, sl, last_fl, last_sl;
+		GL_HeapMapping(size, &fl, &sl);
+		GL_HeapMapping(size + alignment - 1, &last_fl, &last_sl);
+		for (; node == NULL && (fl < last_fl || (fl == last_fl && sl <= last_sl)); ++sl)
 		{
-			current_node->free = false;
-			*aligned_offset = current_node->offset + align_padding;
-			return current_node;
+			if (sl == HEAP_SL_COUNT)
+			{
+				sl = 0;
+				++fl;
+			}
+			for (node = heap->free_lists[fl][sl]; node != NULL; node = node->next_free)
+			{
+				align_mod = node->offset % alignment;
+				align_padding = (align_mod == 0) ? 0 : (alignment - align_mod);
+				if (node->size >= size + align_padding)
+					break;
+			}
 		}
-		else if ((current_node->size > aligned_size) && (current_node->size < best_fit_size))
+		if (node == NULL)
 		{
-			best_fit_size = current_node->size;
-			best_fit_node = current_node;
+			*aligned_offset = 0;
+			return NULL;
 		}
 	}
 
-	if (best_fit_node != NULL)
+	align_mod = node->offset % alignment;
+	align_padding = (align_mod == 0) ? 0 : (alignment - align_mod);
+	aligned_size = size + align_padding;
+
+	GL_HeapRemoveFree(heap, node);
+
+	if (node->size > aligned_size)
 	{
-		const VkDeviceSize align_mod = best_fit_node->offset % alignment;
-		VkDeviceSize align_padding = (align_mod == 0) ? 0 : (alignment - align_mod);
-		VkDeviceSize aligned_size = size + align_padding;
-
-		glheapnode_t * new_node = (glheapnode_t*) malloc(sizeof(glheapnode_t));
-		*new_node = *best_fit_node;
-		new_node->prev = best_fit_node->prev;
-		new_node->next = best_fit_node;
-		if(best_fit_node->prev)
-			best_fit_node->prev->next = new_node;
-		best_fit_node->prev = new_node;
-		new_node->free = false;
-
-		new_node->size = aligned_size;
-		best_fit_node->size -= aligned_size;
-		best_fit_node->offset += aligned_size;
-
-		if (best_fit_node == heap->head)
-			heap->head = new_node;
-
-		*aligned_offset = new_node->offset + align_padding;
-		return new_node;
+		glheapnode_t * remainder = GL_AllocHeapNode();
+		remainder->offset = node->offset + aligned_size;
+		remainder->size = node->size - aligned_size;
+		remainder->prev = node;
+		remainder->next = node->next;
+		if (node->next)
+			node->next->prev = remainder;
+		node->next = remainder;
+		node->size = aligned_size;
+		GL_HeapInsertFree(heap, remainder);
 	}
 
-	*aligned_offset = 0;
-	return NULL;
+	*aligned_offset = node->offset + align_padding;
+	return node;
 }
 
 /*
@@ -155,18 +356,18 @@ void GL_HeapFree(glheap_t * heap, glheapnode_t * node)
 	if(node->free)
 		Sys_Error("Trying to free a node that is already freed");
 
-	node->free = true;
 	if(node->prev && node->prev->free)
 	{
 		glheapnode_t * prev = node->prev;
 
+		GL_HeapRemoveFree(heap, prev);
 		prev->next = node->next;
 		if (node->next)
 			node->next->prev = prev;
 
 		prev->size += node->size;
 
-		free(node);
+		GL_FreeHeapNode(node);
 		node = prev;
 	}
 
@@ -174,14 +375,17 @@ void GL_HeapFree(glheap_t * heap, glheapnode_t * node)
 	{
 		glheapnode_t * next = node->next;
 
+		GL_HeapRemoveFree(heap, next);
 		if(next->next)
 			next->next->prev = node;
 		node->next = next->next;
 
 		node->size += next->size;
 
-		free(next);
+		GL_FreeHeapNode(next);
 	}
+
+	GL_HeapInsertFree(heap, node);
 }
 
 /*
@@ -194,6 +398,38 @@ qboolean GL_IsHeapEmpty(glheap_t * heap)
 	return heap->head->next == NULL;
 }
 
+/*
+===============
+GL_AccumulateHeapStats
+===============
+*/
+void GL_AccumulateHeapStats(int num_heaps, glheap_t ** heaps, glheapstats_t * stats)
+{
+	int i, sl;
+	glheapnode_t * node;
+
+	for (i = 0; i < num_heaps; ++i)
+	{
+		glheap_t * heap = heaps[i];
+		if (!heap)
+			continue;
+
+		stats->num_heaps += 1;
+		stats->total_size += heap->size;
+		stats->free_size += heap->free_size;
+		stats->num_free_nodes += heap->num_free_nodes;
+
+		// The largest free block is in the highest non-empty class
+		if (heap->fl_bitmap)
+		{
+			const int fl = GL_HeapLog2(heap->fl_bitmap);
+			sl = GL_HeapLog2(heap->sl_bitmap[fl]);
+			for (node = heap->free_lists[fl][sl]; node != NULL; node = node->next_free)
+				stats->largest_free_block = q_max(stats->largest_free_block, node->size);
+		}
+	}
+}
+
 /*
 ================
 GL_AllocateFromHeaps
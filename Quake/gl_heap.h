@@ -21,12 +21,18 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifndef __HEAP__
 #define __HEAP__
 
+#define HEAP_SL_LOG2		5
+#define HEAP_SL_COUNT		(1 << HEAP_SL_LOG2)	// second level lists per first level class
+#define HEAP_FL_COUNT		64
+
 typedef struct glheapnode_s
 {
 	VkDeviceSize offset;
 	VkDeviceSize size;
-	struct glheapnode_s * prev;
+	struct glheapnode_s * prev;		// physical neighbours, sorted by offset
 	struct glheapnode_s * next;
+	struct glheapnode_s * prev_free;	// free list of the node's size class
+	struct glheapnode_s * next_free;
 	qboolean free;
 } glheapnode_t;
 
@@ -34,8 +40,23 @@ typedef struct glheap_s
 {
 	VkDeviceMemory	memory;
 	glheapnode_t * head;
+	VkDeviceSize	size;
+	VkDeviceSize	free_size;
+	int				num_free_nodes;
+	uint64_t		fl_bitmap;
+	uint32_t		sl_bitmap[HEAP_FL_COUNT];
+	glheapnode_t *	free_lists[HEAP_FL_COUNT][HEAP_SL_COUNT];
 } glheap_t;
 
+typedef struct glheapstats_s
+{
+	int				num_heaps;
+	VkDeviceSize	total_size;
+	VkDeviceSize	free_size;
+	VkDeviceSize	largest_free_block;
+	int				num_free_nodes;
+} glheapstats_t;
+
 glheap_t * GL_CreateHeap(VkDeviceSize size, uint32_t memory_type_index, const char * name);
 void GL_DestroyHeap(glheap_t * heap);
 
@@ -43,6 +64,7 @@ glheapnode_t * GL_HeapAllocate(glheap_t * heap, VkDeviceSize size, VkDeviceSize
 void GL_HeapFree(glheap_t * heap, glheapnode_t * node);
 
 qboolean GL_IsHeapEmpty(glheap_t * heap);
+void GL_AccumulateHeapStats(int num_heaps, glheap_t ** heaps, glheapstats_t * stats);
 
 VkDeviceSize GL_AllocateFromHeaps(int * num_heaps, glheap_t *** heaps, VkDeviceSize heap_size, uint32_t memory_type_index,
 	VkDeviceSize size, VkDeviceSize alignment, glheap_t ** heap, glheapnode_t ** heap_node, int * num_allocations, const char * heap_name);
@@ -73,8 +73,8 @@ typedef struct
 } buffer_garbage_t;
 
 static int current_garbage_index;
-static int num_garbage_buffers[2];
-static buffer_garbage_t buffer_garbage[MAX_MODELS * 2][2];
+static int num_garbage_buffers[FRAMES_IN_FLIGHT];
+static buffer_garbage_t buffer_garbage[MAX_MODELS * 2][FRAMES_IN_FLIGHT];
 
 /*
 ================
@@ -106,7 +106,7 @@ void R_CollectMeshBufferGarbage()
 	int i;
 	buffer_garbage_t * garbage;
 
-	current_garbage_index = (current_garbage_index + 1) % 2;
+	current_garbage_index = (current_garbage_index + 1) % FRAMES_IN_FLIGHT;
 	num = num_garbage_buffers[current_garbage_index];
 	for (i=0; i<num; ++i)
 	{
@@ -787,3 +787,14 @@ void GLMesh_DeleteVertexBuffers (void)
 		GLMesh_DeleteVertexBuffer(m);
 	}
 }
+
+/*
+================
+GLMesh_GetHeapStats
+================
+*/
+void GLMesh_GetHeapStats (glheapstats_t *vertex_stats, glheapstats_t *index_stats)
+{
+	GL_AccumulateHeapStats (num_vertex_buffer_heaps, vertex_buffer_heaps, vertex_stats);
+	GL_AccumulateHeapStats (num_index_buffer_heaps, index_buffer_heaps, index_stats);
+}
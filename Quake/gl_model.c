@@ -2496,6 +2496,102 @@ static void Mod_LoadLeafsExternal(FILE* f)
 	Mod_ProcessLeafs_S((byte*)in, filelen);
 }
 
+/*
+=================
+Mod_LinearizeHull
+
+Copies the clipnodes reachable from firstclipnode into hull->nodes in depth
+first order, front child first, with the planes copied in. A node shares a
+cache line with its front child and the traversal doesn't touch the planes
+array. Leaves hull->nodes NULL if a child is out of range or reached twice.
+=================
+*/
+static void Mod_LinearizeHull (hull_t *hull)
+{
+	static int	*map, *order, *stack;
+	static int	maxnodes;
+	mclipnode_t	*in;
+	mplane_t	*plane;
+	mhullnode_t	*out;
+	int			i, j, num, child, count, depth;
+	qboolean	valid;
+
+	hull->nodes = NULL;
+	hull->numnodes = 0;
+	if (!hull->clipnodes || hull->firstclipnode < 0 || hull->firstclipnode > hull->lastclipnode)
+		return;
+
+	if (hull->lastclipnode + 1 > maxnodes)
+	{
+		free (map);
+		free (order);
+		free (stack);
+		maxnodes = hull->lastclipnode + 1;
+		map = (int *) malloc (maxnodes * sizeof(int));
+		order = (int *) malloc (maxnodes * sizeof(int));
+		stack = (int *) malloc (maxnodes * sizeof(int));
+		if (!map || !order || !stack)
+			Sys_Error ("Mod_LinearizeHull: out of memory");
+		for (i = 0; i < maxnodes; i++)
+			map[i] = -1;
+	}
+
+	// number the nodes in preorder
+	valid = true;
+	count = 0;
+	depth = 0;
+	stack[depth++] = hull->firstclipnode;
+	while (depth)
+	{
+		num = stack[--depth];
+		if (map[num] != -1 || count == maxnodes)
+		{
+			valid = false;
+			break;
+		}
+		map[num] = count;
+		order[count++] = num;
+
+		in = hull->clipnodes + num;
+		for (j = 1; j >= 0; j--)
+		{
+			child = in->children[j];
+			if (child < 0)
+				continue;
+			if (child < hull->firstclipnode || child > hull->lastclipnode || depth == maxnodes)
+			{
+				valid = false;
+				break;
+			}
+			stack[depth++] = child;
+		}
+		if (!valid)
+			break;
+	}
+
+	if (valid)
+	{
+		out = (mhullnode_t *) Hunk_AllocName (count * sizeof(*out), loadname);
+		for (i = 0; i < count; i++)
+		{
+			in = hull->clipnodes + order[i];
+			plane = hull->planes + in->planenum;
+			VectorCopy (plane->normal, out[i].normal);
+			out[i].dist = plane->dist;
+			out[i].type = plane->type;
+			for (j = 0; j < 2; j++)
+				out[i].children[j] = (in->children[j] < 0) ? in->children[j] : map[in->children[j]];
+		}
+		hull->nodes = out;
+		hull->numnodes = count;
+	}
+	else
+		Con_DPrintf ("%s: clipnodes from %i aren't a tree, using the slow hull tracer\n", loadmodel->name, hull->firstclipnode);
+
+	for (i = 0; i < count; i++)
+		map[order[i]] = -1;
+}
+
 /*
 =================
 Mod_LoadBrushModel
@@ -2616,6 +2712,8 @@ visdone:
 			mod->hulls[j].firstclipnode = bm->headnode[j];
 			mod->hulls[j].lastclipnode = mod->numclipnodes-1;
 		}
+		for (j=0 ; j<3 ; j++)	// hull 3 is never filled in
+			Mod_LinearizeHull (&mod->hulls[j]);
 
 		mod->firstmodelsurface = bm->firstface;
 		mod->nummodelsurfaces = bm->numfaces;
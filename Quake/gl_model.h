@@ -169,6 +169,7 @@ typedef struct msurface_s
 	byte		styles[MAXLIGHTMAPS];
 	int			cached_light[MAXLIGHTMAPS];	// values currently used in lightmap
 	qboolean	cached_dlight;				// true if dynamic light in cache
+	int			lightmapqueued;				// compose pass the surface was last queued for
 	byte		*samples;		// [numstyles*surfsize]
 	int			bmodelindex;
 } msurface_t;
@@ -221,6 +222,16 @@ typedef struct mclipnode_s
 } mclipnode_t;
 //johnfitz
 
+// clipnode with its plane copied in, stored depth first from the head node
+typedef struct mhullnode_s
+{
+	float		normal[3];
+	float		dist;
+	int			children[2];	// index into the hull's nodes, negative numbers are contents
+	int			type;			// plane type
+	int			pad;			// keeps nodes at 32 bytes
+} mhullnode_t;
+
 // !!! if this is changed, it must be changed in asm_i386.h too !!!
 typedef struct
 {
@@ -230,6 +241,8 @@ typedef struct
 	int			lastclipnode;
 	vec3_t		clip_mins;
 	vec3_t		clip_maxs;
+	mhullnode_t	*nodes;			// firstclipnode is nodes[0], NULL if the tree can't be laid out
+	int			numnodes;
 } hull_t;
 
 typedef float soa_aabb_t[2 * 3 * 8]; // 8 AABB's in SoA form
@@ -0,0 +1,315 @@
+/*
+Copyright (C) 2016 Axel Gneiting
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#include "quakedef.h"
+
+/*
+================================================================================
+
+	GPU PROFILER
+	Timestamp queries around named passes. Every command buffer owns a slice of
+	the query pool. The slice is read back once the command buffer's fence has
+	signaled, so reading never stalls the GPU.
+
+================================================================================
+*/
+
+#define MAX_GPU_SCOPE_QUERIES	64		// timestamp pairs per frame
+#define GPU_PROFILE_HISTORY		128		// frames kept for averaging and CSV dumps
+
+static const char * gpu_scope_names[NUM_GPU_SCOPES] =
+{
+	"frame",
+	"blas static",
+	"blas dyn",
+	"tlas",
+	"traceray",
+	"screenfx",
+	"postproc",
+};
+
+typedef struct
+{
+	int			num_queries;
+	gpuscope_t	scopes[MAX_GPU_SCOPE_QUERIES];
+} gpuprofileframe_t;
+
+cvar_t r_gpuprofile = {"r_gpuprofile", "0", CVAR_NONE};
+
+static VkQueryPool			query_pool = VK_NULL_HANDLE;
+static gpuprofileframe_t	frames[FRAMES_IN_FLIGHT];
+static int					open_queries[NUM_GPU_SCOPES];
+static qboolean				profiling_frame;
+static uint64_t				timestamp_mask;
+static double				timestamp_period_ms;
+
+static double				history[GPU_PROFILE_HISTORY][NUM_GPU_SCOPES];
+static int					history_frame[GPU_PROFILE_HISTORY];
+static int					history_count;
+static int					history_pos;
+static int					profiled_frames;
+
+/*
+===============
+GL_GPUProfilerDump_f
+===============
+*/
+static void GL_GPUProfilerDump_f (void)
+{
+	char	name[MAX_OSPATH];
+	FILE	*f;
+	int		i, j, index;
+
+	if (history_count == 0)
+	{
+		Con_Printf ("No GPU profile data, set r_gpuprofile 1 first\n");
+		return;
+	}
+
+	q_snprintf (name, sizeof(name), "%s/%s", com_gamedir, (Cmd_Argc () > 1) ? Cmd_Argv (1) : "gpuprofile.csv");
+	COM_AddExtension (name, ".csv", sizeof(name));
+	f = fopen (name, "w");
+	if (!f)
+	{
+		Con_Printf ("Couldn't write %s\n", name);
+		return;
+	}
+
+	fprintf (f, "frame");
+	for (j = 0; j < NUM_GPU_SCOPES; ++j)
+		fprintf (f, ",%s_ms", gpu_scope_names[j]);
+	fprintf (f, "\n");
+
+	for (i = 0; i < history_count; ++i)
+	{
+		index = (history_pos - history_count + i + GPU_PROFILE_HISTORY) % GPU_PROFILE_HISTORY;
+		fprintf (f, "%d", history_frame[index]);
+		for (j = 0; j < NUM_GPU_SCOPES; ++j)
+			fprintf (f, ",%.4f", history[index][j]);
+		fprintf (f, "\n");
+	}
+
+	fclose (f);
+	Con_Printf ("Wrote %d frames to %s\n", history_count, name);
+}
+
+/*
+===============
+GL_InitGPUProfiler
+===============
+*/
+void GL_InitGPUProfiler (void)
+{
+	VkQueryPoolCreateInfo query_pool_create_info;
+	VkResult err;
+
+	Cvar_RegisterVariable (&r_gpuprofile);
+	Cmd_AddCommand ("gpuprofile_dump", GL_GPUProfilerDump_f);
+
+	if (vulkan_globals.timestamp_valid_bits == 0 || vulkan_globals.device_properties.limits.timestampPeriod == 0.0f)
+	{
+		Con_Printf ("GPU timestamps not supported on graphics queue, r_gpuprofile disabled\n");
+		return;
+	}
+
+	timestamp_mask = (vulkan_globals.timestamp_valid_bits >= 64) ? UINT64_MAX : ((1ULL << vulkan_globals.timestamp_valid_bits) - 1);
+	timestamp_period_ms = (double)vulkan_globals.device_properties.limits.timestampPeriod / 1000000.0;
+
+	memset (&query_pool_create_info, 0, sizeof(query_pool_create_info));
+	query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_create_info.queryCount = FRAMES_IN_FLIGHT * MAX_GPU_SCOPE_QUERIES * 2;
+
+	err = vkCreateQueryPool (vulkan_globals.device, &query_pool_create_info, NULL, &query_pool);
+	if (err != VK_SUCCESS)
+		Sys_Error ("vkCreateQueryPool failed");
+
+	GL_SetObjectName ((uint64_t)query_pool, VK_OBJECT_TYPE_QUERY_POOL, "GPU profiler");
+}
+
+/*
+===============
+GL_GPUProfilerReadback
+
+Called after the fence of the command buffer has been waited on
+===============
+*/
+static void GL_GPUProfilerReadback (int cb_index)
+{
+	uint64_t	timestamps[MAX_GPU_SCOPE_QUERIES * 2];
+	double		*times;
+	int			i;
+	gpuprofileframe_t *frame = &frames[cb_index];
+
+	if (frame->num_queries == 0)
+		return;
+
+	VkResult err = vkGetQueryPoolResults (vulkan_globals.device, query_pool, cb_index * MAX_GPU_SCOPE_QUERIES * 2, frame->num_queries * 2,
+		sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (err != VK_SUCCESS)
+	{
+		frame->num_queries = 0;
+		return;
+	}
+
+	times = history[history_pos];
+	memset (times, 0, sizeof(history[0]));
+	for (i = 0; i < frame->num_queries; ++i)
+	{
+		const uint64_t delta = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestamp_mask;
+		times[frame->scopes[i]] += (double)delta * timestamp_period_ms;
+	}
+
+	history_frame[history_pos] = profiled_frames++;
+	history_pos = (history_pos + 1) % GPU_PROFILE_HISTORY;
+	history_count = q_min (history_count + 1, GPU_PROFILE_HISTORY);
+	frame->num_queries = 0;
+}
+
+/*
+===============
+GL_GPUProfilerBeginFrame
+===============
+*/
+void GL_GPUProfilerBeginFrame (void)
+{
+	const int cb_index = vulkan_globals.current_command_buffer;
+	int i;
+
+	if (query_pool == VK_NULL_HANDLE)
+		return;
+
+	GL_GPUProfilerReadback (cb_index);
+
+	for (i = 0; i < NUM_GPU_SCOPES; ++i)
+		open_queries[i] = -1;
+
+	// Latch the cvar so toggling it mid frame never writes to queries that weren't reset
+	profiling_frame = r_gpuprofile.value != 0;
+	if (!profiling_frame)
+		return;
+
+	vkCmdResetQueryPool (vulkan_globals.command_buffer, query_pool, cb_index * MAX_GPU_SCOPE_QUERIES * 2, MAX_GPU_SCOPE_QUERIES * 2);
+	R_BeginGPUScope (GPU_SCOPE_FRAME);
+}
+
+/*
+===============
+GL_GPUProfilerEndFrame
+===============
+*/
+void GL_GPUProfilerEndFrame (void)
+{
+	int i;
+
+	if (query_pool == VK_NULL_HANDLE)
+		return;
+
+	// Close scopes left open by early outs so every begin has an end
+	for (i = 0; i < NUM_GPU_SCOPES; ++i)
+		if (open_queries[i] >= 0)
+			R_EndGPUScope ((gpuscope_t)i);
+	profiling_frame = false;
+}
+
+/*
+===============
+R_BeginGPUScope
+===============
+*/
+void R_BeginGPUScope (gpuscope_t scope)
+{
+	const int cb_index = vulkan_globals.current_command_buffer;
+	gpuprofileframe_t *frame = &frames[cb_index];
+	int query;
+
+	if (query_pool == VK_NULL_HANDLE || !profiling_frame)
+		return;
+	if (open_queries[scope] >= 0 || frame->num_queries >= MAX_GPU_SCOPE_QUERIES)
+		return;
+
+	query = frame->num_queries++;
+	frame->scopes[query] = scope;
+	open_queries[scope] = query;
+	vkCmdWriteTimestamp (vulkan_globals.command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, (cb_index * MAX_GPU_SCOPE_QUERIES + query) * 2);
+}
+
+/*
+===============
+R_EndGPUScope
+===============
+*/
+void R_EndGPUScope (gpuscope_t scope)
+{
+	const int cb_index = vulkan_globals.current_command_buffer;
+	const int query = open_queries[scope];
+
+	if (query_pool == VK_NULL_HANDLE || !profiling_frame || query < 0)
+		return;
+
+	open_queries[scope] = -1;
+	vkCmdWriteTimestamp (vulkan_globals.command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, (cb_index * MAX_GPU_SCOPE_QUERIES + query) * 2 + 1);
+}
+
+/*
+===============
+SCR_DrawGPUProfile
+===============
+*/
+void SCR_DrawGPUProfile (void)
+{
+	char	str[40];
+	double	avg[NUM_GPU_SCOPES];
+	double	peak[NUM_GPU_SCOPES];
+	int		i, j, y, num_lines;
+
+	if (!r_gpuprofile.value || query_pool == VK_NULL_HANDLE || history_count == 0)
+		return;
+
+	for (j = 0; j < NUM_GPU_SCOPES; ++j)
+	{
+		avg[j] = 0.0;
+		peak[j] = 0.0;
+	}
+	for (i = 0; i < history_count; ++i)
+	{
+		for (j = 0; j < NUM_GPU_SCOPES; ++j)
+		{
+			avg[j] += history[i][j];
+			peak[j] = q_max (peak[j], history[i][j]);
+		}
+	}
+
+	num_lines = NUM_GPU_SCOPES + 2;
+	y = 25 - num_lines - (devstats.value ? 9 : 0);
+
+	GL_SetCanvas (CANVAS_BOTTOMLEFT);
+	Draw_Fill (0, y*8, 24*8, num_lines*8, 0, 0.5); //dark rectangle
+
+	sprintf (str, "gpu ms    |  Avg   Peak");
+	Draw_String (0, (y++)*8, str);
+	sprintf (str, "----------+------------");
+	Draw_String (0, (y++)*8, str);
+	for (j = 0; j < NUM_GPU_SCOPES; ++j)
+	{
+		sprintf (str, "%-10s|%6.2f %6.2f", gpu_scope_names[j], avg[j] / history_count, peak[j]);
+		Draw_String (0, (y++)*8, str);
+	}
+}
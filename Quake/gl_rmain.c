@@ -44,6 +44,7 @@ extern cvar_t vid_rt_depth;
 //johnfitz -- rendering statistics
 unsigned int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 unsigned int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+unsigned int rs_aliasgroups, rs_aliasinstances;
 float rs_megatexels;
 
 //
@@ -110,6 +111,7 @@ float	map_wateralpha, map_lavaalpha, map_telealpha, map_slimealpha;
 float	map_fallbackalpha;
 
 qboolean r_drawworld_cheatsafe, r_fullbright_cheatsafe, r_lightmap_cheatsafe; //johnfitz
+qboolean r_lightmaps_unused; // the ray tracer samples no lightmaps
 
 cvar_t	r_scale = {"r_scale", "1", CVAR_ARCHIVE};
 
@@ -400,7 +402,9 @@ R_SetupView
 */
 void R_SetupView_RTX(void)
 {
-	R_PushDlights();
+	// Light styles and dynamic lights only feed the lightmap atlas, which the
+	// hit shader never reads, so no surfaces are marked or composed here
+	r_lightmaps_unused = true;
 	R_AnimateLight();
 	r_framecount++;
 
@@ -447,6 +451,7 @@ R_SetupView
 void R_SetupView (void)
 {
 	// Need to do those early because we now update dynamic light maps during R_MarkSurfaces
+	r_lightmaps_unused = false;
 	R_PushDlights ();
 	R_AnimateLight ();
 	r_framecount++;
@@ -1101,7 +1106,8 @@ VkResult R_UpdateRaygenDescriptorSets()
 
 void RT_Create_BLAS_Instance(accel_struct_t* accel_struct, VkBuffer vertex_buffer,
 	uint32_t vertex_offset, uint32_t num_vertices, uint32_t num_triangles, uint32_t stride,
-	VkBuffer index_buffer, uint32_t num_indices, uint32_t index_offset, VkFormat format, VkIndexType index_type, VkBuffer transform_data)
+	VkBuffer index_buffer, uint32_t num_indices, uint32_t index_offset, VkFormat format, VkIndexType index_type, VkBuffer transform_data,
+	VkBuildAccelerationStructureFlagsKHR flags)
 {
 	//int current_frame_index = vulkan_globals.current_command_buffer;
 
@@ -1162,7 +1168,7 @@ void RT_Create_BLAS_Instance(accel_struct_t* accel_struct, VkBuffer vertex_buffe
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
 		.pNext = VK_NULL_HANDLE,
 		.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-		.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR,
+		.flags = flags,
 		.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
 		.srcAccelerationStructure = VK_NULL_HANDLE,
 		.dstAccelerationStructure = VK_NULL_HANDLE,
@@ -1224,34 +1230,30 @@ void RT_InitializeDynamicBuffers(void){
 
 	int current_blas_index = vulkan_globals.rt_current_blas_index;
 
-	// Allocate an empty amount of space to get the dynamic buffer offset for dynamic geometry data
-	VkBuffer dynamic_vertex_buffer;
-	VkDeviceSize dynamic_vertex_buffer_offset;
-	R_VertexAllocate(0, &dynamic_vertex_buffer, &dynamic_vertex_buffer_offset);
-
-	vulkan_globals.rt_dynamic_vertex_buffer = dynamic_vertex_buffer;
+	// Allocate an empty amount of space to get the ring buffer offset for dynamic geometry data
+	byte *vertex_data, *index_data;
+	VkDeviceSize dynamic_vertex_buffer_offset = 0;
+	VkDeviceSize dynamic_index_buffer_offset = 0;
+	R_RTGeometryAllocate(0, 0, &vertex_data, &dynamic_vertex_buffer_offset, &index_data, &dynamic_index_buffer_offset);
 	vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_buffer_offset = dynamic_vertex_buffer_offset;
-
-	VkBuffer dynamic_index_buffer;
-	VkDeviceSize dynamic_index_buffer_offset;
-	R_IndexAllocate(0, &dynamic_index_buffer, &dynamic_index_buffer_offset);
-
-	vulkan_globals.rt_dynamic_index_buffer = dynamic_index_buffer;
 	vulkan_globals.rt_blas_data_pointer[current_blas_index].index_buffer_offset = dynamic_index_buffer_offset;
 }
 
 void RT_LoadDynamicAliasGeometry(void) {
+	R_BeginAliasBatch();
 	R_DrawViewModel();
 	R_DrawEntitiesOnList(false);
+	R_EndAliasBatch();
 }
 
 void R_AllocateDescriptorSets(void) {
-	if (vulkan_globals.raygen_desc_set[0] == VK_NULL_HANDLE) {
-		vulkan_globals.raygen_desc_set[0] = R_AllocateDescriptorSet(&vulkan_globals.raygen_set_layout);
-	}
+	int i;
 
-	if (vulkan_globals.raygen_desc_set[1] == VK_NULL_HANDLE) {
-		vulkan_globals.raygen_desc_set[1] = R_AllocateDescriptorSet(&vulkan_globals.raygen_set_layout);
+	for (i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		if (vulkan_globals.raygen_desc_set[i] == VK_NULL_HANDLE) {
+			vulkan_globals.raygen_desc_set[i] = R_AllocateDescriptorSet(&vulkan_globals.raygen_set_layout);
+			TexMgr_InvalidateTextureList();
+		}
 	}
 }
 
@@ -1281,8 +1283,8 @@ void R_RenderScene_RTX(void)
 
 	// TODO: Find different way to initialize
 	if (vulkan_globals.as_instances[0].buffer == NULL) {
-		// One acceleration instances buffer for each frame in flight (currently 2 for double buffering)
-		for (int i = 0; i < 2; i++) {
+		// One acceleration instances buffer for each frame in flight
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
 			buffer_create(&vulkan_globals.as_instances[i], 2 * sizeof(VkAccelerationStructureInstanceKHR),
 				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
 				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
@@ -1296,6 +1298,8 @@ void R_RenderScene_RTX(void)
 	vulkan_globals.rt_blas_data_pointer = blas_data;
 	vulkan_globals.rt_current_blas_index = 0;
 
+	R_BeginRTGeometryFrame();
+
 	//Blas 0 (static)
 	RT_InitializeDynamicBuffers();
 
@@ -1318,28 +1322,45 @@ void R_RenderScene_RTX(void)
 	//int blas_count = vulkan_globals.rt_current_blas_index + 1;
 	
 	// static model blas
-	RT_Create_BLAS_Instance(&vulkan_globals.blas_instances[vulkan_globals.current_command_buffer].static_blas, vulkan_globals.rt_static_vertex_buffer_resource.buffer,
-		0, vulkan_globals.rt_static_vertex_count,
-		vulkan_globals.rt_static_index_count / 3, sizeof(rt_vertex_t), vulkan_globals.rt_static_index_buffer,
-		vulkan_globals.rt_static_index_count, 0,
-		VK_FORMAT_R32G32B32_SFLOAT, VK_INDEX_TYPE_UINT16, VK_NULL_HANDLE);
-	vkCmdPipelineBarrier(vulkan_globals.command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, 0, 0, 0);
+	// The world geometry only changes on map load, so each frame's BLAS is built
+	// once from the static buffers and then reused until they are rebuilt
+	blas_instances_t *frame_blas = &vulkan_globals.blas_instances[vulkan_globals.current_command_buffer];
+	if (!frame_blas->static_blas.accel || frame_blas->static_generation != vulkan_globals.rt_static_generation)
+	{
+		R_BeginGPUScope(GPU_SCOPE_STATIC_BLAS);
+		RT_Create_BLAS_Instance(&frame_blas->static_blas, vulkan_globals.rt_static_vertex_buffer_resource.buffer,
+			0, vulkan_globals.rt_static_vertex_count,
+			vulkan_globals.rt_static_index_count / 3, sizeof(rt_vertex_t), vulkan_globals.rt_static_index_buffer,
+			vulkan_globals.rt_static_index_count, 0,
+			VK_FORMAT_R32G32B32_SFLOAT, VK_INDEX_TYPE_UINT16, VK_NULL_HANDLE,
+			VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+		vkCmdPipelineBarrier(vulkan_globals.command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, 0, 0, 0);
+		R_EndGPUScope(GPU_SCOPE_STATIC_BLAS);
+		frame_blas->static_generation = vulkan_globals.rt_static_generation;
+	}
 
 	//// dynamic model blas
+	R_BeginGPUScope(GPU_SCOPE_DYNAMIC_BLAS);
 	rt_blas_data_t dynamic_blas = blas_data[1];
 	RT_Create_BLAS_Instance(&vulkan_globals.blas_instances[vulkan_globals.current_command_buffer].dynamic_blas, vulkan_globals.rt_dynamic_vertex_buffer,
 		dynamic_blas.vertex_buffer_offset, dynamic_blas.vertex_count,
 		dynamic_blas.index_count / 3, sizeof(rt_vertex_t), vulkan_globals.rt_dynamic_index_buffer,
 		dynamic_blas.index_count, dynamic_blas.index_buffer_offset,
-		VK_FORMAT_R32G32B32_SFLOAT, VK_INDEX_TYPE_UINT32, dynamic_blas.transform_data_buffer);
+		VK_FORMAT_R32G32B32_SFLOAT, VK_INDEX_TYPE_UINT32, dynamic_blas.transform_data_buffer,
+		VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR);
 	vkCmdPipelineBarrier(vulkan_globals.command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, 0, 0, 0);
+	R_EndGPUScope(GPU_SCOPE_DYNAMIC_BLAS);
 
+	R_BeginGPUScope(GPU_SCOPE_TLAS);
 	R_Create_TLAS(2);
 	vkCmdPipelineBarrier(vulkan_globals.command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memoryBarrier, 0, 0, 0, 0);
+	R_EndGPUScope(GPU_SCOPE_TLAS);
 
 	R_UpdateRaygenDescriptorSets();
 
+	R_BeginGPUScope(GPU_SCOPE_TRACE_RAYS);
 	R_InitTraceRays();
+	R_EndGPUScope(GPU_SCOPE_TRACE_RAYS);
 
 	S_ExtraUpdate();
 
@@ -1405,6 +1426,7 @@ void R_RenderView_RTX (void)
 		//johnfitz -- rendering statistics
 		rs_brushpolys = rs_aliaspolys = rs_skypolys = rs_particles = rs_fogpolys = rs_megatexels =
 			rs_dynamiclightmaps = rs_aliaspasses = rs_skypasses = rs_brushpasses = 0;
+		rs_aliasgroups = rs_aliasinstances = 0;
 	}
 
 	R_SetupView_RTX();
@@ -1423,7 +1445,7 @@ void R_RenderView_RTX (void)
 			(int)cl.viewangles[YAW],
 			(int)cl.viewangles[ROLL]);
 	else if (r_speeds.value == 2)
-		Con_Printf("%6.3f ms  %4u/%4u wpoly %4u/%4u epoly %3u lmap %4u/%4u sky\n",
+		Con_Printf("%6.3f ms  %4u/%4u wpoly %4u/%4u epoly %3u lmap %4u/%4u sky %4u/%4u inst\n",
 			(time2 - time1) * 1000.0,
 			rs_brushpolys,
 			rs_brushpasses,
@@ -1431,7 +1453,9 @@ void R_RenderView_RTX (void)
 			rs_aliaspasses,
 			rs_dynamiclightmaps,
 			rs_skypolys,
-			rs_skypasses);
+			rs_skypasses,
+			rs_aliasgroups,
+			rs_aliasinstances);
 	else if (r_speeds.value)
 		Con_Printf("%3i ms  %4i wpoly %4i epoly %3i lmap\n",
 			(int)((time2 - time1) * 1000),
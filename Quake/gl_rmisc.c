@@ -25,6 +25,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 #include "float.h"
+#include "gl_heap.h"
 
 #if defined(SDL_FRAMEWORK) || defined(NO_SDL_CONFIG)
 #include <SDL2/SDL.h>
@@ -94,6 +95,38 @@ static VkDeviceMemory	staging_memory;
 static stagingbuffer_t	staging_buffers[NUM_STAGING_BUFFERS];
 static int				current_staging_buffer = 0;
 
+/*
+================
+Transfer queue uploads
+================
+*/
+#define NUM_TRANSFER_BATCHES	4
+
+typedef struct
+{
+	VkCommandBuffer		command_buffer;
+	uint64_t			timeline_value;
+	int					current_offset;
+	qboolean			submitted;
+	unsigned char *		data;
+} transferbatch_t;
+
+static VkCommandPool	transfer_command_pool;
+static VkCommandPool	acquire_command_pool;
+static VkCommandBuffer	acquire_command_buffers[FRAMES_IN_FLIGHT];
+static VkBuffer			transfer_buffer;
+static VkDeviceMemory	transfer_memory;
+static int				transfer_batch_size;
+static transferbatch_t	transfer_batches[NUM_TRANSFER_BATCHES];
+static int				current_transfer_batch;
+static VkSemaphore		transfer_timeline;
+static uint64_t			transfer_timeline_value;
+
+// Ownership acquires for images released by submitted batches, recorded before the next frame
+static VkImageMemoryBarrier *	pending_acquires;
+static int						num_pending_acquires;
+static int						max_pending_acquires;
+
 /*
 ================
 Dynamic vertex/index & uniform buffer
@@ -102,8 +135,7 @@ Dynamic vertex/index & uniform buffer
 #define INITIAL_DYNAMIC_VERTEX_BUFFER_SIZE_KB	256
 #define INITIAL_DYNAMIC_INDEX_BUFFER_SIZE_KB	1024
 #define INITIAL_DYNAMIC_UNIFORM_BUFFER_SIZE_KB	256
-#define NUM_DYNAMIC_BUFFERS						2
-#define GARBAGE_FRAME_COUNT						3
+#define GARBAGE_FRAME_COUNT						(FRAMES_IN_FLIGHT + 1)
 #define MAX_UNIFORM_ALLOC						2048
 
 typedef struct
@@ -119,11 +151,11 @@ static uint32_t			current_dyn_uniform_buffer_size = INITIAL_DYNAMIC_UNIFORM_BUFF
 static VkDeviceMemory	dyn_vertex_buffer_memory;
 static VkDeviceMemory	dyn_index_buffer_memory;
 static VkDeviceMemory	dyn_uniform_buffer_memory;
-static dynbuffer_t		dyn_vertex_buffers[NUM_DYNAMIC_BUFFERS];
-static dynbuffer_t		dyn_index_buffers[NUM_DYNAMIC_BUFFERS];
-static dynbuffer_t		dyn_uniform_buffers[NUM_DYNAMIC_BUFFERS];
+static dynbuffer_t		dyn_vertex_buffers[FRAMES_IN_FLIGHT];
+static dynbuffer_t		dyn_index_buffers[FRAMES_IN_FLIGHT];
+static dynbuffer_t		dyn_uniform_buffers[FRAMES_IN_FLIGHT];
 static int				current_dyn_buffer_index = 0;
-static VkDescriptorSet	ubo_descriptor_sets[2];
+static VkDescriptorSet	ubo_descriptor_sets[FRAMES_IN_FLIGHT];
 
 static int					current_garbage_index = 0;
 static int					num_device_memory_garbage[GARBAGE_FRAME_COUNT];
@@ -608,6 +640,402 @@ byte * R_StagingAllocate(int size, int alignment, VkCommandBuffer * command_buff
 	return data;
 }
 
+/*
+===============
+R_CreateTransferBuffer
+
+One host visible buffer split into NUM_TRANSFER_BATCHES slices that are
+filled and submitted in turn
+===============
+*/
+static void R_CreateTransferBuffer()
+{
+	int i;
+	VkResult err;
+
+	VkBufferCreateInfo buffer_create_info;
+	memset(&buffer_create_info, 0, sizeof(buffer_create_info));
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.size = (VkDeviceSize)transfer_batch_size * NUM_TRANSFER_BATCHES;
+	buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+	err = vkCreateBuffer(vulkan_globals.device, &buffer_create_info, NULL, &transfer_buffer);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreateBuffer failed");
+	GL_SetObjectName((uint64_t)transfer_buffer, VK_OBJECT_TYPE_BUFFER, "Transfer Buffer");
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(vulkan_globals.device, transfer_buffer, &memory_requirements);
+
+	VkMemoryAllocateInfo memory_allocate_info;
+	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = memory_requirements.size;
+	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0);
+
+	num_vulkan_misc_allocations += 1;
+	err = vkAllocateMemory(vulkan_globals.device, &memory_allocate_info, NULL, &transfer_memory);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkAllocateMemory failed");
+	GL_SetObjectName((uint64_t)transfer_memory, VK_OBJECT_TYPE_DEVICE_MEMORY, "Transfer Buffer");
+
+	err = vkBindBufferMemory(vulkan_globals.device, transfer_buffer, transfer_memory, 0);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkBindBufferMemory failed");
+
+	void * data;
+	err = vkMapMemory(vulkan_globals.device, transfer_memory, 0, VK_WHOLE_SIZE, 0, &data);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkMapMemory failed");
+
+	for (i = 0; i < NUM_TRANSFER_BATCHES; ++i)
+	{
+		transfer_batches[i].current_offset = 0;
+		transfer_batches[i].data = (unsigned char *)data + (i * transfer_batch_size);
+	}
+}
+
+/*
+===============
+R_DestroyTransferBuffer
+===============
+*/
+static void R_DestroyTransferBuffer()
+{
+	vkUnmapMemory(vulkan_globals.device, transfer_memory);
+	vkFreeMemory(vulkan_globals.device, transfer_memory, NULL);
+	vkDestroyBuffer(vulkan_globals.device, transfer_buffer, NULL);
+	num_vulkan_misc_allocations -= 1;
+}
+
+/*
+===============
+R_BeginTransferBatch
+===============
+*/
+static void R_BeginTransferBatch(transferbatch_t * batch)
+{
+	VkCommandBufferBeginInfo command_buffer_begin_info;
+	memset(&command_buffer_begin_info, 0, sizeof(command_buffer_begin_info));
+	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult err = vkBeginCommandBuffer(batch->command_buffer, &command_buffer_begin_info);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkBeginCommandBuffer failed");
+}
+
+/*
+===============
+R_InitTransferQueue
+===============
+*/
+void R_InitTransferQueue()
+{
+	int i;
+	VkResult err;
+
+	if (!vulkan_globals.async_transfer)
+		return;
+
+	transfer_batch_size = vulkan_globals.staging_buffer_size;
+	R_CreateTransferBuffer();
+
+	VkSemaphoreTypeCreateInfo semaphore_type_create_info;
+	memset(&semaphore_type_create_info, 0, sizeof(semaphore_type_create_info));
+	semaphore_type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	semaphore_type_create_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphore_create_info;
+	memset(&semaphore_create_info, 0, sizeof(semaphore_create_info));
+	semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_create_info.pNext = &semaphore_type_create_info;
+
+	err = vkCreateSemaphore(vulkan_globals.device, &semaphore_create_info, NULL, &transfer_timeline);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreateSemaphore failed");
+	GL_SetObjectName((uint64_t)transfer_timeline, VK_OBJECT_TYPE_SEMAPHORE, "Transfer Timeline");
+
+	VkCommandPoolCreateInfo command_pool_create_info;
+	memset(&command_pool_create_info, 0, sizeof(command_pool_create_info));
+	command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	command_pool_create_info.queueFamilyIndex = vulkan_globals.transfer_queue_family_index;
+
+	err = vkCreateCommandPool(vulkan_globals.device, &command_pool_create_info, NULL, &transfer_command_pool);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreateCommandPool failed");
+
+	command_pool_create_info.queueFamilyIndex = vulkan_globals.gfx_queue_family_index;
+	err = vkCreateCommandPool(vulkan_globals.device, &command_pool_create_info, NULL, &acquire_command_pool);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreateCommandPool failed");
+
+	VkCommandBufferAllocateInfo command_buffer_allocate_info;
+	memset(&command_buffer_allocate_info, 0, sizeof(command_buffer_allocate_info));
+	command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_allocate_info.commandPool = transfer_command_pool;
+	command_buffer_allocate_info.commandBufferCount = NUM_TRANSFER_BATCHES;
+
+	VkCommandBuffer command_buffers[NUM_TRANSFER_BATCHES];
+	err = vkAllocateCommandBuffers(vulkan_globals.device, &command_buffer_allocate_info, command_buffers);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkAllocateCommandBuffers failed");
+
+	command_buffer_allocate_info.commandPool = acquire_command_pool;
+	command_buffer_allocate_info.commandBufferCount = FRAMES_IN_FLIGHT;
+	err = vkAllocateCommandBuffers(vulkan_globals.device, &command_buffer_allocate_info, acquire_command_buffers);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkAllocateCommandBuffers failed");
+
+	for (i = 0; i < NUM_TRANSFER_BATCHES; ++i)
+	{
+		transfer_batches[i].command_buffer = command_buffers[i];
+		transfer_batches[i].submitted = false;
+		R_BeginTransferBatch(&transfer_batches[i]);
+	}
+}
+
+/*
+===============
+R_SubmitTransferBatch
+===============
+*/
+static void R_SubmitTransferBatch(int index)
+{
+	transferbatch_t * batch = &transfer_batches[index];
+
+	vkEndCommandBuffer(batch->command_buffer);
+
+	batch->timeline_value = ++transfer_timeline_value;
+
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info;
+	memset(&timeline_submit_info, 0, sizeof(timeline_submit_info));
+	timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_submit_info.signalSemaphoreValueCount = 1;
+	timeline_submit_info.pSignalSemaphoreValues = &batch->timeline_value;
+
+	VkSubmitInfo submit_info;
+	memset(&submit_info, 0, sizeof(submit_info));
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_submit_info;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &batch->command_buffer;
+	submit_info.signalSemaphoreCount = 1;
+	submit_info.pSignalSemaphores = &transfer_timeline;
+
+	VkResult err = vkQueueSubmit(vulkan_globals.transfer_queue, 1, &submit_info, VK_NULL_HANDLE);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkQueueSubmit failed");
+
+	batch->submitted = true;
+	current_transfer_batch = (current_transfer_batch + 1) % NUM_TRANSFER_BATCHES;
+}
+
+/*
+===============
+R_SubmitTransfers
+===============
+*/
+void R_SubmitTransfers()
+{
+	if (vulkan_globals.async_transfer && transfer_batches[current_transfer_batch].current_offset > 0)
+		R_SubmitTransferBatch(current_transfer_batch);
+}
+
+/*
+===============
+R_WaitTransferBatch
+
+Makes a submitted batch writable again. Only blocks when every slice of the
+ring is still being copied by the GPU.
+===============
+*/
+static void R_WaitTransferBatch(transferbatch_t * batch)
+{
+	VkResult err;
+
+	if (!batch->submitted)
+		return;
+
+	VkSemaphoreWaitInfo wait_info;
+	memset(&wait_info, 0, sizeof(wait_info));
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &transfer_timeline;
+	wait_info.pValues = &batch->timeline_value;
+
+	err = vkWaitSemaphores(vulkan_globals.device, &wait_info, UINT64_MAX);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkWaitSemaphores failed");
+
+	batch->current_offset = 0;
+	batch->submitted = false;
+	R_BeginTransferBatch(batch);
+}
+
+/*
+===============
+R_TransferAllocate
+
+Same contract as R_StagingAllocate, but the command buffer belongs to the
+transfer queue: images recorded into it have to be handed to the graphics
+queue with R_TransferReleaseImage.
+===============
+*/
+byte * R_TransferAllocate(int size, int alignment, VkCommandBuffer * command_buffer, VkBuffer * buffer, int * buffer_offset)
+{
+	int i;
+
+	vulkan_globals.device_idle = false;
+
+	if (size > transfer_batch_size)
+	{
+		R_SubmitTransfers();
+		for (i = 0; i < NUM_TRANSFER_BATCHES; ++i)
+			R_WaitTransferBatch(&transfer_batches[i]);
+
+		transfer_batch_size = size;
+		R_DestroyTransferBuffer();
+		R_CreateTransferBuffer();
+	}
+
+	transferbatch_t * batch = &transfer_batches[current_transfer_batch];
+	const int align_mod = batch->current_offset % alignment;
+	if (align_mod != 0)
+		batch->current_offset += alignment - align_mod;
+
+	if ((batch->current_offset + size) > transfer_batch_size)
+	{
+		R_SubmitTransferBatch(current_transfer_batch);
+		batch = &transfer_batches[current_transfer_batch];
+	}
+	R_WaitTransferBatch(batch);
+
+	if (command_buffer)
+		*command_buffer = batch->command_buffer;
+	if (buffer)
+		*buffer = transfer_buffer;
+	if (buffer_offset)
+		*buffer_offset = (current_transfer_batch * transfer_batch_size) + batch->current_offset;
+
+	unsigned char *data = batch->data + batch->current_offset;
+	batch->current_offset += size;
+
+	return data;
+}
+
+/*
+===============
+R_TransferReleaseImage
+
+Records the release half of the queue family ownership transfer. The barrier
+must describe the image in TRANSFER_DST_OPTIMAL after its copies; it ends in
+newLayout on the graphics queue.
+===============
+*/
+void R_TransferReleaseImage(VkCommandBuffer command_buffer, const VkImageMemoryBarrier * barrier, VkImageLayout new_layout)
+{
+	VkImageMemoryBarrier release = *barrier;
+	release.srcQueueFamilyIndex = vulkan_globals.transfer_queue_family_index;
+	release.dstQueueFamilyIndex = vulkan_globals.gfx_queue_family_index;
+	release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	release.newLayout = new_layout;
+	release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	release.dstAccessMask = 0;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &release);
+
+	if (num_pending_acquires == max_pending_acquires)
+	{
+		max_pending_acquires = q_max(64, max_pending_acquires * 2);
+		pending_acquires = (VkImageMemoryBarrier *)realloc(pending_acquires, max_pending_acquires * sizeof(VkImageMemoryBarrier));
+		if (!pending_acquires)
+			Sys_Error("R_TransferReleaseImage: out of memory");
+	}
+
+	VkImageMemoryBarrier * acquire = &pending_acquires[num_pending_acquires++];
+	*acquire = release;
+	acquire->srcAccessMask = 0;
+	acquire->dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+}
+
+/*
+===============
+R_CancelTransferAcquire
+
+The image is being destroyed before a frame took ownership of it. No frame
+will wait on its copy any more, so wait for it here before the image can be
+handed to the garbage collector.
+===============
+*/
+void R_CancelTransferAcquire(VkImage image)
+{
+	int i;
+	qboolean cancelled = false;
+
+	for (i = 0; i < num_pending_acquires; ++i)
+	{
+		if (pending_acquires[i].image == image)
+		{
+			pending_acquires[i] = pending_acquires[--num_pending_acquires];
+			cancelled = true;
+			--i;
+		}
+	}
+
+	if (cancelled)
+	{
+		R_SubmitTransfers();
+		for (i = 0; i < NUM_TRANSFER_BATCHES; ++i)
+			R_WaitTransferBatch(&transfer_batches[i]);
+	}
+}
+
+/*
+===============
+R_PrepareTransferAcquires
+
+Submits outstanding uploads and records the acquire barriers for the frame
+that is about to be submitted. Returns the command buffer to execute before
+the frame and the timeline value it has to wait for, or VK_NULL_HANDLE.
+===============
+*/
+VkCommandBuffer R_PrepareTransferAcquires(VkSemaphore * wait_semaphore, uint64_t * wait_value)
+{
+	VkResult err;
+
+	if (!vulkan_globals.async_transfer)
+		return VK_NULL_HANDLE;
+
+	R_SubmitTransfers();
+	if (num_pending_acquires == 0)
+		return VK_NULL_HANDLE;
+
+	// The frame's fence was waited on, so its acquire command buffer is free again
+	VkCommandBuffer command_buffer = acquire_command_buffers[vulkan_globals.current_command_buffer];
+
+	VkCommandBufferBeginInfo command_buffer_begin_info;
+	memset(&command_buffer_begin_info, 0, sizeof(command_buffer_begin_info));
+	command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	err = vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkBeginCommandBuffer failed");
+
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, num_pending_acquires, pending_acquires);
+
+	err = vkEndCommandBuffer(command_buffer);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkEndCommandBuffer failed");
+
+	num_pending_acquires = 0;
+	*wait_semaphore = transfer_timeline;
+	*wait_value = transfer_timeline_value;
+	return command_buffer;
+}
+
 /*
 ===============
 R_InitDynamicVertexBuffers
@@ -627,7 +1055,7 @@ static void R_InitDynamicVertexBuffers()
 	buffer_create_info.size = current_dyn_vertex_buffer_size;
 	buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		dyn_vertex_buffers[i].current_offset = 0;
 
@@ -649,7 +1077,7 @@ static void R_InitDynamicVertexBuffers()
 	VkMemoryAllocateInfo memory_allocate_info;
 	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
 	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = NUM_DYNAMIC_BUFFERS * aligned_size;
+	memory_allocate_info.allocationSize = FRAMES_IN_FLIGHT * aligned_size;
 	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
 
 	VkMemoryAllocateFlagsInfo mem_alloc_flags = {
@@ -667,7 +1095,7 @@ static void R_InitDynamicVertexBuffers()
 
 	GL_SetObjectName((uint64_t)dyn_vertex_buffer_memory, VK_OBJECT_TYPE_DEVICE_MEMORY, "Dynamic Vertex Buffers");
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		err = vkBindBufferMemory(vulkan_globals.device, dyn_vertex_buffers[i].buffer, dyn_vertex_buffer_memory, i * aligned_size);
 		if (err != VK_SUCCESS)
@@ -675,11 +1103,11 @@ static void R_InitDynamicVertexBuffers()
 	}
 
 	void * data;
-	err = vkMapMemory(vulkan_globals.device, dyn_vertex_buffer_memory, 0, NUM_DYNAMIC_BUFFERS * aligned_size, 0, &data);
+	err = vkMapMemory(vulkan_globals.device, dyn_vertex_buffer_memory, 0, FRAMES_IN_FLIGHT * aligned_size, 0, &data);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkMapMemory failed");
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 		dyn_vertex_buffers[i].data = (unsigned char *)data + (i * aligned_size);
 }
 
@@ -703,7 +1131,7 @@ static void R_InitDynamicIndexBuffers()
 	buffer_create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
 		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		dyn_index_buffers[i].current_offset = 0;
 
@@ -725,7 +1153,7 @@ static void R_InitDynamicIndexBuffers()
 	VkMemoryAllocateInfo memory_allocate_info;
 	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
 	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = NUM_DYNAMIC_BUFFERS * aligned_size;
+	memory_allocate_info.allocationSize = FRAMES_IN_FLIGHT * aligned_size;
 	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
 
 	VkMemoryAllocateFlagsInfo mem_alloc_flags = {
@@ -743,7 +1171,7 @@ static void R_InitDynamicIndexBuffers()
 
 	GL_SetObjectName((uint64_t)dyn_index_buffer_memory, VK_OBJECT_TYPE_DEVICE_MEMORY, "Dynamic Index Buffers");
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		err = vkBindBufferMemory(vulkan_globals.device, dyn_index_buffers[i].buffer, dyn_index_buffer_memory, i * aligned_size);
 		if (err != VK_SUCCESS)
@@ -751,11 +1179,11 @@ static void R_InitDynamicIndexBuffers()
 	}
 
 	void * data;
-	err = vkMapMemory(vulkan_globals.device, dyn_index_buffer_memory, 0, NUM_DYNAMIC_BUFFERS * aligned_size, 0, &data);
+	err = vkMapMemory(vulkan_globals.device, dyn_index_buffer_memory, 0, FRAMES_IN_FLIGHT * aligned_size, 0, &data);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkMapMemory failed");
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 		dyn_index_buffers[i].data = (unsigned char *)data + (i * aligned_size);
 }
 
@@ -779,7 +1207,7 @@ static void R_InitDynamicUniformBuffers()
 	buffer_create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
 		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		dyn_uniform_buffers[i].current_offset = 0;
 
@@ -801,7 +1229,7 @@ static void R_InitDynamicUniformBuffers()
 	VkMemoryAllocateInfo memory_allocate_info;
 	memset(&memory_allocate_info, 0, sizeof(memory_allocate_info));
 	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = NUM_DYNAMIC_BUFFERS * aligned_size;
+	memory_allocate_info.allocationSize = FRAMES_IN_FLIGHT * aligned_size;
 	memory_allocate_info.memoryTypeIndex = GL_MemoryTypeFromProperties(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
 
 	VkMemoryAllocateFlagsInfo mem_alloc_flags = {
@@ -819,7 +1247,7 @@ static void R_InitDynamicUniformBuffers()
 
 	GL_SetObjectName((uint64_t)dyn_uniform_buffer_memory, VK_OBJECT_TYPE_DEVICE_MEMORY, "Dynamic Uniform Buffers");
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		err = vkBindBufferMemory(vulkan_globals.device, dyn_uniform_buffers[i].buffer, dyn_uniform_buffer_memory, i * aligned_size);
 		if (err != VK_SUCCESS)
@@ -827,11 +1255,11 @@ static void R_InitDynamicUniformBuffers()
 	}
 
 	void * data;
-	err = vkMapMemory(vulkan_globals.device, dyn_uniform_buffer_memory, 0, NUM_DYNAMIC_BUFFERS * aligned_size, 0, &data);
+	err = vkMapMemory(vulkan_globals.device, dyn_uniform_buffer_memory, 0, FRAMES_IN_FLIGHT * aligned_size, 0, &data);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkMapMemory failed");
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 		dyn_uniform_buffers[i].data = (unsigned char *)data + (i * aligned_size);
 
 	VkDescriptorSetAllocateInfo descriptor_set_allocate_info;
@@ -841,8 +1269,8 @@ static void R_InitDynamicUniformBuffers()
 	descriptor_set_allocate_info.descriptorSetCount = 1;
 	descriptor_set_allocate_info.pSetLayouts = &vulkan_globals.ubo_set_layout.handle;
 
-	ubo_descriptor_sets[0] = R_AllocateDescriptorSet(&vulkan_globals.ubo_set_layout);
-	ubo_descriptor_sets[1] = R_AllocateDescriptorSet(&vulkan_globals.ubo_set_layout);
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
+		ubo_descriptor_sets[i] = R_AllocateDescriptorSet(&vulkan_globals.ubo_set_layout);
 
 	VkDescriptorBufferInfo buffer_info;
 	memset(&buffer_info, 0, sizeof(buffer_info));
@@ -858,7 +1286,7 @@ static void R_InitDynamicUniformBuffers()
 	ubo_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	ubo_write.pBufferInfo = &buffer_info;
 
-	for (i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		buffer_info.buffer = dyn_uniform_buffers[i].buffer;
 		ubo_write.dstSet = ubo_descriptor_sets[i];
@@ -945,7 +1373,8 @@ R_SwapDynamicBuffers
 */
 void R_SwapDynamicBuffers()
 {
-	current_dyn_buffer_index = (current_dyn_buffer_index + 1) % NUM_DYNAMIC_BUFFERS;
+	// Dynamic buffers are used in lockstep with the frame command buffers
+	current_dyn_buffer_index = vulkan_globals.current_command_buffer;
 	dyn_vertex_buffers[current_dyn_buffer_index].current_offset = 0;
 	dyn_index_buffers[current_dyn_buffer_index].current_offset = 0;
 	dyn_uniform_buffers[current_dyn_buffer_index].current_offset = 0;
@@ -993,12 +1422,12 @@ static void R_AddDynamicBufferGarbage(VkDeviceMemory device_memory, dynbuffer_t
 	{
 		int * num_garbage = &num_buffer_garbage[current_garbage_index];
 		int old_num_buffer_garbage = *num_garbage;
-		*num_garbage += NUM_DYNAMIC_BUFFERS;
+		*num_garbage += FRAMES_IN_FLIGHT;
 		if (buffer_garbage[current_garbage_index] == NULL)
 			buffer_garbage[current_garbage_index] = malloc(sizeof(VkBuffer) * (*num_garbage));
 		else
 			buffer_garbage[current_garbage_index] = realloc(buffer_garbage[current_garbage_index], sizeof(VkBuffer) * (*num_garbage));
-		for (int i = 0; i < NUM_DYNAMIC_BUFFERS; ++i)
+		for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
 			buffer_garbage[current_garbage_index][old_num_buffer_garbage + i] = buffers[i].buffer;
 	}
 
@@ -1006,12 +1435,12 @@ static void R_AddDynamicBufferGarbage(VkDeviceMemory device_memory, dynbuffer_t
 	{
 		int * num_garbage = &num_desc_set_garbage[current_garbage_index];
 		int old_num_desc_set_garbage = *num_garbage;
-		*num_garbage += 2;
+		*num_garbage += FRAMES_IN_FLIGHT;
 		if (descriptor_set_garbage[current_garbage_index] == NULL)
 			descriptor_set_garbage[current_garbage_index] = malloc(sizeof(VkDescriptorSet) * (*num_garbage));
 		else
 			descriptor_set_garbage[current_garbage_index] = realloc(descriptor_set_garbage[current_garbage_index], sizeof(VkDescriptorSet) * (*num_garbage));
-		for (int i = 0; i < 2; ++i)
+		for (int i = 0; i < FRAMES_IN_FLIGHT; ++i)
 			descriptor_set_garbage[current_garbage_index][old_num_desc_set_garbage + i] = descriptor_sets[i];
 	}
 }
@@ -1108,6 +1537,142 @@ byte * R_IndexAllocate(int size, VkBuffer * buffer, VkDeviceSize * buffer_offset
 	return data;
 }
 
+/*
+================================================================================
+
+	RT GEOMETRY RING
+	Dynamic ray tracing geometry gets its own vertex and index buffers, one
+	pair per frame in flight. A pair is only touched after the fence of its
+	frame has signaled, so it is resized there to the high water mark of
+	previous frames and never reallocated while a frame is being built.
+	Every allocation of a frame is contiguous from the start of its buffer.
+
+================================================================================
+*/
+
+#define INITIAL_RT_GEOMETRY_VERTEX_SIZE_KB	4096
+#define INITIAL_RT_GEOMETRY_INDEX_SIZE_KB	1024
+
+typedef struct
+{
+	BufferResource_t	vertex;
+	BufferResource_t	index;
+	byte				*vertex_data;
+	byte				*index_data;
+} rtgeometrybuffer_t;
+
+static rtgeometrybuffer_t	rt_geometry_buffers[FRAMES_IN_FLIGHT];
+static rtgeometrybuffer_t	*rt_geometry;
+static uint32_t				rt_geometry_vertex_offset;
+static uint32_t				rt_geometry_index_offset;
+static uint32_t				rt_geometry_vertex_peak = INITIAL_RT_GEOMETRY_VERTEX_SIZE_KB * 1024;
+static uint32_t				rt_geometry_index_peak = INITIAL_RT_GEOMETRY_INDEX_SIZE_KB * 1024;
+
+/*
+===============
+R_CreateRTGeometryBuffer
+===============
+*/
+static void R_CreateRTGeometryBuffer(BufferResource_t * buffer, byte ** data, uint32_t size, VkBufferUsageFlags usage, const char * name)
+{
+	if (buffer->buffer != VK_NULL_HANDLE)
+	{
+		buffer_unmap(buffer);
+		buffer_destroy(buffer);
+		num_vulkan_dynbuf_allocations -= 1;
+	}
+
+	Sys_Printf("Reallocating %s (%u KB)\n", name, size / 1024);
+
+	if (buffer_create(buffer, size, usage | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+		Sys_Error("Failed to create %s", name);
+	num_vulkan_dynbuf_allocations += 1;
+
+	GL_SetObjectName((uint64_t)buffer->buffer, VK_OBJECT_TYPE_BUFFER, name);
+	*data = (byte *)buffer_map(buffer);
+}
+
+/*
+===============
+R_BeginRTGeometryFrame
+
+Called once the fence of the current command buffer has been waited on
+===============
+*/
+void R_BeginRTGeometryFrame(void)
+{
+	rt_geometry = &rt_geometry_buffers[vulkan_globals.current_command_buffer];
+
+	if (rt_geometry->vertex.size < rt_geometry_vertex_peak)
+		R_CreateRTGeometryBuffer(&rt_geometry->vertex, &rt_geometry->vertex_data, Q_nextPow2(rt_geometry_vertex_peak), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "RT Geometry Vertex Buffer");
+	if (rt_geometry->index.size < rt_geometry_index_peak)
+		R_CreateRTGeometryBuffer(&rt_geometry->index, &rt_geometry->index_data, Q_nextPow2(rt_geometry_index_peak), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, "RT Geometry Index Buffer");
+
+	rt_geometry_vertex_offset = 0;
+	rt_geometry_index_offset = 0;
+
+	vulkan_globals.rt_dynamic_vertex_buffer = rt_geometry->vertex.buffer;
+	vulkan_globals.rt_dynamic_index_buffer = rt_geometry->index.buffer;
+}
+
+/*
+===============
+R_RTGeometryAllocate
+
+Reserves vertices and indices together, so a full buffer never leaves one
+half of the pair behind. Returns false and reserves nothing if either of
+the frame's buffers is full. The demand is still recorded, so the buffers
+are big enough the next time they are used.
+===============
+*/
+qboolean R_RTGeometryAllocate(int vertex_size, int index_size, byte ** vertex_data, VkDeviceSize * vertex_offset, byte ** index_data, VkDeviceSize * index_offset)
+{
+	const uint32_t vertex_end = rt_geometry_vertex_offset + vertex_size;
+	const uint32_t index_end = rt_geometry_index_offset + ((index_size + 3) & ~3);
+
+	rt_geometry_vertex_peak = q_max(rt_geometry_vertex_peak, vertex_end);
+	rt_geometry_index_peak = q_max(rt_geometry_index_peak, index_end);
+	if (vertex_end > rt_geometry->vertex.size || index_end > rt_geometry->index.size)
+		return false;
+
+	*vertex_offset = rt_geometry_vertex_offset;
+	*index_offset = rt_geometry_index_offset;
+	*vertex_data = rt_geometry->vertex_data + rt_geometry_vertex_offset;
+	*index_data = rt_geometry->index_data + rt_geometry_index_offset;
+	rt_geometry_vertex_offset = vertex_end;
+	rt_geometry_index_offset = index_end;
+	return true;
+}
+
+/*
+===============
+R_DestroyRTGeometryBuffers
+===============
+*/
+void R_DestroyRTGeometryBuffers(void)
+{
+	int i;
+
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
+	{
+		rtgeometrybuffer_t *geometry = &rt_geometry_buffers[i];
+		if (geometry->vertex.buffer != VK_NULL_HANDLE)
+		{
+			buffer_unmap(&geometry->vertex);
+			buffer_destroy(&geometry->vertex);
+			num_vulkan_dynbuf_allocations -= 1;
+		}
+		if (geometry->index.buffer != VK_NULL_HANDLE)
+		{
+			buffer_unmap(&geometry->index);
+			buffer_destroy(&geometry->index);
+			num_vulkan_dynbuf_allocations -= 1;
+		}
+	}
+	rt_geometry = NULL;
+}
+
 /*
 ===============
 R_UniformAllocate
@@ -1717,6 +2282,251 @@ void R_InitSamplers()
 	TexMgr_UpdateTextureDescriptorSets();
 }
 
+/*
+================
+Pipeline cache
+
+The cache blob is stored in the user directory behind a small header of our
+own. The header repeats the identification data from the Vulkan cache header
+and adds the driver version, so a driver update or a different GPU discards
+the file instead of feeding the driver a stale blob.
+================
+*/
+#define PIPELINE_CACHE_FILENAME	"vkquake_pipelines.bin"
+#define PIPELINE_CACHE_MAGIC	(('C'<<24) | ('P'<<16) | ('K'<<8) | 'V')
+#define PIPELINE_CACHE_VERSION	1
+#define PIPELINE_CACHE_MAX_SIZE	(256 * 1024 * 1024)	// anything larger is treated as corrupt
+
+typedef struct
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	vendor_id;
+	uint32_t	device_id;
+	uint32_t	driver_version;
+	uint8_t		uuid[VK_UUID_SIZE];
+	uint32_t	data_size;
+} pipelinecacheheader_t;
+
+static size_t	pipeline_cache_loaded_size;
+static double	pipeline_creation_time;
+
+/*
+===============
+R_PipelineCachePath
+===============
+*/
+static const char * R_PipelineCachePath(void)
+{
+	return va("%s/%s", host_parms->userdir, PIPELINE_CACHE_FILENAME);
+}
+
+/*
+===============
+R_FillPipelineCacheHeader
+===============
+*/
+static void R_FillPipelineCacheHeader(pipelinecacheheader_t * header, uint32_t data_size)
+{
+	memset(header, 0, sizeof(pipelinecacheheader_t));
+	header->magic = PIPELINE_CACHE_MAGIC;
+	header->version = PIPELINE_CACHE_VERSION;
+	header->vendor_id = vulkan_globals.device_properties.vendorID;
+	header->device_id = vulkan_globals.device_properties.deviceID;
+	header->driver_version = vulkan_globals.device_properties.driverVersion;
+	memcpy(header->uuid, vulkan_globals.device_properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header->data_size = data_size;
+}
+
+/*
+===============
+R_LoadPipelineCacheData
+
+Returns a malloc'ed blob or NULL if there is no usable cache on disk
+===============
+*/
+static byte * R_LoadPipelineCacheData(size_t * size)
+{
+	pipelinecacheheader_t expected, header;
+	byte * data;
+	long file_size;
+	FILE * f;
+
+	*size = 0;
+	f = fopen(R_PipelineCachePath(), "rb");
+	if (!f)
+		return NULL;
+
+	fseek(f, 0, SEEK_END);
+	file_size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (fread(&header, sizeof(header), 1, f) != 1)
+	{
+		fclose(f);
+		return NULL;
+	}
+
+	R_FillPipelineCacheHeader(&expected, header.data_size);
+	if (memcmp(&header, &expected, sizeof(header)) != 0 || header.data_size == 0)
+	{
+		Con_Printf("Pipeline cache is from a different device or driver, discarding\n");
+		fclose(f);
+		return NULL;
+	}
+
+	// data_size comes from the file, check it before trusting it with an allocation
+	if (header.data_size > PIPELINE_CACHE_MAX_SIZE || file_size < 0 || header.data_size > (size_t)file_size - sizeof(header))
+	{
+		Con_Printf("Pipeline cache is truncated or corrupt, discarding\n");
+		fclose(f);
+		return NULL;
+	}
+
+	data = (byte *) malloc(header.data_size);
+	if (!data)
+	{
+		Con_Printf("Not enough memory for the pipeline cache, discarding\n");
+		fclose(f);
+		return NULL;
+	}
+
+	if (fread(data, header.data_size, 1, f) != 1)
+	{
+		Con_Printf("Pipeline cache is truncated, discarding\n");
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+
+	fclose(f);
+	*size = header.data_size;
+	return data;
+}
+
+/*
+===============
+R_InitPipelineCache
+===============
+*/
+void R_InitPipelineCache(void)
+{
+	VkPipelineCacheCreateInfo pipeline_cache_create_info;
+	byte * data = NULL;
+	size_t size = 0;
+	VkResult err;
+
+	assert(vulkan_globals.pipeline_cache == VK_NULL_HANDLE);
+
+	if (!COM_CheckParm("-nopipelinecache"))
+		data = R_LoadPipelineCacheData(&size);
+
+	memset(&pipeline_cache_create_info, 0, sizeof(pipeline_cache_create_info));
+	pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipeline_cache_create_info.initialDataSize = size;
+	pipeline_cache_create_info.pInitialData = data;
+
+	err = vkCreatePipelineCache(vulkan_globals.device, &pipeline_cache_create_info, NULL, &vulkan_globals.pipeline_cache);
+	if ((err != VK_SUCCESS) && (data != NULL))
+	{
+		// The driver is allowed to reject the blob. Start over with an empty cache.
+		Con_Printf("Pipeline cache rejected by driver, discarding\n");
+		size = 0;
+		pipeline_cache_create_info.initialDataSize = 0;
+		pipeline_cache_create_info.pInitialData = NULL;
+		err = vkCreatePipelineCache(vulkan_globals.device, &pipeline_cache_create_info, NULL, &vulkan_globals.pipeline_cache);
+	}
+	if (err != VK_SUCCESS)
+		Sys_Error("vkCreatePipelineCache failed");
+
+	free(data);
+
+	pipeline_cache_loaded_size = size;
+	if (size > 0)
+		Con_Printf("Loaded pipeline cache (%u KB)\n", (unsigned int)(size / 1024));
+
+	GL_SetObjectName((uint64_t)vulkan_globals.pipeline_cache, VK_OBJECT_TYPE_PIPELINE_CACHE, "pipeline cache");
+}
+
+/*
+===============
+R_SavePipelineCache
+
+Writes the cache to the user directory if it grew since it was loaded
+===============
+*/
+void R_SavePipelineCache(void)
+{
+	pipelinecacheheader_t header;
+	size_t size = 0;
+	byte * data;
+	FILE * f;
+
+	if (vulkan_globals.pipeline_cache == VK_NULL_HANDLE)
+		return;
+
+	if (vkGetPipelineCacheData(vulkan_globals.device, vulkan_globals.pipeline_cache, &size, NULL) != VK_SUCCESS || size == 0)
+		return;
+	if (size == pipeline_cache_loaded_size || size > PIPELINE_CACHE_MAX_SIZE)
+		return;
+
+	data = (byte *) malloc(size);
+	if (!data)
+		return;
+	if (vkGetPipelineCacheData(vulkan_globals.device, vulkan_globals.pipeline_cache, &size, data) != VK_SUCCESS)
+	{
+		free(data);
+		return;
+	}
+
+	f = fopen(R_PipelineCachePath(), "wb");
+	if (!f)
+	{
+		Con_Printf("Couldn't write %s\n", R_PipelineCachePath());
+		free(data);
+		return;
+	}
+
+	R_FillPipelineCacheHeader(&header, (uint32_t)size);
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(data, size, 1, f);
+	fclose(f);
+	free(data);
+
+	pipeline_cache_loaded_size = size;
+}
+
+/*
+===============
+R_DestroyPipelineCache
+===============
+*/
+void R_DestroyPipelineCache(void)
+{
+	R_SavePipelineCache();
+	vkDestroyPipelineCache(vulkan_globals.device, vulkan_globals.pipeline_cache, NULL);
+	vulkan_globals.pipeline_cache = VK_NULL_HANDLE;
+}
+
+/*
+===============
+R_PipelineCacheStats_f
+===============
+*/
+static void R_PipelineCacheStats_f(void)
+{
+	size_t size = 0;
+
+	if (vulkan_globals.pipeline_cache != VK_NULL_HANDLE)
+		vkGetPipelineCacheData(vulkan_globals.device, vulkan_globals.pipeline_cache, &size, NULL);
+
+	Con_Printf("Pipeline cache:\n");
+	Con_Printf(" File:     %s\n", R_PipelineCachePath());
+	Con_Printf(" Loaded:   %u KB\n", (unsigned int)(pipeline_cache_loaded_size / 1024));
+	Con_Printf(" Current:  %u KB\n", (unsigned int)(size / 1024));
+	Con_Printf(" Last pipeline creation: %.1f ms\n", pipeline_creation_time * 1000.0);
+}
+
 /*
 ===============
 R_CreateShaderModule
@@ -1754,6 +2564,7 @@ void R_CreatePipelines()
 	int render_pass;
 	int alpha_blend, alpha_test, fullbright_enabled;
 	VkResult err;
+	double start_time = Sys_DoubleTime();
 
 	Sys_Printf("Creating pipelines\n");
 
@@ -1917,7 +2728,7 @@ void R_CreatePipelines()
 		multisample_state_create_info.rasterizationSamples = (render_pass == 0) ? vulkan_globals.sample_count : VK_SAMPLE_COUNT_1_BIT;
 
 		assert(vulkan_globals.basic_alphatest_pipeline[render_pass].handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_alphatest_pipeline[render_pass].handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_alphatest_pipeline[render_pass].handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.basic_alphatest_pipeline[render_pass].layout = vulkan_globals.basic_pipeline_layout;
@@ -1943,7 +2754,7 @@ void R_CreatePipelines()
 		multisample_state_create_info.rasterizationSamples = (render_pass == 0) ? vulkan_globals.sample_count : VK_SAMPLE_COUNT_1_BIT;
 
 		assert(vulkan_globals.basic_notex_blend_pipeline[render_pass].handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_notex_blend_pipeline[render_pass].handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_notex_blend_pipeline[render_pass].handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.basic_notex_blend_pipeline[render_pass].layout = vulkan_globals.basic_pipeline_layout;
@@ -1955,7 +2766,7 @@ void R_CreatePipelines()
 	multisample_state_create_info.rasterizationSamples = vulkan_globals.sample_count;
 
 	assert(vulkan_globals.basic_poly_blend_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_poly_blend_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_poly_blend_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.basic_poly_blend_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -1969,7 +2780,7 @@ void R_CreatePipelines()
 		multisample_state_create_info.rasterizationSamples = (render_pass == 0) ? vulkan_globals.sample_count : VK_SAMPLE_COUNT_1_BIT;
 
 		assert(vulkan_globals.basic_blend_pipeline[render_pass].handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_blend_pipeline[render_pass].handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.basic_blend_pipeline[render_pass].handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.basic_blend_pipeline[render_pass].layout = vulkan_globals.basic_pipeline_layout;
@@ -1994,7 +2805,7 @@ void R_CreatePipelines()
 	pipeline_create_info.renderPass = vulkan_globals.warp_render_pass;
 
 	assert(vulkan_globals.raster_tex_warp_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.raster_tex_warp_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.raster_tex_warp_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.raster_tex_warp_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2015,7 +2826,7 @@ void R_CreatePipelines()
 	blend_attachment_state.blendEnable = VK_TRUE;
 
 	assert(vulkan_globals.particle_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.particle_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.particle_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.particle_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2084,7 +2895,7 @@ void R_CreatePipelines()
 		blend_attachment_state.dstAlphaBlendFactor = source_blend_factors[i];
 
 		assert(vulkan_globals.fte_particle_pipelines[i].handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.fte_particle_pipelines[i].handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.fte_particle_pipelines[i].handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.fte_particle_pipelines[i].layout = vulkan_globals.basic_pipeline_layout;
@@ -2096,7 +2907,7 @@ void R_CreatePipelines()
 			rasterization_state_create_info.polygonMode = VK_POLYGON_MODE_LINE;
 
 			assert(vulkan_globals.fte_particle_pipelines[i + 8].handle == VK_NULL_HANDLE);
-			err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.fte_particle_pipelines[i + 8].handle);
+			err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.fte_particle_pipelines[i + 8].handle);
 			if (err != VK_SUCCESS)
 				Sys_Error("vkCreateGraphicsPipelines failed");
 			vulkan_globals.fte_particle_pipelines[i + 8].layout = vulkan_globals.basic_pipeline_layout;
@@ -2123,7 +2934,7 @@ void R_CreatePipelines()
 	rasterization_state_create_info.depthBiasEnable = VK_FALSE;
 
 	assert(vulkan_globals.water_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.water_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.water_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.water_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2134,7 +2945,7 @@ void R_CreatePipelines()
 	blend_attachment_state.blendEnable = VK_TRUE;
 
 	assert(vulkan_globals.water_blend_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.water_blend_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.water_blend_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.water_blend_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2151,7 +2962,7 @@ void R_CreatePipelines()
 	dynamic_states[dynamic_state_create_info.dynamicStateCount++] = VK_DYNAMIC_STATE_DEPTH_BIAS;
 
 	assert(vulkan_globals.sprite_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.sprite_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.sprite_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.sprite_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2182,7 +2993,7 @@ void R_CreatePipelines()
 	blend_attachment_state.colorWriteMask = 0; 	// We only want to write stencil
 
 	assert(vulkan_globals.sky_stencil_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_stencil_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_stencil_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.sky_stencil_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2195,7 +3006,7 @@ void R_CreatePipelines()
 	shader_stages[1].module = basic_notex_frag_module;
 
 	assert(vulkan_globals.sky_color_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_color_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_color_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	vulkan_globals.sky_color_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2214,7 +3025,7 @@ void R_CreatePipelines()
 	shader_stages[1].module = sky_box_frag_module;
 
 	assert(vulkan_globals.sky_box_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_box_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_box_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.sky_box_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "sky_box");
@@ -2256,7 +3067,7 @@ void R_CreatePipelines()
 	pipeline_create_info.layout = vulkan_globals.sky_layer_pipeline.layout.handle;
 
 	assert(vulkan_globals.sky_layer_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_layer_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.sky_layer_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.sky_layer_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "sky_layer");
@@ -2296,7 +3107,7 @@ void R_CreatePipelines()
 		pipeline_create_info.layout = vulkan_globals.basic_pipeline_layout.handle;
 
 		assert(vulkan_globals.showtris_pipeline.handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.showtris_pipeline.handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.showtris_pipeline.handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.showtris_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2308,7 +3119,7 @@ void R_CreatePipelines()
 		rasterization_state_create_info.depthBiasSlopeFactor = 0.0f;
 
 		assert(vulkan_globals.showtris_depth_test_pipeline.handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.showtris_depth_test_pipeline.handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.showtris_depth_test_pipeline.handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.showtris_depth_test_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2319,7 +3130,7 @@ void R_CreatePipelines()
 		rasterization_state_create_info.depthBiasEnable = VK_FALSE;
 		input_assembly_state_create_info.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
 		assert(vulkan_globals.showbboxes_pipeline.handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.showbboxes_pipeline.handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.showbboxes_pipeline.handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		vulkan_globals.showbboxes_pipeline.layout = vulkan_globals.basic_pipeline_layout;
@@ -2410,7 +3221,7 @@ void R_CreatePipelines()
 				}
 
 				assert(vulkan_globals.world_pipelines[pipeline_index].handle == VK_NULL_HANDLE);
-				err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.world_pipelines[pipeline_index].handle);
+				err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.world_pipelines[pipeline_index].handle);
 				if (err != VK_SUCCESS)
 					Sys_Error("vkCreateGraphicsPipelines failed");
 				GL_SetObjectName((uint64_t)vulkan_globals.world_pipelines[pipeline_index].handle, VK_OBJECT_TYPE_PIPELINE, va("world %d", pipeline_index));
@@ -2474,7 +3285,7 @@ void R_CreatePipelines()
 	pipeline_create_info.layout = vulkan_globals.alias_pipeline.layout.handle;
 
 	assert(vulkan_globals.alias_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.alias_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "alias");
@@ -2482,7 +3293,7 @@ void R_CreatePipelines()
 	shader_stages[1].module = alias_alphatest_frag_module;
 
 	assert(vulkan_globals.alias_alphatest_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_alphatest_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_alphatest_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.alias_alphatest_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "alias_alphatest");
@@ -2493,7 +3304,7 @@ void R_CreatePipelines()
 	shader_stages[1].module = alias_frag_module;
 
 	assert(vulkan_globals.alias_blend_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_blend_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_blend_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.alias_blend_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "alias_blend");
@@ -2502,7 +3313,7 @@ void R_CreatePipelines()
 	shader_stages[1].module = alias_alphatest_frag_module;
 
 	assert(vulkan_globals.alias_alphatest_blend_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_alphatest_blend_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_alphatest_blend_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.alias_alphatest_blend_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "alias_alphatest_blend");
@@ -2523,7 +3334,7 @@ void R_CreatePipelines()
 		pipeline_create_info.layout = vulkan_globals.alias_pipeline.layout.handle;
 
 		assert(vulkan_globals.alias_showtris_pipeline.handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_showtris_pipeline.handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_showtris_pipeline.handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		GL_SetObjectName((uint64_t)vulkan_globals.alias_showtris_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "alias_showtris");
@@ -2535,7 +3346,7 @@ void R_CreatePipelines()
 		rasterization_state_create_info.depthBiasSlopeFactor = 0.0f;
 
 		assert(vulkan_globals.alias_showtris_depth_test_pipeline.handle == VK_NULL_HANDLE);
-		err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_showtris_depth_test_pipeline.handle);
+		err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.alias_showtris_depth_test_pipeline.handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateGraphicsPipelines failed");
 		GL_SetObjectName((uint64_t)vulkan_globals.alias_showtris_depth_test_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "alias_showtris_depth_test");
@@ -2565,7 +3376,7 @@ void R_CreatePipelines()
 	pipeline_create_info.subpass = 1;
 
 	assert(vulkan_globals.postprocess_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateGraphicsPipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &vulkan_globals.postprocess_pipeline.handle);
+	err = vkCreateGraphicsPipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &pipeline_create_info, NULL, &vulkan_globals.postprocess_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateGraphicsPipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.postprocess_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "postprocess");
@@ -2587,7 +3398,7 @@ void R_CreatePipelines()
 	compute_pipeline_create_info.layout = vulkan_globals.screen_effects_pipeline.layout.handle;
 
 	assert(vulkan_globals.screen_effects_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateComputePipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.screen_effects_pipeline.handle);
+	err = vkCreateComputePipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.screen_effects_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateComputePipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.screen_effects_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "screen_effects");
@@ -2595,7 +3406,7 @@ void R_CreatePipelines()
 	compute_shader_stage.module = (vulkan_globals.color_format == VK_FORMAT_A2B10G10R10_UNORM_PACK32) ? screen_effects_10bit_scale_comp_module : screen_effects_8bit_scale_comp_module;
 	compute_pipeline_create_info.stage = compute_shader_stage;
 	assert(vulkan_globals.screen_effects_scale_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateComputePipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.screen_effects_scale_pipeline.handle);
+	err = vkCreateComputePipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.screen_effects_scale_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateComputePipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.screen_effects_scale_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "screen_effects_scale");
@@ -2607,7 +3418,7 @@ void R_CreatePipelines()
 		compute_shader_stage.flags = VK_PIPELINE_SHADER_STAGE_CREATE_ALLOW_VARYING_SUBGROUP_SIZE_BIT_EXT | VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT_EXT;
 		compute_pipeline_create_info.stage = compute_shader_stage;
 		assert(vulkan_globals.screen_effects_scale_sops_pipeline.handle == VK_NULL_HANDLE);
-		err = vkCreateComputePipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.screen_effects_scale_sops_pipeline.handle);
+		err = vkCreateComputePipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.screen_effects_scale_sops_pipeline.handle);
 		if (err != VK_SUCCESS)
 			Sys_Error("vkCreateComputePipelines failed");
 		GL_SetObjectName((uint64_t)vulkan_globals.screen_effects_scale_sops_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "screen_effects_scale_sops");
@@ -2630,7 +3441,7 @@ void R_CreatePipelines()
 	compute_pipeline_create_info.layout = vulkan_globals.cs_tex_warp_pipeline.layout.handle;
 
 	assert(vulkan_globals.cs_tex_warp_pipeline.handle == VK_NULL_HANDLE);
-	err = vkCreateComputePipelines(vulkan_globals.device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.cs_tex_warp_pipeline.handle);
+	err = vkCreateComputePipelines(vulkan_globals.device, vulkan_globals.pipeline_cache, 1, &compute_pipeline_create_info, NULL, &vulkan_globals.cs_tex_warp_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateComputePipelines failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.cs_tex_warp_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "cs_tex_warp");
@@ -2766,7 +3577,7 @@ void R_CreatePipelines()
 	rt_pipeline_info.basePipelineIndex = -1;
 
 	assert(vulkan_globals.raygen_pipeline.handle == VK_NULL_HANDLE);
-	err = vulkan_globals.fpCreateRayTracingPipelinesKHR(vulkan_globals.device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &rt_pipeline_info, VK_NULL_HANDLE, &vulkan_globals.raygen_pipeline.handle);
+	err = vulkan_globals.fpCreateRayTracingPipelinesKHR(vulkan_globals.device, VK_NULL_HANDLE, vulkan_globals.pipeline_cache, 1, &rt_pipeline_info, VK_NULL_HANDLE, &vulkan_globals.raygen_pipeline.handle);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkCreateRayTracingPipelinesKHR failed");
 	GL_SetObjectName((uint64_t)vulkan_globals.raygen_pipeline.handle, VK_OBJECT_TYPE_PIPELINE, "raygen pipeline");
@@ -2893,6 +3704,12 @@ void R_CreatePipelines()
 	vkDestroyShaderModule(vulkan_globals.device, basic_alphatest_frag_module, NULL);
 	vkDestroyShaderModule(vulkan_globals.device, basic_frag_module, NULL);
 	vkDestroyShaderModule(vulkan_globals.device, basic_vert_module, NULL);
+
+	pipeline_creation_time = Sys_DoubleTime() - start_time;
+	Sys_Printf("Created pipelines in %.1f ms (%s pipeline cache)\n", pipeline_creation_time * 1000.0,
+		(pipeline_cache_loaded_size > 0) ? "warm" : "cold");
+
+	R_SavePipelineCache();
 }
 
 /*
@@ -3009,6 +3826,8 @@ void R_Init (void)
 	Cmd_AddCommand ("timerefresh", R_TimeRefresh_f);
 	Cmd_AddCommand ("pointfile", R_ReadPointFile_f);
 	Cmd_AddCommand ("vkmemstats", R_VulkanMemStats_f);
+	Cmd_AddCommand ("vkpipelinecache", R_PipelineCacheStats_f);
+	Cmd_AddCommand ("r_aliasbench", R_AliasBenchmark_f);
 
 	Cvar_RegisterVariable (&r_fullbright);
 	Cvar_RegisterVariable (&r_lightmap);
@@ -3314,6 +4133,19 @@ void R_TimeRefresh_f (void)
 	Con_Printf ("%f seconds (%f fps)\n", time, 128/time);
 }
 
+/*
+====================
+R_PrintHeapStats
+====================
+*/
+static void R_PrintHeapStats(const char * name, const glheapstats_t * stats)
+{
+	// 0% when all free memory is one block, approaching 100% when it is scattered in small holes
+	const double fragmentation = (stats->free_size > 0) ? 100.0 * (1.0 - (double)stats->largest_free_block / (double)stats->free_size) : 0.0;
+	Con_Printf(" %-8s %2d heaps %6u KB used %6u KB free %4d holes %5.1f%% fragmented\n", name, stats->num_heaps,
+		(unsigned int)((stats->total_size - stats->free_size) / 1024), (unsigned int)(stats->free_size / 1024), stats->num_free_nodes, fragmentation);
+}
+
 /*
 ====================
 R_VulkanMemStats_f
@@ -3321,12 +4153,26 @@ R_VulkanMemStats_f
 */
 void R_VulkanMemStats_f(void)
 {
+	glheapstats_t tex_stats, vertex_stats, index_stats;
+
 	Con_Printf("Vulkan allocations:\n");
 	Con_Printf(" Tex:    %d\n", num_vulkan_tex_allocations);
 	Con_Printf(" BModel: %d\n", num_vulkan_bmodel_allocations);
 	Con_Printf(" Mesh:   %d\n", num_vulkan_mesh_allocations);
 	Con_Printf(" Misc:   %d\n", num_vulkan_misc_allocations);
 	Con_Printf(" DynBuf: %d\n", num_vulkan_dynbuf_allocations);
+	memset(&tex_stats, 0, sizeof(tex_stats));
+	memset(&vertex_stats, 0, sizeof(vertex_stats));
+	memset(&index_stats, 0, sizeof(index_stats));
+	TexMgr_GetHeapStats(&tex_stats);
+	GLMesh_GetHeapStats(&vertex_stats, &index_stats);
+	Con_Printf("Heaps:\n");
+	R_PrintHeapStats("Tex", &tex_stats);
+	R_PrintHeapStats("Vertex", &vertex_stats);
+	R_PrintHeapStats("Index", &index_stats);
+	Con_Printf("RT geometry high water mark:\n");
+	Con_Printf(" Vertices: %u KB\n", rt_geometry_vertex_peak / 1024);
+	Con_Printf(" Indices:  %u KB\n", rt_geometry_index_peak / 1024);
 	Con_Printf("Descriptors:\n");
 	Con_Printf(" Combined image samplers: %d\n", num_vulkan_combined_image_samplers );
 	Con_Printf(" Dynamic UBOs: %d\n", num_vulkan_ubos_dynamic );
@@ -28,6 +28,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 static cvar_t	gl_max_size = {"gl_max_size", "0", CVAR_NONE};
 static cvar_t	gl_picmip = {"gl_picmip", "0", CVAR_NONE};
+static cvar_t	gl_texture_budget = {"gl_texture_budget", "0", CVAR_ARCHIVE}; //MB, 0 = use the driver's VK_EXT_memory_budget estimate
 
 extern cvar_t vid_filter;
 extern cvar_t vid_anisotropic;
@@ -35,6 +36,7 @@ extern cvar_t vid_anisotropic;
 #define	MAX_MIPS 16
 static int numgltextures;
 static gltexture_t	*active_gltextures, *free_gltextures;
+static gltexture_t	*gltextures; //base of the texture array, indexes into the raygen texture list
 gltexture_t		*notexture, *nulltexture, *whitetexture, *greytexture;
 
 unsigned int d_8to24table[256];
@@ -52,6 +54,22 @@ unsigned int d_8to24table_pants[256];
 static glheap_t ** texmgr_heaps;
 static int num_texmgr_heaps;
 
+// Residency
+#define TEXTURE_EVICT_MIN_AGE		120		// frames a texture has to be unused before it may be evicted
+#define TEXTURE_MAX_EVICTIONS		64		// per frame, bounds the hitch when pressure appears
+#define TEXTURE_BUDGET_FRACTION		0.9		// of the driver budget, headroom for other allocations
+
+static uint32_t		texture_memory_heap = UINT32_MAX;
+static VkDeviceSize	resident_texture_bytes;
+static int			num_texture_evictions;
+static int			num_texture_restores;
+
+// Raygen texture list, rewritten per descriptor set when its version is stale
+static VkDescriptorImageInfo	texture_image_infos[MAX_GLTEXTURES];
+static int						texture_list_version = 1;
+static int						raygen_list_version[FRAMES_IN_FLIGHT];
+static int						raygen_list_count[FRAMES_IN_FLIGHT];
+
 /*
 ================================================================================
 
@@ -105,7 +123,8 @@ void TexMgr_UpdateTextureDescriptorSets(void)
 	gltexture_t	*glt;
 
 	for (glt = active_gltextures; glt; glt = glt->next)
-		TexMgr_SetFilterModes (glt);
+		if (!glt->evicted)
+			TexMgr_SetFilterModes (glt);
 }
 
 /*
@@ -132,6 +151,83 @@ static void TexMgr_Imagelist_f (void)
 	Con_Printf ("%i textures %i pixels %1.1f megabytes\n", numgltextures, (int)texels, mb);
 }
 
+/*
+===============
+TexMgr_TextureBudget
+
+Bytes textures may occupy. Driver budget minus what the rest of the device
+memory heap is already using, or gl_texture_budget if set.
+===============
+*/
+static qboolean TexMgr_TextureBudget (VkDeviceSize *budget)
+{
+	VkDeviceSize heap_budget, heap_usage;
+	glheapstats_t stats;
+
+	if (gl_texture_budget.value > 0)
+	{
+		*budget = (VkDeviceSize)gl_texture_budget.value * 1024 * 1024;
+		return true;
+	}
+
+	if (!GL_GetMemoryBudget (texture_memory_heap, &heap_budget, &heap_usage))
+		return false;
+
+	memset (&stats, 0, sizeof(stats));
+	GL_AccumulateHeapStats (num_texmgr_heaps, texmgr_heaps, &stats);
+
+	const VkDeviceSize other_usage = (heap_usage > stats.total_size) ? (heap_usage - stats.total_size) : 0;
+	const VkDeviceSize usable = (VkDeviceSize)(heap_budget * TEXTURE_BUDGET_FRACTION);
+	*budget = (usable > other_usage) ? (usable - other_usage) : 0;
+	return true;
+}
+
+/*
+===============
+TexMgr_Residency_f -- report resident and evicted texture memory
+===============
+*/
+static void TexMgr_Residency_f (void)
+{
+	gltexture_t	*glt;
+	VkDeviceSize resident_bytes = 0, evicted_bytes = 0, budget;
+	int num_resident = 0, num_evicted = 0;
+
+	for (glt = active_gltextures; glt; glt = glt->next)
+	{
+		if (glt->evicted)
+		{
+			num_evicted++;
+			evicted_bytes += glt->resident_size;
+			if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "list"))
+				Con_SafePrintf ("   %6u KB %s\n", (unsigned int)(glt->resident_size / 1024), glt->name);
+		}
+		else if (glt->image_view != VK_NULL_HANDLE)
+		{
+			num_resident++;
+			resident_bytes += glt->resident_size;
+		}
+	}
+
+	Con_Printf ("%i textures resident, %u KB\n", num_resident, (unsigned int)(resident_bytes / 1024));
+	Con_Printf ("%i textures evicted, %u KB\n", num_evicted, (unsigned int)(evicted_bytes / 1024));
+	if (TexMgr_TextureBudget (&budget))
+		Con_Printf ("budget %u KB (%s)\n", (unsigned int)(budget / 1024), (gl_texture_budget.value > 0) ? "gl_texture_budget" : "driver");
+	else
+		Con_Printf ("no budget, set gl_texture_budget to enable eviction\n");
+	Con_Printf ("%i evictions, %i restores\n", num_texture_evictions, num_texture_restores);
+}
+
+/*
+===============
+TexMgr_GetHeapStats
+===============
+*/
+void TexMgr_GetHeapStats (glheapstats_t *stats)
+{
+	GL_AccumulateHeapStats (num_texmgr_heaps, texmgr_heaps, stats);
+}
+
 /*
 ================================================================================
 
@@ -174,6 +270,9 @@ gltexture_t *TexMgr_NewTexture (void)
 	free_gltextures = glt->next;
 	glt->next = active_gltextures;
 	active_gltextures = glt;
+	glt->last_used_frame = 0;
+	glt->evicted = false;
+	glt->pinned = false;
 
 	numgltextures++;
 	return glt;
@@ -376,79 +475,225 @@ void TexMgr_NewGame (void)
 	TexMgr_LoadPalette ();
 }
 
-void TexMgr_LoadActiveTextures(void)
+/*
+================================================================================
+
+	RESIDENCY
+
+================================================================================
+*/
+
+/*
+================
+TexMgr_DescriptorIndex
+
+Slot of the texture in the raygen texture list. Stable for the lifetime of the
+texture, also while it is evicted.
+================
+*/
+int TexMgr_DescriptorIndex (gltexture_t *glt)
 {
+	return glt ? (int)(glt - gltextures) : -1;
+}
+
+/*
+================
+TexMgr_TouchTexture
 
-	// TODO: Only run when loading new level or on respawn
-	free(vulkan_globals.texture_list);
-	VkDescriptorImageInfo* texture_image_infos = (VkDescriptorImageInfo*)malloc(MAX_GLTEXTURES * sizeof(VkDescriptorImageInfo));
-	memset(texture_image_infos, 0, MAX_GLTEXTURES * sizeof(VkDescriptorImageInfo));
+Marks the texture as used this frame and brings it back if it was evicted
+================
+*/
+void TexMgr_TouchTexture (gltexture_t *glt)
+{
+	if (!glt)
+		return;
 
-	gltexture_t* current_texture = active_gltextures;
+	glt->last_used_frame = r_framecount;
+	if (glt->evicted)
+	{
+		glt->evicted = false;
+		TexMgr_ReloadImage (glt, -1, -1);
+		num_texture_restores++;
+	}
+}
 
-	int maxImageIndex = -1;
+/*
+================
+TexMgr_PinTexture
 
-	qboolean last_check = false;
-	while (current_texture->next != NULL && !last_check) {
-		glheapnode_t* heapnode = current_texture->heap_node;
+The texture is referenced by geometry that isn't drawn through the touch
+path, such as the static brush model BLAS, and has to stay resident
+================
+*/
+void TexMgr_PinTexture (gltexture_t *glt)
+{
+	if (!glt)
+		return;
 
-		int imageview_index = -1;
-			
-		while (heapnode->prev != NULL) {
-			heapnode = heapnode->prev;
-			imageview_index++;
-		}
+	TexMgr_TouchTexture (glt);
+	glt->pinned = true;
+}
 
-		if (imageview_index > maxImageIndex) {
-			maxImageIndex = imageview_index;
-		}
+/*
+================
+TexMgr_UnpinTextures
+================
+*/
+void TexMgr_UnpinTextures (void)
+{
+	gltexture_t	*glt;
+
+	for (glt = active_gltextures; glt; glt = glt->next)
+		glt->pinned = false;
+}
+
+/*
+================
+TexMgr_EvictTexture
+================
+*/
+static void TexMgr_EvictTexture (gltexture_t *glt)
+{
+	GL_DeleteTexture (glt);
+
+	// Raster code may still bind the texture, show the checker until it's touched again
+	glt->descriptor_set = notexture->descriptor_set;
+	glt->evicted = true;
+	num_texture_evictions++;
+}
+
+/*
+================
+TexMgr_IsEvictable
+================
+*/
+static qboolean TexMgr_IsEvictable (gltexture_t *glt)
+{
+	if (glt->evicted || glt->pinned || glt->image_view == VK_NULL_HANDLE || !glt->owner)
+		return false;
+	if (glt->flags & (TEXPREF_PERSIST | TEXPREF_WARPIMAGE))
+		return false;
+	// Only textures that can be reread from disk, in memory sources may be gone
+	if (glt->source_format == SRC_LIGHTMAP || !glt->source_file[0])
+		return false;
+	// Never touched by the renderer, so its use isn't tracked
+	if (glt->last_used_frame == 0)
+		return false;
+	return (r_framecount - glt->last_used_frame) > TEXTURE_EVICT_MIN_AGE;
+}
+
+/*
+================
+TexMgr_LastUsedCompare
+================
+*/
+static int TexMgr_LastUsedCompare (const void *a, const void *b)
+{
+	const gltexture_t *glt_a = *(const gltexture_t **)a;
+	const gltexture_t *glt_b = *(const gltexture_t **)b;
+	return glt_a->last_used_frame - glt_b->last_used_frame;
+}
+
+/*
+================
+TexMgr_UpdateResidency
+
+Evicts the least recently used textures while the resident set is over budget
+================
+*/
+static void TexMgr_UpdateResidency (void)
+{
+	static gltexture_t *candidates[MAX_GLTEXTURES];
+	gltexture_t *glt;
+	VkDeviceSize budget, resident;
+	int i, num_candidates = 0;
+
+	if (!TexMgr_TextureBudget (&budget) || resident_texture_bytes <= budget)
+		return;
+
+	for (glt = active_gltextures; glt; glt = glt->next)
+		if (TexMgr_IsEvictable (glt))
+			candidates[num_candidates++] = glt;
 
-		texture_image_infos[imageview_index].imageView = current_texture->image_view;
-		texture_image_infos[imageview_index].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		texture_image_infos[imageview_index].sampler = vulkan_globals.linear_sampler_lod_bias;
+	qsort (candidates, num_candidates, sizeof(gltexture_t *), TexMgr_LastUsedCompare);
 
-		current_texture = current_texture->next;
+	resident = resident_texture_bytes;
+	for (i = 0; i < num_candidates && i < TEXTURE_MAX_EVICTIONS && resident > budget; ++i)
+	{
+		resident -= candidates[i]->resident_size;
+		TexMgr_EvictTexture (candidates[i]);
 	}
+}
 
-	// only update descriptor set when active texture count changes
-	if (maxImageIndex != vulkan_globals.texture_list_count) {
+/*
+================
+TexMgr_LoadActiveTextures
 
-		// reallocates descriptor sets when texture count is lower then before
-		// because descriptors would still keep old texture data even after update
-		if (maxImageIndex < vulkan_globals.texture_list_count) {
-			vulkan_globals.raygen_desc_set[0] = R_AllocateDescriptorSet(&vulkan_globals.raygen_set_layout);
-			vulkan_globals.raygen_desc_set[1] = R_AllocateDescriptorSet(&vulkan_globals.raygen_set_layout);
-		}
+Updates residency and the raygen texture list of the current frame
+================
+*/
+void TexMgr_LoadActiveTextures (void)
+{
+	const int cb_index = vulkan_globals.current_command_buffer;
+	gltexture_t *glt;
+	int i, index, count = 0, write_count;
 
-		// They may be empty imageviews, but i still have to set a valid sampler and image layout 
-		for (int i = 0; i < MAX_GLTEXTURES; i++) {
-			VkDescriptorImageInfo image_info = texture_image_infos[i];
-			if (image_info.sampler == NULL) {
-				texture_image_infos[i].imageView = VK_NULL_HANDLE;
-				texture_image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				texture_image_infos[i].sampler = vulkan_globals.linear_sampler_lod_bias;
-			}
-		}
+	TexMgr_UpdateResidency ();
 
-		vulkan_globals.texture_list = texture_image_infos;
-		vulkan_globals.texture_list_count = maxImageIndex;
+	if (raygen_list_version[cb_index] == texture_list_version)
+		return;
 
-		VkWriteDescriptorSet raygen_writes[2];
-		memset(&raygen_writes, 0, sizeof(raygen_writes));
+	for (glt = active_gltextures; glt; glt = glt->next)
+		if (glt->image_view != VK_NULL_HANDLE)
+			count = q_max (count, TexMgr_DescriptorIndex (glt) + 1);
 
-		for (int i = 0; i < 2; i++) {
-			raygen_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			raygen_writes[i].dstBinding = 7;
-			raygen_writes[i].descriptorCount = maxImageIndex;
-			raygen_writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			raygen_writes[i].dstSet = vulkan_globals.raygen_desc_set[i];
-			raygen_writes[i].pImageInfo = vulkan_globals.texture_list;
-		}
+	// Free and evicted slots keep a valid image, stale entries past count are overwritten too
+	write_count = q_max (count, raygen_list_count[cb_index]);
+	for (i = 0; i < write_count; ++i)
+	{
+		texture_image_infos[i].imageView = notexture->image_view;
+		texture_image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		texture_image_infos[i].sampler = vulkan_globals.linear_sampler_lod_bias;
+	}
+	for (glt = active_gltextures; glt; glt = glt->next)
+	{
+		if (glt->image_view == VK_NULL_HANDLE)
+			continue;
+		index = TexMgr_DescriptorIndex (glt);
+		texture_image_infos[index].imageView = glt->image_view;
+	}
 
- 		vkUpdateDescriptorSets(vulkan_globals.device, 2, raygen_writes, 0, NULL);
+	vulkan_globals.texture_list = texture_image_infos;
+	vulkan_globals.texture_list_count = count;
+
+	if (write_count > 0)
+	{
+		VkWriteDescriptorSet raygen_write;
+		memset (&raygen_write, 0, sizeof(raygen_write));
+		raygen_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		raygen_write.dstBinding = 7;
+		raygen_write.descriptorCount = write_count;
+		raygen_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		raygen_write.dstSet = vulkan_globals.raygen_desc_set[cb_index];
+		raygen_write.pImageInfo = texture_image_infos;
+		vkUpdateDescriptorSets (vulkan_globals.device, 1, &raygen_write, 0, NULL);
 	}
 
-	//free(texture_image_infos);
+	raygen_list_version[cb_index] = texture_list_version;
+	raygen_list_count[cb_index] = count;
+}
+
+/*
+================
+TexMgr_InvalidateTextureList
+
+Called when the raygen descriptor sets were reallocated
+================
+*/
+void TexMgr_InvalidateTextureList (void)
+{
+	memset (raygen_list_version, 0, sizeof(raygen_list_version));
+	memset (raygen_list_count, 0, sizeof(raygen_list_count));
 }
 
 /*
@@ -469,6 +714,7 @@ void TexMgr_Init (void)
 
 	// init texture list
 	free_gltextures = (gltexture_t *) Hunk_AllocName (MAX_GLTEXTURES * sizeof(gltexture_t), "gltextures");
+	gltextures = free_gltextures;
 	active_gltextures = NULL;
 	for (i = 0; i < MAX_GLTEXTURES - 1; i++)
 		free_gltextures[i].next = &free_gltextures[i+1];
@@ -480,7 +726,9 @@ void TexMgr_Init (void)
 
 	Cvar_RegisterVariable (&gl_max_size);
 	Cvar_RegisterVariable (&gl_picmip);
+	Cvar_RegisterVariable (&gl_texture_budget);
 	Cmd_AddCommand ("imagelist", &TexMgr_Imagelist_f);
+	Cmd_AddCommand ("texresidency", &TexMgr_Residency_f);
 
 	// load notexture images
 	notexture = TexMgr_LoadImage (NULL, "notexture", 2, 2, SRC_RGBA, notexture_data, "", (src_offset_t)notexture_data, TEXPREF_NEAREST | TEXPREF_PERSIST | TEXPREF_NOPICMIP);
@@ -919,6 +1167,12 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 	if (err != VK_SUCCESS)
 		Sys_Error("vkBindImageMemory failed");
 
+	texture_memory_heap = vulkan_globals.memory_properties.memoryTypes[memory_type_index].heapIndex;
+	glt->resident_size = memory_requirements.size;
+	glt->evicted = false;
+	resident_texture_bytes += glt->resident_size;
+	texture_list_version++;
+
 	VkImageViewCreateInfo image_view_create_info;
 	memset(&image_view_create_info, 0, sizeof(image_view_create_info));
 	image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1009,7 +1263,11 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 	VkBuffer staging_buffer;
 	VkCommandBuffer command_buffer;
 	int staging_offset;
-	unsigned char * staging_memory = R_StagingAllocate(staging_size, 4, &command_buffer, &staging_buffer, &staging_offset);
+	// Lightmaps are rewritten in place through the graphics staging buffers, so they never change queue family
+	const qboolean async_upload = vulkan_globals.async_transfer && (glt->source_format != SRC_LIGHTMAP);
+	unsigned char * staging_memory = async_upload
+		? R_TransferAllocate(staging_size, 4, &command_buffer, &staging_buffer, &staging_offset)
+		: R_StagingAllocate(staging_size, 4, &command_buffer, &staging_buffer, &staging_offset);
 
 	int num_regions = 0;
 	int mip_offset = 0;
@@ -1072,6 +1330,13 @@ static void TexMgr_LoadImage32 (gltexture_t *glt, unsigned *data)
 
 	vkCmdCopyBufferToImage(command_buffer, staging_buffer, glt->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, num_mips, regions);
 
+	if (async_upload)
+	{
+		// The graphics queue acquires the image before the next frame that may sample it
+		R_TransferReleaseImage(command_buffer, &image_memory_barrier, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		return;
+	}
+
 	image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
 	image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 	image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
@@ -1427,8 +1692,8 @@ typedef struct
 } texture_garbage_t;
 
 static int current_garbage_index;
-static int num_garbage_textures[2];
-static texture_garbage_t texture_garbage[MAX_GLTEXTURES][2];
+static int num_garbage_textures[FRAMES_IN_FLIGHT];
+static texture_garbage_t texture_garbage[MAX_GLTEXTURES][FRAMES_IN_FLIGHT];
 
 /*
 ================
@@ -1441,7 +1706,7 @@ void TexMgr_CollectGarbage (void)
 	int i;
 	texture_garbage_t * garbage;
 
-	current_garbage_index = (current_garbage_index + 1) % 2;
+	current_garbage_index = (current_garbage_index + 1) % FRAMES_IN_FLIGHT;
 	num = num_garbage_textures[current_garbage_index];
 	for (i=0; i<num; ++i)
 	{
@@ -1476,6 +1741,10 @@ static void GL_DeleteTexture (gltexture_t *texture)
 	if (texture->image_view == VK_NULL_HANDLE)
 		return;
 
+	resident_texture_bytes -= texture->resident_size;
+	texture_list_version++;
+	R_CancelTransferAcquire(texture->image);
+
 	if (in_update_screen)
 	{
 		garbage_index = num_garbage_textures[current_garbage_index]++;
@@ -73,6 +73,11 @@ typedef struct gltexture_s {
 	VkDescriptorSet		descriptor_set;
 	VkFramebuffer		frame_buffer;
 	VkDescriptorSet		warp_write_descriptor_set;
+//managed by residency
+	VkDeviceSize		resident_size; //bytes of device memory, kept while evicted
+	int					last_used_frame;
+	qboolean			evicted; //image was released under memory pressure, reloaded from source when touched
+	qboolean			pinned; //referenced by the static brush model geometry, never evicted
 } gltexture_t;
 
 extern gltexture_t *notexture;
@@ -112,6 +117,15 @@ int TexMgr_PadConditional (int s);
 
 void TexMgr_UpdateTextureDescriptorSets(void);
 
+int TexMgr_DescriptorIndex (gltexture_t *glt);
+void TexMgr_TouchTexture (gltexture_t *glt);
+void TexMgr_PinTexture (gltexture_t *glt);
+void TexMgr_UnpinTextures (void);
+void TexMgr_InvalidateTextureList (void);
+
+struct glheapstats_s;
+void TexMgr_GetHeapStats (struct glheapstats_s *stats);
+
 
 #endif	/* _GL_TEXMAN_H */
 
@@ -41,7 +41,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define MAXWIDTH		10000
 #define MAXHEIGHT		10000
 
-#define NUM_COMMAND_BUFFERS 2
 #define MAX_SWAP_CHAIN_IMAGES 8
 #define REQUIRED_COLOR_BUFFER_FEATURES ( VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT | \
 										 VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | \
@@ -98,6 +97,9 @@ static cvar_t	vid_refreshrate = { "vid_refreshrate", "60", CVAR_ARCHIVE };
 static cvar_t	vid_vsync = { "vid_vsync", "0", CVAR_ARCHIVE };
 static cvar_t	vid_desktopfullscreen = { "vid_desktopfullscreen", "0", CVAR_ARCHIVE }; // QuakeSpasm
 static cvar_t	vid_borderless = { "vid_borderless", "0", CVAR_ARCHIVE }; // QuakeSpasm
+static cvar_t	vid_frames_in_flight = { "vid_frames_in_flight", "2", CVAR_ARCHIVE };
+static cvar_t	vid_lowlatency = { "vid_lowlatency", "0", CVAR_ARCHIVE };
+static cvar_t	vid_lowlatency_margin = { "vid_lowlatency_margin", "1", CVAR_ARCHIVE };
 cvar_t	vid_rt_samples = { "vid_rt_samples", "1", CVAR_ARCHIVE };
 cvar_t	vid_rt_depth = { "vid_rt_depth", "2", CVAR_ARCHIVE };
 cvar_t	vid_filter = { "vid_filter", "0", CVAR_ARCHIVE };
@@ -119,15 +121,16 @@ static VkSwapchainKHR				vulkan_swapchain;
 static uint32_t						num_swap_chain_images;
 static qboolean						render_resources_created = false;
 static uint32_t						current_command_buffer;
+static uint32_t						num_frames_in_flight = 2;
 static VkCommandPool				command_pool;
 static VkCommandPool				transient_command_pool;
-static VkCommandBuffer				command_buffers[NUM_COMMAND_BUFFERS];
-static VkFence						command_buffer_fences[NUM_COMMAND_BUFFERS];
-static qboolean						command_buffer_submitted[NUM_COMMAND_BUFFERS];
+static VkCommandBuffer				command_buffers[FRAMES_IN_FLIGHT];
+static VkFence						command_buffer_fences[FRAMES_IN_FLIGHT];
+static qboolean						command_buffer_submitted[FRAMES_IN_FLIGHT];
 static VkFramebuffer				main_framebuffers[NUM_COLOR_BUFFERS];
 static VkFramebuffer				raytrace_framebuffer[NUM_COLOR_BUFFERS];
-static VkSemaphore					image_aquired_semaphores[NUM_COMMAND_BUFFERS];
-static VkSemaphore					draw_complete_semaphores[NUM_COMMAND_BUFFERS];
+static VkSemaphore					image_aquired_semaphores[FRAMES_IN_FLIGHT];
+static VkSemaphore					draw_complete_semaphores[FRAMES_IN_FLIGHT];
 static VkFramebuffer				ui_framebuffers[MAX_SWAP_CHAIN_IMAGES];
 static VkImage						swapchain_images[MAX_SWAP_CHAIN_IMAGES];
 static VkImageView					swapchain_images_views[MAX_SWAP_CHAIN_IMAGES];
@@ -820,6 +823,10 @@ static void GL_InitDevice(void)
 			if (strcmp(VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME, device_extensions[i].extensionName) == 0)
 				subgroup_size_control = true;
 #endif
+#if defined(VK_EXT_memory_budget)
+			if (strcmp(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, device_extensions[i].extensionName) == 0)
+				vulkan_globals.memory_budget = true;
+#endif
 #if defined(VK_EXT_full_screen_exclusive)
 			// Only enable on NVIDIA for now. Some people report issues with the mouse cursor on AMD hardware.
 			if (strcmp(VK_EXT_FULL_SCREEN_EXCLUSIVE_EXTENSION_NAME, device_extensions[i].extensionName) == 0)
@@ -866,6 +873,21 @@ static void GL_InitDevice(void)
 		{
 			found_graphics_queue = true;
 			vulkan_globals.gfx_queue_family_index = i;
+			vulkan_globals.timestamp_valid_bits = queue_family_properties[i].timestampValidBits;
+			break;
+		}
+	}
+
+	// Dedicated DMA queue for uploads, only used if it can copy whole mips of any size
+	vulkan_globals.transfer_queue_family_index = UINT32_MAX;
+	for (i = 0; i < vulkan_queue_count; ++i)
+	{
+		const VkQueueFlags flags = queue_family_properties[i].queueFlags;
+		const VkExtent3D granularity = queue_family_properties[i].minImageTransferGranularity;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+			&& granularity.width == 1 && granularity.height == 1 && granularity.depth == 1)
+		{
+			vulkan_globals.transfer_queue_family_index = i;
 			break;
 		}
 	}
@@ -877,12 +899,13 @@ static void GL_InitDevice(void)
 		Sys_Error("Couldn't find graphics queue");
 
 	float queue_priorities[] = { 0.0 };
-	VkDeviceQueueCreateInfo queue_create_info;
-	memset(&queue_create_info, 0, sizeof(queue_create_info));
-	queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queue_create_info.queueFamilyIndex = vulkan_globals.gfx_queue_family_index;
-	queue_create_info.queueCount = 1;
-	queue_create_info.pQueuePriorities = queue_priorities;
+	VkDeviceQueueCreateInfo queue_create_infos[2];
+	uint32_t num_queue_create_infos = 1;
+	memset(queue_create_infos, 0, sizeof(queue_create_infos));
+	queue_create_infos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+	queue_create_infos[0].queueFamilyIndex = vulkan_globals.gfx_queue_family_index;
+	queue_create_infos[0].queueCount = 1;
+	queue_create_infos[0].pQueuePriorities = queue_priorities;
 
 #if defined(VK_EXT_subgroup_size_control)
 	VkPhysicalDeviceSubgroupProperties physical_device_subgroup_properties;
@@ -935,7 +958,7 @@ static void GL_InitDevice(void)
 		Con_Printf("Using subgroup operations\n");
 #endif
 
-	const char* device_extensions[9] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+	const char* device_extensions[10] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 	uint32_t numEnabledExtensions = 1;
 	if (vulkan_globals.dedicated_allocation) {
 		device_extensions[numEnabledExtensions++] = VK_KHR_GET_MEMORY_REQUIREMENTS_2_EXTENSION_NAME;
@@ -949,6 +972,10 @@ static void GL_InitDevice(void)
 	if (vulkan_globals.full_screen_exclusive) {
 		device_extensions[numEnabledExtensions++] = VK_EXT_FULL_SCREEN_EXCLUSIVE_EXTENSION_NAME;
 	}
+#endif
+#if defined(VK_EXT_memory_budget)
+	if (vulkan_globals.memory_budget)
+		device_extensions[numEnabledExtensions++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
 #endif
 	//Ray tracing pipeline extension
 	device_extensions[numEnabledExtensions++] = VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME;
@@ -1058,6 +1085,20 @@ static void GL_InitDevice(void)
 
 	vulkan_globals.non_solid_fill = (vulkan_physical_device_features.fillModeNonSolid == VK_TRUE) ? true : false;
 
+	// Uploads on the transfer queue signal a timeline semaphore the frame submit waits on
+	vulkan_globals.async_transfer = (vulkan_globals.transfer_queue_family_index != UINT32_MAX)
+		&& (device_features_vk12.timelineSemaphore == VK_TRUE)
+		&& !COM_CheckParm("-noasynctransfer");
+	if (vulkan_globals.async_transfer)
+	{
+		queue_create_infos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queue_create_infos[1].queueFamilyIndex = vulkan_globals.transfer_queue_family_index;
+		queue_create_infos[1].queueCount = 1;
+		queue_create_infos[1].pQueuePriorities = queue_priorities;
+		num_queue_create_infos = 2;
+		Con_Printf("Using transfer queue family %u for uploads\n", vulkan_globals.transfer_queue_family_index);
+	}
+
 	VkDeviceCreateInfo device_create_info;
 	memset(&device_create_info, 0, sizeof(device_create_info));
 	device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -1065,8 +1106,8 @@ static void GL_InitDevice(void)
 	//#if defined(VK_EXT_subgroup_size_control)
 	//	device_create_info.pNext = vulkan_globals.screen_effects_sops ? &subgroup_size_control_features : NULL;
 	//#endif
-	device_create_info.queueCreateInfoCount = 1;
-	device_create_info.pQueueCreateInfos = &queue_create_info;
+	device_create_info.queueCreateInfoCount = num_queue_create_infos;
+	device_create_info.pQueueCreateInfos = queue_create_infos;
 	device_create_info.enabledExtensionCount = numEnabledExtensions;
 	device_create_info.ppEnabledExtensionNames = device_extensions;
 	//device_create_info.pEnabledFeatures = &device_features;
@@ -1121,6 +1162,8 @@ static void GL_InitDevice(void)
 #endif
 
 	vkGetDeviceQueue(vulkan_globals.device, vulkan_globals.gfx_queue_family_index, 0, &vulkan_globals.queue);
+	if (vulkan_globals.async_transfer)
+		vkGetDeviceQueue(vulkan_globals.device, vulkan_globals.transfer_queue_family_index, 0, &vulkan_globals.transfer_queue);
 
 	VkFormatProperties format_properties;
 
@@ -1206,7 +1249,7 @@ static void GL_InitCommandBuffers(void)
 	memset(&command_buffer_allocate_info, 0, sizeof(command_buffer_allocate_info));
 	command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	command_buffer_allocate_info.commandPool = command_pool;
-	command_buffer_allocate_info.commandBufferCount = NUM_COMMAND_BUFFERS;
+	command_buffer_allocate_info.commandBufferCount = FRAMES_IN_FLIGHT;
 
 	err = vkAllocateCommandBuffers(vulkan_globals.device, &command_buffer_allocate_info, command_buffers);
 	if (err != VK_SUCCESS)
@@ -1216,7 +1259,7 @@ static void GL_InitCommandBuffers(void)
 	memset(&fence_create_info, 0, sizeof(fence_create_info));
 	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-	for (i = 0; i < NUM_COMMAND_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		err = vkCreateFence(vulkan_globals.device, &fence_create_info, NULL, &command_buffer_fences[i]);
 		if (err != VK_SUCCESS)
@@ -1933,7 +1976,9 @@ static qboolean GL_CreateSwapChain(void)
 	swapchain_create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapchain_create_info.pNext = NULL;
 	swapchain_create_info.surface = vulkan_surface;
-	swapchain_create_info.minImageCount = 2;
+	swapchain_create_info.minImageCount = q_max(2, CLAMP(1, (int)vid_frames_in_flight.value, FRAMES_IN_FLIGHT));
+	if (vulkan_surface_capabilities.maxImageCount > 0)
+		swapchain_create_info.minImageCount = q_min(swapchain_create_info.minImageCount, vulkan_surface_capabilities.maxImageCount);
 	swapchain_create_info.imageFormat = swap_chain_format;
 	swapchain_create_info.imageColorSpace = swap_chain_color_space;
 	swapchain_create_info.imageExtent.width = vid.width;
@@ -2023,7 +2068,7 @@ static qboolean GL_CreateSwapChain(void)
 		GL_SetObjectName((uint64_t)swapchain_images_views[i], VK_OBJECT_TYPE_IMAGE_VIEW, "Swap Chain View");
 	}
 
-	for (i = 0; i < NUM_COMMAND_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		assert(image_aquired_semaphores[i] == VK_NULL_HANDLE);
 		err = vkCreateSemaphore(vulkan_globals.device, &semaphore_create_info, NULL, &image_aquired_semaphores[i]);
@@ -2218,7 +2263,7 @@ static void GL_DestroyRenderResources(void)
 		swapchain_images[i] = VK_NULL_HANDLE;
 	}
 
-	for (i = 0; i < NUM_COMMAND_BUFFERS; ++i)
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
 	{
 		vkDestroySemaphore(vulkan_globals.device, image_aquired_semaphores[i], NULL);
 		image_aquired_semaphores[i] = VK_NULL_HANDLE;
@@ -2237,6 +2282,203 @@ static void GL_DestroyRenderResources(void)
 	vulkan_globals.main_render_pass = VK_NULL_HANDLE;
 }
 
+/*
+================================================================================
+
+	FRAME PACING
+	vid_frames_in_flight selects how many of the FRAMES_IN_FLIGHT command buffers
+	the CPU may run ahead of the GPU. Latency is measured from the input sample at
+	the start of the host frame to the completion of that frame's command buffer,
+	the last point the application can observe before scan out.
+
+================================================================================
+*/
+
+#define NUM_LATENCY_SAMPLES		128
+
+typedef struct
+{
+	float	submit_ms;		// input sample to queue submit
+	float	complete_ms;	// input sample to GPU completion
+} latencysample_t;
+
+static double			input_sample_time;
+static double			frame_input_time[FRAMES_IN_FLIGHT];
+static double			frame_submit_time[FRAMES_IN_FLIGHT];
+static qboolean			frame_latency_pending[FRAMES_IN_FLIGHT];
+static latencysample_t	latency_samples[NUM_LATENCY_SAMPLES];
+static int				latency_count;
+static int				latency_pos;
+static double			predicted_frame_cost;	// seconds from input sample to GPU completion
+static double			last_frame_complete;
+
+extern cvar_t host_maxfps;
+
+/*
+=================
+GL_FrameCompleted
+=================
+*/
+static void GL_FrameCompleted(int frame, double time)
+{
+	latencysample_t *sample;
+
+	if (!frame_latency_pending[frame])
+		return;
+	frame_latency_pending[frame] = false;
+
+	sample = &latency_samples[latency_pos];
+	sample->submit_ms = (frame_submit_time[frame] - frame_input_time[frame]) * 1000.0;
+	sample->complete_ms = (time - frame_input_time[frame]) * 1000.0;
+	latency_pos = (latency_pos + 1) % NUM_LATENCY_SAMPLES;
+	latency_count = q_min(latency_count + 1, NUM_LATENCY_SAMPLES);
+
+	// Track rises quickly and decays slowly so a single fast frame doesn't make the next one late
+	const double cost = time - frame_input_time[frame];
+	if (cost > predicted_frame_cost)
+		predicted_frame_cost = cost;
+	else
+		predicted_frame_cost = predicted_frame_cost * 0.9 + cost * 0.1;
+	last_frame_complete = q_max(last_frame_complete, time);
+}
+
+/*
+=================
+GL_PollFrameCompletion
+
+Records the completion of frames whose fences signaled since the last poll
+=================
+*/
+static void GL_PollFrameCompletion(void)
+{
+	uint32_t i;
+	double time = Sys_DoubleTime();
+
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
+		if (frame_latency_pending[i] && vkGetFenceStatus(vulkan_globals.device, command_buffer_fences[i]) == VK_SUCCESS)
+			GL_FrameCompleted(i, time);
+}
+
+/*
+=================
+GL_WaitForFrame
+=================
+*/
+static void GL_WaitForFrame(uint32_t frame)
+{
+	VkResult err;
+
+	GL_PollFrameCompletion();
+	if (!command_buffer_submitted[frame] || !frame_latency_pending[frame])
+		return;
+
+	err = vkWaitForFences(vulkan_globals.device, 1, &command_buffer_fences[frame], VK_TRUE, UINT64_MAX);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkWaitForFences failed");
+	GL_FrameCompleted(frame, Sys_DoubleTime());
+}
+
+/*
+=================
+GL_SetFramesInFlight
+
+Applies vid_frames_in_flight between frames. The swapchain is recreated so
+its minImageCount follows the new ring depth.
+=================
+*/
+static void GL_SetFramesInFlight(void)
+{
+	const uint32_t num_frames = CLAMP(1, (int)vid_frames_in_flight.value, FRAMES_IN_FLIGHT);
+	uint32_t i;
+
+	if (num_frames == num_frames_in_flight)
+		return;
+
+	if (render_resources_created)
+		GL_DestroyRenderResources();
+	GL_WaitForDeviceIdle();
+	for (i = 0; i < FRAMES_IN_FLIGHT; ++i)
+		frame_latency_pending[i] = false;
+
+	num_frames_in_flight = num_frames;
+	current_command_buffer = 0;
+	vulkan_globals.current_command_buffer = 0;
+	Con_DPrintf("Using %u frames in flight\n", num_frames_in_flight);
+}
+
+/*
+=================
+GL_WaitForFrameStart
+
+Called at the start of a host frame, right before input is sampled.
+vid_lowlatency 1 waits for the GPU to free the next command buffer here
+instead of after input has been sampled. vid_lowlatency 2 also delays
+the frame so it is predicted to complete vid_lowlatency_margin ms before
+the next vertical blank.
+=================
+*/
+void GL_WaitForFrameStart(void)
+{
+	double now, interval, next_vblank, start;
+	int mode = (int)vid_lowlatency.value;
+
+	if (render_resources_created && mode > 0)
+	{
+		GL_WaitForFrame(current_command_buffer);
+
+		interval = 0.0;
+		if (vid_vsync.value)
+			interval = 1.0 / q_max(VID_GetCurrentRefreshRate(), 1);
+		else if (host_maxfps.value)
+			interval = 1.0 / CLAMP(10.0, host_maxfps.value, 1000.0);
+
+		if (mode >= 2 && interval > 0.0 && last_frame_complete > 0.0)
+		{
+			// Completions of the previous frames anchor the vblank grid
+			now = Sys_DoubleTime();
+			next_vblank = last_frame_complete + interval * ceil((now + predicted_frame_cost - last_frame_complete) / interval);
+			start = next_vblank - predicted_frame_cost - vid_lowlatency_margin.value / 1000.0;
+			while ((now = Sys_DoubleTime()) < start)
+			{
+				if (start - now > 0.002)
+					SDL_Delay(1);
+			}
+		}
+	}
+
+	input_sample_time = Sys_DoubleTime();
+}
+
+/*
+=================
+GL_Latency_f
+=================
+*/
+static void GL_Latency_f(void)
+{
+	float submit_avg = 0.0f, complete_avg = 0.0f, complete_min = 0.0f, complete_max = 0.0f;
+	int i;
+
+	if (latency_count == 0)
+	{
+		Con_Printf("No frames completed yet\n");
+		return;
+	}
+
+	for (i = 0; i < latency_count; ++i)
+	{
+		const latencysample_t *sample = &latency_samples[i];
+		submit_avg += sample->submit_ms;
+		complete_avg += sample->complete_ms;
+		complete_min = (i == 0) ? sample->complete_ms : q_min(complete_min, sample->complete_ms);
+		complete_max = q_max(complete_max, sample->complete_ms);
+	}
+
+	Con_Printf("%u frames in flight, low latency mode %d, last %d frames:\n", num_frames_in_flight, (int)vid_lowlatency.value, latency_count);
+	Con_Printf("  input to submit:  %6.2f ms avg\n", submit_avg / latency_count);
+	Con_Printf("  input to GPU done: %6.2f ms avg %6.2f min %6.2f max\n", complete_avg / latency_count, complete_min, complete_max);
+}
+
 /*
 =================
 GL_BeginRendering
@@ -2252,6 +2494,8 @@ qboolean GL_BeginRendering(int* x, int* y, int* width, int* height)
 		vid.restart_next_frame = false;
 	}
 
+	GL_SetFramesInFlight();
+
 	if (!render_resources_created) {
 		GL_CreateRenderResources();
 
@@ -2270,12 +2514,7 @@ qboolean GL_BeginRendering(int* x, int* y, int* width, int* height)
 
 	VkResult err;
 
-	if (command_buffer_submitted[current_command_buffer])
-	{
-		err = vkWaitForFences(vulkan_globals.device, 1, &command_buffer_fences[current_command_buffer], VK_TRUE, UINT64_MAX);
-		if (err != VK_SUCCESS)
-			Sys_Error("vkWaitForFences failed");
-	}
+	GL_WaitForFrame(current_command_buffer);
 
 	err = vkResetFences(vulkan_globals.device, 1, &command_buffer_fences[current_command_buffer]);
 	if (err != VK_SUCCESS)
@@ -2295,6 +2534,8 @@ qboolean GL_BeginRendering(int* x, int* y, int* width, int* height)
 	if (err != VK_SUCCESS)
 		Sys_Error("vkBeginCommandBuffer failed");
 
+	GL_GPUProfilerBeginFrame();
+
 	VkRect2D render_area;
 	render_area.offset.x = 0;
 	render_area.offset.y = 0;
@@ -2444,30 +2685,61 @@ void GL_EndRendering(qboolean swapchain_acquired)
 		float postprocess_values[2] = { vid_gamma.value, q_min(2.0f, q_max(1.0f, vid_contrast.value)) };
 
 		vkCmdNextSubpass(vulkan_globals.command_buffer, VK_SUBPASS_CONTENTS_INLINE);
+		R_BeginGPUScope(GPU_SCOPE_POSTPROCESS);
 		R_BindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.postprocess_pipeline);
 		vkCmdBindDescriptorSets(vulkan_globals.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, vulkan_globals.postprocess_pipeline.layout.handle, 0, 1, &postprocess_descriptor_set, 0, NULL);
 		R_PushConstants(VK_SHADER_STAGE_FRAGMENT_BIT, 0, 2 * sizeof(float), postprocess_values);
 		vkCmdDraw(vulkan_globals.command_buffer, 3, 1, 0, 0);
+		R_EndGPUScope(GPU_SCOPE_POSTPROCESS);
 
 		vkCmdEndRenderPass(vulkan_globals.command_buffer);
 	}
 
+	GL_GPUProfilerEndFrame();
+
 	err = vkEndCommandBuffer(vulkan_globals.command_buffer);
 	if (err != VK_SUCCESS)
 		Sys_Error("vkEndCommandBuffer failed");
 
-	VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	VkSemaphore wait_semaphores[2];
+	VkPipelineStageFlags wait_dst_stage_masks[2];
+	uint64_t wait_values[2] = { 0, 0 };
+	uint32_t num_wait_semaphores = 0;
+	VkCommandBuffer submit_command_buffers[2];
+	uint32_t num_submit_command_buffers = 0;
+
+	if (swapchain_acquired)
+	{
+		wait_semaphores[num_wait_semaphores] = image_aquired_semaphores[current_command_buffer];
+		wait_dst_stage_masks[num_wait_semaphores++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	}
+
+	// Take ownership of images uploaded on the transfer queue once their copies are done
+	VkCommandBuffer acquire_command_buffer = R_PrepareTransferAcquires(&wait_semaphores[num_wait_semaphores], &wait_values[num_wait_semaphores]);
+	if (acquire_command_buffer != VK_NULL_HANDLE)
+	{
+		wait_dst_stage_masks[num_wait_semaphores++] = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		submit_command_buffers[num_submit_command_buffers++] = acquire_command_buffer;
+	}
+	submit_command_buffers[num_submit_command_buffers++] = command_buffers[current_command_buffer];
+
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info;
+	memset(&timeline_submit_info, 0, sizeof(timeline_submit_info));
+	timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_submit_info.waitSemaphoreValueCount = num_wait_semaphores;
+	timeline_submit_info.pWaitSemaphoreValues = wait_values;
 
 	VkSubmitInfo submit_info;
 	memset(&submit_info, 0, sizeof(submit_info));
 	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &command_buffers[current_command_buffer];
-	submit_info.waitSemaphoreCount = swapchain_acquired ? 1 : 0;
-	submit_info.pWaitSemaphores = &image_aquired_semaphores[current_command_buffer];
+	submit_info.pNext = (acquire_command_buffer != VK_NULL_HANDLE) ? &timeline_submit_info : NULL;
+	submit_info.commandBufferCount = num_submit_command_buffers;
+	submit_info.pCommandBuffers = submit_command_buffers;
+	submit_info.waitSemaphoreCount = num_wait_semaphores;
+	submit_info.pWaitSemaphores = wait_semaphores;
 	submit_info.signalSemaphoreCount = swapchain_acquired ? 1 : 0;
 	submit_info.pSignalSemaphores = &draw_complete_semaphores[current_command_buffer];
-	submit_info.pWaitDstStageMask = &wait_dst_stage_mask;
+	submit_info.pWaitDstStageMask = wait_dst_stage_masks;
 
 	err = vkQueueSubmit(vulkan_globals.queue, 1, &submit_info, command_buffer_fences[current_command_buffer]);
 	if (err != VK_SUCCESS)
@@ -2501,7 +2773,10 @@ void GL_EndRendering(qboolean swapchain_acquired)
 	}
 
 	command_buffer_submitted[current_command_buffer] = true;
-	current_command_buffer = (current_command_buffer + 1) % NUM_COMMAND_BUFFERS;
+	frame_input_time[current_command_buffer] = input_sample_time;
+	frame_submit_time[current_command_buffer] = Sys_DoubleTime();
+	frame_latency_pending[current_command_buffer] = true;
+	current_command_buffer = (current_command_buffer + 1) % num_frames_in_flight;
 	vulkan_globals.current_command_buffer = current_command_buffer;
 }
 
@@ -2515,12 +2790,44 @@ void GL_WaitForDeviceIdle(void)
 	if (!vulkan_globals.device_idle)
 	{
 		R_SubmitStagingBuffers();
+		R_SubmitTransfers();
 		vkDeviceWaitIdle(vulkan_globals.device);
 	}
 
 	vulkan_globals.device_idle = true;
 }
 
+/*
+=================
+GL_GetMemoryBudget
+
+Driver estimate of how much of a memory heap this process may use
+=================
+*/
+qboolean GL_GetMemoryBudget(uint32_t heap_index, VkDeviceSize * budget, VkDeviceSize * usage)
+{
+#if defined(VK_EXT_memory_budget)
+	if (!vulkan_globals.memory_budget || heap_index >= VK_MAX_MEMORY_HEAPS)
+		return false;
+
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties;
+	memset(&budget_properties, 0, sizeof(budget_properties));
+	budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 memory_properties_2;
+	memset(&memory_properties_2, 0, sizeof(memory_properties_2));
+	memory_properties_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memory_properties_2.pNext = &budget_properties;
+
+	vkGetPhysicalDeviceMemoryProperties2(vulkan_physical_device, &memory_properties_2);
+	*budget = budget_properties.heapBudget[heap_index];
+	*usage = budget_properties.heapUsage[heap_index];
+	return *budget > 0;
+#else
+	return false;
+#endif
+}
+
 /*
 =================
 VID_Shutdown
@@ -2530,6 +2837,12 @@ void VID_Shutdown(void)
 {
 	if (vid_initialized)
 	{
+		if (vulkan_globals.pipeline_cache != VK_NULL_HANDLE)
+		{
+			GL_WaitForDeviceIdle();
+			R_DestroyPipelineCache();
+			R_DestroyRTGeometryBuffers();
+		}
 		SDL_QuitSubSystem(SDL_INIT_VIDEO);
 		draw_context = NULL;
 		PL_VID_Shutdown();
@@ -2676,6 +2989,9 @@ void	VID_Init(void)
 	Cvar_RegisterVariable(&vid_fsaa);
 	Cvar_RegisterVariable(&vid_desktopfullscreen); //QuakeSpasm
 	Cvar_RegisterVariable(&vid_borderless); //QuakeSpasm
+	Cvar_RegisterVariable(&vid_frames_in_flight);
+	Cvar_RegisterVariable(&vid_lowlatency);
+	Cvar_RegisterVariable(&vid_lowlatency_margin);
 	Cvar_SetCallback(&vid_fullscreen, VID_Changed_f);
 	Cvar_SetCallback(&vid_width, VID_Changed_f);
 	Cvar_SetCallback(&vid_height, VID_Changed_f);
@@ -2694,6 +3010,7 @@ void	VID_Init(void)
 	Cmd_AddCommand("vid_test", VID_Test); //johnfitz
 	Cmd_AddCommand("vid_describecurrentmode", VID_DescribeCurrentMode_f);
 	Cmd_AddCommand("vid_describemodes", VID_DescribeModes_f);
+	Cmd_AddCommand("vid_latency", GL_Latency_f);
 
 	putenv(vid_center);	/* SDL_putenv is problematic in versions <= 1.2.9 */
 
@@ -2806,11 +3123,14 @@ void	VID_Init(void)
 	GL_InitCommandBuffers();
 	vulkan_globals.staging_buffer_size = INITIAL_STAGING_BUFFER_SIZE_KB * 1024;
 	R_InitStagingBuffers();
+	R_InitTransferQueue();
 	R_CreateDescriptorSetLayouts();
 	R_CreateDescriptorPool();
 	R_InitGPUBuffers();
 	R_InitSamplers();
 	R_CreatePipelineLayouts();
+	R_InitPipelineCache();
+	GL_InitGPUProfiler();
 
 	GL_CreateRenderResources();
 
@@ -26,7 +26,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define GLQUAKE_H
 
 void GL_WaitForDeviceIdle(void);
+qboolean GL_GetMemoryBudget(uint32_t heap_index, VkDeviceSize * budget, VkDeviceSize * usage);
 qboolean GL_BeginRendering(int* x, int* y, int* width, int* height);
+void GL_WaitForFrameStart(void);
 qboolean GL_AcquireNextSwapChainImage(void);
 void GL_EndRendering(qboolean swapchain_acquired);
 qboolean GL_Set2D(void);
@@ -55,7 +57,7 @@ extern	int glx, gly, glwidth, glheight;
 
 #define FAN_INDEX_BUFFER_SIZE 126
 
-#define FRAMES_IN_FLIGHT 2
+#define FRAMES_IN_FLIGHT 3 // maximum, vid_frames_in_flight selects how many are used
 
 void R_TimeRefresh_f(void);
 void R_ReadPointFile_f(void);
@@ -181,6 +183,7 @@ typedef struct accel_struct_s {
 
 typedef struct blas_instances_s {
 	accel_struct_t static_blas;
+	int static_generation;	// rt_static_generation static_blas was built from
 	accel_struct_t dynamic_blas;
 } blas_instances_t;
 
@@ -300,6 +303,9 @@ typedef struct
 	qboolean							validation;
 	qboolean							debug_utils;
 	VkQueue								queue;
+	VkQueue								transfer_queue;
+	qboolean							async_transfer;
+	VkPipelineCache						pipeline_cache;
 	VkCommandBuffer						command_buffer;
 	int									current_command_buffer;
 	vulkan_pipeline_t					current_pipeline;
@@ -311,6 +317,8 @@ typedef struct
 	VkPhysicalDeviceProperties			device_properties;
 	VkPhysicalDeviceMemoryProperties	memory_properties;
 	uint32_t							gfx_queue_family_index;
+	uint32_t							transfer_queue_family_index;
+	uint32_t							timestamp_valid_bits;
 	VkFormat							color_format;
 	VkFormat							depth_format;
 	VkSampleCountFlagBits				sample_count;
@@ -343,6 +351,7 @@ typedef struct
 	VkDeviceMemory						rt_static_index_memory;
 	VkBuffer							rt_static_index_buffer;
 	int									rt_static_index_count;
+	int									rt_static_generation;
 
 	VkBuffer							rt_dynamic_index_buffer;
 
@@ -368,6 +377,7 @@ typedef struct
 	// Device extensions
 	qboolean							dedicated_allocation;
 	qboolean							full_screen_exclusive;
+	qboolean							memory_budget;
 	qboolean							ray_pipeline;
 	qboolean							ray_query;
 
@@ -552,6 +562,7 @@ extern	cvar_t	gl_subdivide_size;
 //johnfitz -- rendering statistics
 extern unsigned int rs_brushpolys, rs_aliaspolys, rs_skypolys, rs_particles, rs_fogpolys;
 extern unsigned int rs_dynamiclightmaps, rs_brushpasses, rs_aliaspasses, rs_skypasses;
+extern unsigned int rs_aliasgroups, rs_aliasinstances;
 extern float rs_megatexels;
 
 //johnfitz -- track developer statistics that vary every frame
@@ -607,6 +618,7 @@ extern struct lightmap_s* lightmaps;
 extern int lightmap_count;	//allocated lightmaps
 
 extern qboolean r_fullbright_cheatsafe, r_lightmap_cheatsafe, r_drawworld_cheatsafe; //johnfitz
+extern qboolean r_lightmaps_unused;
 
 extern float	map_wateralpha, map_lavaalpha, map_telealpha, map_slimealpha; //ericw
 extern float	map_fallbackalpha; //spike -- because we might want r_wateralpha to apply to teleporters while water itself wasn't watervised
@@ -644,6 +656,9 @@ void R_DrawWorld(void);
 void RT_LoadStaticWorldGeometry();
 void RT_LoadDynamicWorldIndices();
 void R_DrawAliasModel(entity_t* e);
+void R_BeginAliasBatch(void);
+void R_EndAliasBatch(void);
+void R_AliasBenchmark_f(void);
 void R_DrawBrushModel(entity_t* e);
 void R_DrawSpriteModel(entity_t* e);
 
@@ -655,6 +670,8 @@ void GL_BuildBModelVertexBuffer(void);
 void GL_BuildBModelRTVertexAndIndexBuffer(void);
 void GLMesh_LoadVertexBuffers(void);
 void GLMesh_DeleteVertexBuffers(void);
+struct glheapstats_s;
+void GLMesh_GetHeapStats(struct glheapstats_s *vertex_stats, struct glheapstats_s *index_stats);
 
 int R_LightPoint(vec3_t p);
 void R_InitWorldLightEntities(void);
@@ -666,6 +683,7 @@ void R_CreateLightEntitiesList(vec3_t viewpos);
 void GL_SubdivideSurface(msurface_t* fa);
 void R_BuildLightMap(msurface_t* surf, byte* dest, int stride);
 void R_RenderDynamicLightmaps(msurface_t* fa);
+void R_ComposeLightmaps(void);
 void R_UploadLightmaps(void);
 
 void R_DrawWorld_ShowTris(void);
@@ -703,6 +721,9 @@ void R_InitSamplers();
 void R_CreatePipelineLayouts();
 void R_CreatePipelines();
 void R_DestroyPipelines();
+void R_InitPipelineCache(void);
+void R_SavePipelineCache(void);
+void R_DestroyPipelineCache(void);
 
 // Utils
 VkResult buffer_create(BufferResource_t* buf, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags mem_properties);
@@ -720,7 +741,8 @@ VkResult R_UpdateRaygenDescriptorSets();
 // Creates bottom level acceleration strucuture (BLAS)
 void RT_Create_BLAS_Instance(accel_struct_t* accel_struct, VkBuffer vertex_buffer,
 	uint32_t vertex_offset, uint32_t num_vertices, uint32_t num_triangles, uint32_t stride,
-	VkBuffer index_buffer, uint32_t num_indices, uint32_t index_offset, VkFormat format, VkIndexType index_type, VkBuffer transform_data);
+	VkBuffer index_buffer, uint32_t num_indices, uint32_t index_offset, VkFormat format, VkIndexType index_type, VkBuffer transform_data,
+	VkBuildAccelerationStructureFlagsKHR flags);
 void R_Create_TLAS(int num_instances);
 int accel_matches(accel_match_info_t* match, int fast_build,uint32_t vertex_count,uint32_t index_count);
 int accel_matches_top_level(accel_match_info_t* match, int fast_build, uint32_t instance_count);
@@ -773,11 +795,37 @@ static inline void R_EndDebugUtilsLabel()
 #endif
 }
 
+// GPU profiler scopes, see gl_profile.c
+typedef enum
+{
+	GPU_SCOPE_FRAME,
+	GPU_SCOPE_STATIC_BLAS,
+	GPU_SCOPE_DYNAMIC_BLAS,
+	GPU_SCOPE_TLAS,
+	GPU_SCOPE_TRACE_RAYS,
+	GPU_SCOPE_SCREEN_EFFECTS,
+	GPU_SCOPE_POSTPROCESS,
+	NUM_GPU_SCOPES
+} gpuscope_t;
+
+void GL_InitGPUProfiler(void);
+void GL_GPUProfilerBeginFrame(void);
+void GL_GPUProfilerEndFrame(void);
+void R_BeginGPUScope(gpuscope_t scope);
+void R_EndGPUScope(gpuscope_t scope);
+void SCR_DrawGPUProfile(void);
+
 VkDescriptorSet R_AllocateDescriptorSet(vulkan_desc_set_layout_t* layout);
 void R_FreeDescriptorSet(VkDescriptorSet desc_set, vulkan_desc_set_layout_t* layout);
 
 void R_InitStagingBuffers();
 void R_SubmitStagingBuffers();
+void R_InitTransferQueue();
+void R_SubmitTransfers();
+byte* R_TransferAllocate(int size, int alignment, VkCommandBuffer* command_buffer, VkBuffer* buffer, int* buffer_offset);
+void R_TransferReleaseImage(VkCommandBuffer command_buffer, const VkImageMemoryBarrier* barrier, VkImageLayout new_layout);
+void R_CancelTransferAcquire(VkImage image);
+VkCommandBuffer R_PrepareTransferAcquires(VkSemaphore* wait_semaphore, uint64_t* wait_value);
 byte* R_StagingAllocate(int size, int alignment, VkCommandBuffer* command_buffer, VkBuffer* buffer, int* buffer_offset);
 
 void R_InitGPUBuffers();
@@ -787,6 +835,9 @@ void R_CollectDynamicBufferGarbage();
 void R_CollectMeshBufferGarbage();
 byte* R_VertexAllocate(int size, VkBuffer* buffer, VkDeviceSize* buffer_offset);
 byte* R_IndexAllocate(int size, VkBuffer* buffer, VkDeviceSize* buffer_offset);
+void R_BeginRTGeometryFrame(void);
+qboolean R_RTGeometryAllocate(int vertex_size, int index_size, byte** vertex_data, VkDeviceSize* vertex_offset, byte** index_data, VkDeviceSize* index_offset);
+void R_DestroyRTGeometryBuffers(void);
 byte* R_UniformAllocate(int size, VkBuffer* buffer, uint32_t* buffer_offset, VkDescriptorSet* descriptor_set);
 
 void GL_SetObjectName(uint64_t object, VkObjectType object_type, const char* name);
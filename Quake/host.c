@@ -823,6 +823,10 @@ void _Host_Frame (double time)
 	if (!Host_FilterTime (time))
 		return;			// don't run too fast, or packets will flood out
 
+// wait for the GPU before input is sampled, not after
+	if (!isDedicated)
+		GL_WaitForFrameStart ();
+
 // get new key events
 	Key_UpdateForDest ();
 	IN_UpdateInputMode ();
@@ -934,6 +938,7 @@ void Host_Frame (double time)
 	static double	timetotal;
 	static int		timecount;
 	int		i, c, m;
+	int		lookups, hits, flushes;
 
 	if (!serverprofile.value)
 	{
@@ -962,6 +967,10 @@ void Host_Frame (double time)
 	}
 
 	Con_Printf ("serverprofile: %2i clients %2i msec\n",  c,  m);
+
+	SV_TraceCacheCounters (&lookups, &hits, &flushes);
+	if (lookups)
+		Con_Printf ("serverprofile: trace cache %2i%% of %i lookups hit, %i flushes\n", (int)(hits * 100.0 / lookups), lookups, flushes);
 }
 
 /*
@@ -992,6 +1001,7 @@ void Host_Init (void)
 	COM_Init ();
 	COM_InitFilesystem ();
 	Host_InitLocal ();
+	Tasks_Init ();
 	W_LoadWadFile (); //johnfitz -- filename is now hard-coded for honesty
 	if (cls.state != ca_dedicated)
 	{
@@ -34,6 +34,326 @@ char *PR_GetTempString (void)
 
 #define	RETURN_EDICT(e) (((int *)qcvm->globals)[OFS_RETURN] = EDICT_TO_PROG(e))
 
+/*
+===============================================================================
+
+	FIND INDEX
+
+	Hashes the classname, targetname and target fields of the server edicts so
+	find and findchain only visit edicts whose string can match. QC writes to
+	the fields are caught in OP_ADDRESS and engine writes call ED_FieldsChanged,
+	both of which queue the edict to be rehashed before the next lookup. Fields
+	pointing into the temp string buffers can change content without a write,
+	so those edicts go to a list that every lookup scans.
+
+===============================================================================
+*/
+
+#define	FINDINDEX_FIELDS		3
+#define	FINDINDEX_BUCKETS		1024
+#define	FINDINDEX_VOLATILE		FINDINDEX_BUCKETS	// bucket of edicts with temp strings
+
+cvar_t	pr_findindex = {"pr_findindex", "1", CVAR_NONE};
+
+static const int findindex_fieldofs[FINDINDEX_FIELDS] =
+{
+	offsetof(entvars_t, classname) / 4, offsetof(entvars_t, targetname) / 4, offsetof(entvars_t, target) / 4,
+};
+
+typedef struct
+{
+	int		fieldofs;
+	int		head[FINDINDEX_BUCKETS + 1];
+	int		*next;		// sorted chain of edict numbers per bucket, -1 terminated
+	int		*bucket;	// bucket of each edict, -1 if not hashed
+} findindexfield_t;
+
+static findindexfield_t	findindex[FINDINDEX_FIELDS];
+static qboolean			findindex_valid;
+static int				findindex_maxedicts;
+static byte				*findindex_dirty;
+static int				*findindex_dirtylist;
+static int				findindex_numdirty;
+
+/*
+=================
+PR_FindIndexHash
+=================
+*/
+static int PR_FindIndexHash (const char *s)
+{
+	unsigned int	h = 2166136261u;
+
+	while (*s)
+		h = (h ^ (byte)*s++) * 16777619u;
+	return h & (FINDINDEX_BUCKETS - 1);
+}
+
+/*
+=================
+PR_FindIndexBucket
+
+Like E_STRING, but never errors on a dangling string and sorts temp strings
+into the volatile bucket
+=================
+*/
+static int PR_FindIndexBucket (edict_t *ed, int fieldofs)
+{
+	int			num = ((int *)&ed->v)[fieldofs];
+	const char	*s;
+
+	if (num >= 0 && num < qcvm->stringssize)
+		return PR_FindIndexHash (qcvm->strings + num);
+	if (num >= 0 || num < -qcvm->numknownstrings)
+		return FINDINDEX_VOLATILE;
+	s = qcvm->knownstrings[-1 - num];
+	if (!s || (s >= pr_string_temp[0] && s < pr_string_temp[STRINGTEMP_BUFFERS]))
+		return FINDINDEX_VOLATILE;
+	return PR_FindIndexHash (s);
+}
+
+/*
+=================
+PR_FindIndexInsert
+=================
+*/
+static void PR_FindIndexInsert (findindexfield_t *field, int e, int b)
+{
+	int		*link;
+
+	for (link = &field->head[b]; *link != -1 && *link < e; link = &field->next[*link])
+		;
+	field->next[e] = *link;
+	*link = e;
+	field->bucket[e] = b;
+}
+
+/*
+=================
+PR_FindIndexRemove
+=================
+*/
+static void PR_FindIndexRemove (findindexfield_t *field, int e)
+{
+	int		*link;
+
+	if (field->bucket[e] == -1)
+		return;
+	for (link = &field->head[field->bucket[e]]; *link != e; link = &field->next[*link])
+		;
+	*link = field->next[e];
+	field->bucket[e] = -1;
+}
+
+/*
+=================
+PR_FindIndexRebuild
+=================
+*/
+static void PR_FindIndexRebuild (void)
+{
+	findindexfield_t	*field;
+	edict_t				*ed;
+	int					i, e;
+
+	if (findindex_maxedicts != qcvm->max_edicts)
+	{
+		findindex_maxedicts = qcvm->max_edicts;
+		for (i = 0; i < FINDINDEX_FIELDS; i++)
+		{
+			findindex[i].next = (int *) realloc (findindex[i].next, findindex_maxedicts * sizeof(int));
+			findindex[i].bucket = (int *) realloc (findindex[i].bucket, findindex_maxedicts * sizeof(int));
+			if (!findindex[i].next || !findindex[i].bucket)
+				Sys_Error ("PR_FindIndexRebuild: out of memory");
+		}
+		findindex_dirty = (byte *) realloc (findindex_dirty, findindex_maxedicts);
+		findindex_dirtylist = (int *) realloc (findindex_dirtylist, findindex_maxedicts * sizeof(int));
+		if (!findindex_dirty || !findindex_dirtylist)
+			Sys_Error ("PR_FindIndexRebuild: out of memory");
+	}
+
+	memset (findindex_dirty, 0, findindex_maxedicts);
+	findindex_numdirty = 0;
+
+	for (i = 0; i < FINDINDEX_FIELDS; i++)
+	{
+		field = &findindex[i];
+		field->fieldofs = findindex_fieldofs[i];
+		for (e = 0; e <= FINDINDEX_BUCKETS; e++)
+			field->head[e] = -1;
+		for (e = 0; e < findindex_maxedicts; e++)
+			field->bucket[e] = -1;
+
+		// walk backwards so every insert lands at the head of its chain
+		for (e = qcvm->num_edicts - 1; e > 0; e--)
+		{
+			ed = EDICT_NUM(e);
+			if (!ed->free)
+				PR_FindIndexInsert (field, e, PR_FindIndexBucket (ed, field->fieldofs));
+		}
+	}
+
+	findindex_valid = true;
+}
+
+/*
+=================
+PR_FindIndexUpdate
+
+Returns the index of the field, rehashing the edicts written since the last
+lookup, or NULL if the field is not indexed
+=================
+*/
+static findindexfield_t *PR_FindIndexUpdate (int fieldofs)
+{
+	findindexfield_t	*field;
+	edict_t				*ed;
+	int					i, j, e;
+
+	if (!pr_findindex.value || qcvm != &sv.qcvm)
+		return NULL;
+	for (i = 0; i < FINDINDEX_FIELDS; i++)
+		if (findindex_fieldofs[i] == fieldofs)
+			break;
+	if (i == FINDINDEX_FIELDS)
+		return NULL;
+
+	if (!findindex_valid)
+		PR_FindIndexRebuild ();
+	else
+	{
+		for (j = 0; j < findindex_numdirty; j++)
+		{
+			e = findindex_dirtylist[j];
+			findindex_dirty[e] = false;
+			ed = EDICT_NUM(e);
+			for (field = findindex; field < findindex + FINDINDEX_FIELDS; field++)
+			{
+				PR_FindIndexRemove (field, e);
+				if (!ed->free)
+					PR_FindIndexInsert (field, e, PR_FindIndexBucket (ed, field->fieldofs));
+			}
+		}
+		findindex_numdirty = 0;
+	}
+
+	return &findindex[i];
+}
+
+/*
+=================
+PR_FindIndexTouch
+
+Queues an edict whose indexed fields are about to change or just changed
+=================
+*/
+void PR_FindIndexTouch (edict_t *ed)
+{
+	int		e;
+
+	if (!findindex_valid || qcvm != &sv.qcvm)
+		return;
+	e = NUM_FOR_EDICT(ed);
+	if (findindex_dirty[e])
+		return;
+	findindex_dirty[e] = true;
+	findindex_dirtylist[findindex_numdirty++] = e;
+}
+
+/*
+=================
+PR_FindIndexInvalidate
+=================
+*/
+void PR_FindIndexInvalidate (void)
+{
+	if (qcvm == &sv.qcvm)
+		findindex_valid = false;
+}
+
+/*
+=================
+PR_FindIndexMatch
+
+Walks the bucket of s and the volatile bucket together in edict order from the
+cursors and returns the next edict whose field equals s, or -1
+=================
+*/
+static int PR_FindIndexMatch (findindexfield_t *field, const char *s, int *b, int *v)
+{
+	edict_t		*ed;
+	int			e;
+
+	while (*b != -1 || *v != -1)
+	{
+		if (*v == -1 || (*b != -1 && *b < *v))
+		{
+			e = *b;
+			*b = field->next[e];
+		}
+		else
+		{
+			e = *v;
+			*v = field->next[e];
+		}
+
+		ed = EDICT_NUM(e);
+		if (!ed->free && !strcmp (E_STRING(ed, field->fieldofs), s))
+			return e;
+	}
+
+	return -1;
+}
+
+/*
+=================
+PR_FindIndexNext
+
+Same result as scanning the edicts after start for the first one whose string
+field equals s. indexed is false if the caller has to do the scan itself.
+=================
+*/
+edict_t *PR_FindIndexNext (int start, int fieldofs, const char *s, qboolean *indexed)
+{
+	findindexfield_t	*field = PR_FindIndexUpdate (fieldofs);
+	int					b, v, e;
+
+	*indexed = field != NULL;
+	if (!field)
+		return qcvm->edicts;
+
+	for (b = field->head[PR_FindIndexHash (s)]; b != -1 && b <= start; b = field->next[b])
+		;
+	for (v = field->head[FINDINDEX_VOLATILE]; v != -1 && v <= start; v = field->next[v])
+		;
+	e = PR_FindIndexMatch (field, s, &b, &v);
+	return (e == -1) ? qcvm->edicts : EDICT_NUM(e);
+}
+
+/*
+=================
+PR_FindIndexAll
+
+Fills list with every edict whose string field equals s, in edict order
+=================
+*/
+int PR_FindIndexAll (int fieldofs, const char *s, edict_t **list, qboolean *indexed)
+{
+	findindexfield_t	*field = PR_FindIndexUpdate (fieldofs);
+	int					b, v, e, count;
+
+	*indexed = field != NULL;
+	if (!field)
+		return 0;
+
+	b = field->head[PR_FindIndexHash (s)];
+	v = field->head[FINDINDEX_VOLATILE];
+	count = 0;
+	while ((e = PR_FindIndexMatch (field, s, &b, &v)) != -1)
+		list[count++] = EDICT_NUM(e);
+	return count;
+}
+
 /*
 ===============================================================================
 
@@ -960,22 +1280,125 @@ Returns a chain of entities that have origins within a spherical area
 findradius (origin, radius)
 =================
 */
+static int PF_findradius_compare (const void *a, const void *b)
+{
+	const edict_t	*ea = *(edict_t * const *)a;
+	const edict_t	*eb = *(edict_t * const *)b;
+
+	return (ea > eb) - (ea < eb);
+}
+
+#ifdef USE_SSE2
+/*
+=================
+PF_findradius_cull
+
+Drops the candidates that are certainly outside the sphere, four at a time
+with squared distances. The limit is widened by the rounding error of the
+float math, so every candidate the exact test in PF_findradius would accept
+is kept, NaNs included. Returns the new count, order is preserved.
+=================
+*/
+static int PF_findradius_cull (edict_t **list, int count, const float *org, float rad)
+{
+	const __m128	signmask = _mm_set1_ps (-0.0f);
+	const __m128	half = _mm_set1_ps (0.5f);
+	const float		orgmax = q_max (fabs (org[0]), q_max (fabs (org[1]), fabs (org[2])));
+	float			center[3][4];
+	int				i, j, k, keep, numkept;
+
+	numkept = 0;
+	for (i = 0; i + 4 <= count; i += 4)
+	{
+		for (k = 0; k < 4; k++)
+		{
+			const edict_t *ent = list[i + k];
+			for (j = 0; j < 3; j++)
+				center[j][k] = ent->v.mins[j] + ent->v.maxs[j];
+		}
+
+		__m128 dist2 = _mm_setzero_ps ();
+		__m128 centermax = _mm_setzero_ps ();
+		for (j = 0; j < 3; j++)
+		{
+			const __m128 origin = _mm_setr_ps (list[i]->v.origin[j], list[i + 1]->v.origin[j], list[i + 2]->v.origin[j], list[i + 3]->v.origin[j]);
+			const __m128 c = _mm_add_ps (origin, _mm_mul_ps (_mm_loadu_ps (center[j]), half));
+			const __m128 d = _mm_sub_ps (_mm_set1_ps (org[j]), c);
+			dist2 = _mm_add_ps (dist2, _mm_mul_ps (d, d));
+			centermax = _mm_max_ps (centermax, _mm_andnot_ps (signmask, c));
+		}
+
+		// a few ulps of the largest coordinate involved, plus the relative error of the squares
+		const __m128 slack = _mm_add_ps (_mm_mul_ps (_mm_add_ps (centermax, _mm_set1_ps (orgmax)), _mm_set1_ps (1.0f / (1 << 20))), _mm_set1_ps (1.0f / 1024));
+		const __m128 bound = _mm_add_ps (_mm_set1_ps (rad), slack);
+		const __m128 limit = _mm_mul_ps (_mm_mul_ps (bound, bound), _mm_set1_ps (1.0001f));
+
+		// comparisons against NaN are false, so those lanes are kept
+		keep = ~_mm_movemask_ps (_mm_cmpgt_ps (dist2, limit));
+		for (k = 0; k < 4; k++)
+			if (keep & (1 << k))
+				list[numkept++] = list[i + k];
+	}
+	for ( ; i < count; i++)
+		list[numkept++] = list[i];
+
+	return numkept;
+}
+#endif
+
 static void PF_findradius (void)
 {
+	static edict_t	**candidates;
+	static int		maxcandidates;
 	edict_t	*ent, *chain;
 	float	rad;
 	float	*org;
-	vec3_t	eorg;
-	int	i, j;
+	vec3_t	eorg, mins, maxs;
+	int	i, j, count;
 
 	chain = (edict_t *)qcvm->edicts;
 
 	org = G_VECTOR(OFS_PARM0);
 	rad = G_FLOAT(OFS_PARM1);
 
-	ent = NEXT_EDICT(qcvm->edicts);
-	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
+	if (maxcandidates < qcvm->max_edicts * 2)
+	{
+		maxcandidates = qcvm->max_edicts * 2;
+		candidates = (edict_t **) realloc (candidates, maxcandidates * sizeof(edict_t *));
+		if (!candidates)
+			Sys_Error ("PF_findradius: out of memory");
+	}
+
+	// the area tree holds every solid edict by its absolute box, which always
+	// contains the center tested below, so only the edicts near org and the
+	// ones moved since their last link need the exact test
+	if (qcvm == &sv.qcvm && rad >= 0 && rad < 65536 && fabs (org[0]) < 1e9 && fabs (org[1]) < 1e9 && fabs (org[2]) < 1e9)
 	{
+		for (j = 0; j < 3; j++)
+		{
+			mins[j] = org[j] - rad - 1;
+			maxs[j] = org[j] + rad + 1;
+		}
+		count = SV_AreaEdicts (mins, maxs, candidates, maxcandidates);
+		qsort (candidates, count, sizeof(edict_t *), PF_findradius_compare);
+	}
+	else
+	{
+		count = 0;
+		for (i = 1; i < qcvm->num_edicts; i++)
+			candidates[count++] = EDICT_NUM(i);
+	}
+
+#ifdef USE_SSE2
+	if (use_simd && rad >= 0)
+		count = PF_findradius_cull (candidates, count, org, rad);
+#endif
+
+	for (i = 0; i < count; i++)
+	{
+		ent = candidates[i];
+		if (i > 0 && ent == candidates[i - 1])
+			continue;
 		if (ent->free)
 			continue;
 		if (ent->v.solid == SOLID_NOT)
@@ -1057,6 +1480,7 @@ static void PF_Find (void)
 	int		f;
 	const char	*s, *t;
 	edict_t	*ed;
+	qboolean	indexed;
 
 	e = G_EDICTNUM(OFS_PARM0);
 	f = G_INT(OFS_PARM1);
@@ -1064,6 +1488,13 @@ static void PF_Find (void)
 	if (!s)
 		PR_RunError ("PF_Find: bad search string");
 
+	ed = PR_FindIndexNext (e, f, s, &indexed);
+	if (indexed)
+	{
+		RETURN_EDICT(ed);
+		return;
+	}
+
 	for (e++ ; e < qcvm->num_edicts ; e++)
 	{
 		ed = EDICT_NUM(e);
@@ -1542,6 +1973,7 @@ void PF_changeyaw (void)
 	}
 
 	ent->v.angles[1] = anglemod (current + move);
+	SV_TouchAreaEdict (ent);
 }
 
 /*
@@ -37,6 +37,8 @@ int		type_size[8] = {
 
 static ddef_t	*ED_FieldAtOfs (int ofs);
 
+extern cvar_t	pr_findindex;
+
 cvar_t	nomonsters = {"nomonsters", "0", CVAR_NONE};
 cvar_t	gamecfg = {"gamecfg", "0", CVAR_NONE};
 cvar_t	scratch1 = {"scratch1", "0", CVAR_NONE};
@@ -49,6 +51,81 @@ cvar_t	saved2 = {"saved2", "0", CVAR_ARCHIVE};
 cvar_t	saved3 = {"saved3", "0", CVAR_ARCHIVE};
 cvar_t	saved4 = {"saved4", "0", CVAR_ARCHIVE};
 
+byte pr_fieldwatch[FIELDWATCH_COUNT];
+
+/*
+=================
+ED_InitFieldWatch
+
+Flags the entvars_t fields that the spatial and string find indexes are keyed
+on, and the ones speculative traces depend on
+=================
+*/
+static void ED_InitFieldWatch (void)
+{
+	static const int area_fields[] =
+	{
+		offsetof(entvars_t, origin), offsetof(entvars_t, mins), offsetof(entvars_t, maxs),
+		offsetof(entvars_t, absmin), offsetof(entvars_t, absmax),
+	};
+	static const int find_fields[] =
+	{
+		offsetof(entvars_t, classname), offsetof(entvars_t, targetname), offsetof(entvars_t, target),
+	};
+	static const int clip_fields[] =
+	{
+		offsetof(entvars_t, owner), offsetof(entvars_t, skin), offsetof(entvars_t, flags), offsetof(entvars_t, modelindex),
+	};
+	int		i, j;
+
+	memset (pr_fieldwatch, 0, sizeof(pr_fieldwatch));
+	for (i = 0; i < (int)countof(area_fields); i++)
+		for (j = 0; j < 3; j++)
+			pr_fieldwatch[area_fields[i] / 4 + j] |= FIELDWATCH_AREA;
+	pr_fieldwatch[offsetof(entvars_t, solid) / 4] |= FIELDWATCH_AREA;
+	for (i = 0; i < (int)countof(find_fields); i++)
+		pr_fieldwatch[find_fields[i] / 4] |= FIELDWATCH_FIND;
+	for (i = 0; i < (int)countof(clip_fields); i++)
+		pr_fieldwatch[clip_fields[i] / 4] |= FIELDWATCH_CLIP;
+	for (j = 0; j < 3; j++)
+	{
+		pr_fieldwatch[offsetof(entvars_t, size) / 4 + j] |= FIELDWATCH_CLIP;
+		pr_fieldwatch[offsetof(entvars_t, angles) / 4 + j] |= FIELDWATCH_CLIP;
+	}
+}
+
+/*
+=================
+ED_FieldWritten
+
+Called by OP_ADDRESS before QC stores to a watched field
+=================
+*/
+void ED_FieldWritten (edict_t *ed, int ofs)
+{
+	if (pr_fieldwatch[ofs] & FIELDWATCH_AREA)
+		SV_MarkAreaDirty (ed);
+	if (pr_fieldwatch[ofs] & FIELDWATCH_FIND)
+		PR_FindIndexTouch (ed);
+	if (pr_fieldwatch[ofs] & FIELDWATCH_CLIP)
+		SV_TouchAreaEdict (ed);
+	if (ofs == offsetof(entvars_t, solid) / 4)
+		SV_FlushTraceCache (false);	// may become SOLID_BSP before it is linked again
+}
+
+/*
+=================
+ED_FieldsChanged
+
+Called after the engine rewrote any number of fields of an edict
+=================
+*/
+void ED_FieldsChanged (edict_t *ed)
+{
+	SV_MarkAreaDirty (ed);
+	PR_FindIndexTouch (ed);
+}
+
 /*
 =================
 ED_ClearEdict
@@ -60,6 +137,7 @@ void ED_ClearEdict (edict_t *e)
 {
 	memset (&e->v, 0, qcvm->progs->entityfields * 4);
 	e->free = false;
+	ED_FieldsChanged (e);
 }
 
 /*
@@ -96,6 +174,7 @@ edict_t *ED_Alloc (void)
 	qcvm->num_edicts++;
 	e = EDICT_NUM(i);
 	memset(e, 0, qcvm->edict_size); // ericw -- switched sv.edicts to malloc(), so we are accessing uninitialized memory and must fully zero it, not just ED_ClearEdict
+	ED_FieldsChanged (e);
 
 	return e;
 }
@@ -110,9 +189,9 @@ FIXME: walk all entities and NULL out references to this entity
 */
 void ED_Free (edict_t *ed)
 {
-	SV_UnlinkEdict (ed);		// unlink from world bsp
-
 	ed->free = true;
+	SV_UnlinkEdict (ed);		// unlink from world bsp, and drop it from the area dirty list
+
 	ed->v.model = 0;
 	ed->v.takedamage = 0;
 	ed->v.modelindex = 0;
@@ -575,7 +654,10 @@ static void ED_PrintEdict_f (void)
 			else if (Cmd_Argc() < 4)
 				Con_Printf("Edict %u.%s==%s\n", i, PR_GetString(def->s_name), PR_UglyValueString(def->type&~DEF_SAVEGLOBAL, (eval_t *)((char *)&EDICT_NUM(i)->v + def->ofs*4)));
 			else
+			{
 				ED_ParseEpair((void *)&EDICT_NUM(i)->v, def, Cmd_Argv(3), false);
+				ED_FieldsChanged (EDICT_NUM(i));
+			}
 		}
 
 	}
@@ -979,6 +1061,7 @@ const char *ED_ParseEdict (const char *data, edict_t *ent)
 	if (!init)
 		ent->free = true;
 
+	ED_FieldsChanged (ent);
 	return data;
 }
 
@@ -1107,6 +1190,7 @@ void PR_ClearProgs(qcvm_t *vm)
 	if (qcvm->knownstrings)
 		Z_Free ((void *)qcvm->knownstrings);
 	free(qcvm->edicts); // ericw -- sv.edicts switched to use malloc()
+	free(qcvm->areadirty);
 	if (qcvm->fielddefs != (ddef_t *)((byte *)qcvm->progs + qcvm->progs->ofs_fielddefs))
 		free(qcvm->fielddefs);
 	free(qcvm->progs);	// spike -- pr_progs switched to use malloc (so menuqc doesn't end up stuck on the early hunk nor wiped on every map change)
@@ -1396,7 +1480,9 @@ void PR_Init (void)
 	Cvar_RegisterVariable (&saved2);
 	Cvar_RegisterVariable (&saved3);
 	Cvar_RegisterVariable (&saved4);
+	Cvar_RegisterVariable (&pr_findindex);
 
+	ED_InitFieldWatch ();
 	PR_InitExtensions();
 }
 
@@ -1490,6 +1576,7 @@ int PR_SetEngineString (const char *s)
 		{
 			if (qcvm->knownstrings[i])
 				continue;
+			PR_FindIndexInvalidate ();	// fields still holding the freed string would change content
 		}
 		else
 		{
@@ -1513,7 +1600,10 @@ int PR_AllocString (int size, char **ptr)
 	for (i = 0; i < qcvm->numknownstrings; i++)
 	{
 		if (!qcvm->knownstrings[i])
+		{
+			PR_FindIndexInvalidate ();	// fields still holding the freed string would change content
 			break;
+		}
 	}
 //	if (i >= pr_numknownstrings)
 //	{
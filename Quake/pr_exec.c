@@ -554,6 +554,8 @@ void PR_ExecuteProgram (func_t fnum)
 			qcvm->xstatement = st - qcvm->statements;
 			PR_RunError("assignment to world entity");
 		}
+		if ((unsigned int)OPB->_int < FIELDWATCH_COUNT && pr_fieldwatch[OPB->_int])
+			ED_FieldWritten (ed, OPB->_int);
 		OPC->_int = (byte *)((int *)&ed->v + OPB->_int) - (byte *)qcvm->edicts;
 		break;
 
@@ -2220,6 +2220,7 @@ static void PF_spawnclient(void)
 			svs.clients[i].spawned = true;
 			ent = svs.clients[i].edict;
 			memset (&ent->v, 0, qcvm->progs->entityfields * 4);
+			ED_FieldsChanged (ent);
 			ent->v.colormap = NUM_FOR_EDICT(ent);
 			ent->v.team = (svs.clients[i].colors & 15) + 1;
 			ent->v.netname = PR_SetEngineString(svs.clients[i].name);
@@ -3201,10 +3202,13 @@ static void PF_num_for_edict(void)
 }
 static void PF_findchain(void)
 {
+	static edict_t	**list;
+	static int		maxlist;
 	edict_t	*ent, *chain;
-	int	i, f;
+	int	i, f, count;
 	const char *s, *t;
 	int cfld;
+	qboolean indexed;
 
 	chain = (edict_t *)qcvm->edicts;
 
@@ -3216,6 +3220,28 @@ static void PF_findchain(void)
 	else
 		cfld = &ent->v.chain - (int*)&ent->v;
 
+	if ((unsigned int)cfld >= FIELDWATCH_COUNT || !pr_fieldwatch[cfld])
+	{
+		if (maxlist < qcvm->max_edicts)
+		{
+			maxlist = qcvm->max_edicts;
+			list = (edict_t **) realloc (list, maxlist * sizeof(edict_t *));
+			if (!list)
+				Sys_Error ("PF_findchain: out of memory");
+		}
+		count = PR_FindIndexAll (f, s, list, &indexed);
+		if (indexed)
+		{
+			for (i = 0; i < count; i++)
+			{
+				((int*)&list[i]->v)[cfld] = EDICT_TO_PROG(chain);
+				chain = list[i];
+			}
+			RETURN_EDICT(chain);
+			return;
+		}
+	}
+
 	for (i = 1; i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
 	{
 		if (ent->free)
@@ -3223,6 +3249,8 @@ static void PF_findchain(void)
 		t = E_STRING(ent,f);
 		if (strcmp(s, t))
 			continue;
+		if ((unsigned int)cfld < FIELDWATCH_COUNT && pr_fieldwatch[cfld])
+			ED_FieldWritten (ent, cfld);
 		((int*)&ent->v)[cfld] = EDICT_TO_PROG(chain);
 		chain = ent;
 	}
@@ -3397,7 +3425,10 @@ static void PF_putentfldstr(void)
 	edict_t *ent = G_EDICT(OFS_PARM1);
 	const char *value = G_STRING(OFS_PARM2);
 	if (fldidx < (unsigned int)qcvm->progs->numfielddefs)
+	{
 		G_FLOAT(OFS_RETURN) = ED_ParseEpair ((void *)&ent->v, qcvm->fielddefs+fldidx, value, true);
+		ED_FieldsChanged (ent);
+	}
 	else
 		G_FLOAT(OFS_RETURN) = false;
 }
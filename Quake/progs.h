@@ -41,9 +41,18 @@ typedef struct edict_s
 {
 	qboolean	free;
 	link_t		area;			/* linked to a division node or leaf */
+	struct areanode_s	*areanode;	/* node the area link is in */
+	byte		areadirty;		/* AREADIRTY_*, spatial fields written since the last link */
+	byte		linkmodel;		/* had a modelindex at the last full link */
+	float		linksolid;		/* solid at the last full link */
+	vec3_t		linkmins, linkmaxs;	/* absmin and absmax the leafs and area link were found for */
+	unsigned int	linkgeneration;	/* qcvm->linkgeneration of the last full link, 0 once unlinked */
 
 	unsigned int		num_leafs;
 	int		leafnums[MAX_ENT_LEAFS];
+	unsigned int		num_leafwords;	/* leafnums grouped by 32 bit word of a pvs */
+	int		leafwords[MAX_ENT_LEAFS];
+	unsigned int		leafwordmasks[MAX_ENT_LEAFS];
 
 	entity_state_t	baseline;
 	unsigned char	alpha;			/* johnfitz -- hack to support alpha since it's not part of entvars_t */
@@ -64,6 +73,17 @@ typedef struct edict_light_s {
 
 #define	EDICT_FROM_AREA(l)	STRUCT_FROM_LINK(l,edict_t,area)
 
+#define	AREADIRTY_NONE		0	/* not on the dirty list */
+#define	AREADIRTY_CHANGED	1	/* on the dirty list, the area link may not match the fields */
+#define	AREADIRTY_LINKED	2	/* on the dirty list, but relinked since */
+
+/* fields whose writes are tracked for the spatial and string find indexes */
+#define	FIELDWATCH_AREA		1
+#define	FIELDWATCH_FIND		2
+#define	FIELDWATCH_CLIP		4	/* read by SV_Move when clipping against the edict */
+#define	FIELDWATCH_COUNT	(sizeof(entvars_t) / 4)
+extern byte pr_fieldwatch[FIELDWATCH_COUNT];
+
 //============================================================================
 
 typedef void (*builtin_t) (void);
@@ -103,6 +123,13 @@ void PR_Profile_f (void);
 
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
+void ED_FieldWritten (edict_t *ed, int ofs);
+void ED_FieldsChanged (edict_t *ed);
+
+void PR_FindIndexTouch (edict_t *ed);
+void PR_FindIndexInvalidate (void);
+edict_t *PR_FindIndexNext (int start, int fieldofs, const char *s, qboolean *indexed);
+int PR_FindIndexAll (int fieldofs, const char *s, edict_t **list, qboolean *indexed);
 
 void ED_Print (edict_t *ed);
 void ED_Write (FILE *f, edict_t *ed);
@@ -288,16 +315,25 @@ typedef struct
 } prstack_t;
 
 
+// Loose kd-tree over X, Y and Z. Leaves are split on demand when they hold
+// too many edicts, an edict is linked into the deepest node whose loose
+// bounds contain its absolute box.
 typedef struct areanode_s
 {
 	int		axis;		// -1 = leaf node
 	float	dist;
+	float	loosedist[2];	// children[0] holds boxes above loosedist[0], children[1] boxes below loosedist[1]
 	struct areanode_s	*children[2];
+	vec3_t	mins, maxs;	// bounds of the cell before loosening
+	unsigned int	stamp;	// qcvm->areastamp of the last change to the edicts linked here
+	int		numedicts;
 	link_t	trigger_edicts;
 	link_t	solid_edicts;
 } areanode_t;
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+#define	AREA_NODES			1024	// node pool per qcvm, leaves stop splitting when it runs out
+#define	AREA_SPLIT_EDICTS	8		// a leaf holding more edicts than this is split
+#define	AREA_MIN_SIZE		64		// cells aren't split below this size on their longest axis
+#define	AREA_LOOSENESS		0.25f	// fraction of the cell size that children overlap the split by
 
 struct qcvm_s
 {
@@ -360,6 +396,11 @@ struct qcvm_s
 	//originally from world.c
 	areanode_t	areanodes[AREA_NODES];
 	int			numareanodes;
+	unsigned int	areastamp;		// bumped by every change to the area tree
+	unsigned int	linkgeneration;	// bumped by SV_ClearWorld, so no edict link survives it
+	int			*areadirty;			// edict numbers whose spatial fields QC wrote since their last link
+	int			numareadirty;
+	int			maxareadirty;
 };
 extern globalvars_t	*pr_global_struct;
 
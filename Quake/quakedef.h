@@ -237,6 +237,7 @@ typedef struct
 #include "bspfile.h"
 #include "sys.h"
 #include "zone.h"
+#include "tasks.h"
 #include "mathlib.h"
 #include "cvar.h"
 
@@ -87,6 +87,67 @@ typedef union char_to_float_convert_s {
 	float real;
 } char_to_float_convert_t;
 
+// Alias entities that share a model, pose pair and skin have the same object
+// space geometry. Each such instance group is decoded once into
+// rt_alias_templates, every entity of the group then only lerps and transforms
+// the template into its output memory, which is reserved in the RT geometry
+// ring in draw order so the work can be done by worker threads in any order.
+//
+// A template holds the decoded poses as x, y and z float arrays padded to a
+// multiple of 4 (pose2 first, pose1 only when the poses differ), followed by
+// the rt_vertex_t attributes and the 16 bit indices.
+typedef struct {
+	const qmodel_t	*model;
+	const byte		*vertex_data;
+	const uint16_t	*index_data;
+	VkDeviceSize	pose1_offset;
+	VkDeviceSize	pose2_offset;
+	int				st_offset;
+	int				num_verts;
+	int				num_indexes;
+	int				tx_index;
+	int				fb_index;
+	int				template_offset;	// byte offset of the group in rt_alias_templates
+	int				next;				// next group in the same hash bucket
+} rtaliasgroup_t;
+
+typedef struct {
+	int				group;
+	byte			*vertex_out;
+	byte			*index_out;
+	float			model_matrix[16];
+	float			blend;
+	int				base_vertex;
+} rtaliasjob_t;
+
+#define ALIAS_SOA_STRIDE(numverts)	(((numverts) + 3) & ~3)
+
+#define ALIAS_GROUP_HASH_SIZE	256
+
+static rtaliasjob_t		*rt_alias_jobs;
+static int				rt_num_alias_jobs;
+static int				rt_max_alias_jobs;
+static rtaliasgroup_t	*rt_alias_groups;
+static int				rt_num_alias_groups;
+static int				rt_max_alias_groups;
+static int				rt_alias_group_hash[ALIAS_GROUP_HASH_SIZE];
+static byte				*rt_alias_templates;
+static int				rt_alias_templates_size;
+static int				rt_alias_templates_used;
+static qboolean			rt_alias_batching;
+
+// Mesh heaps mapped for the current batch. They stay mapped until the workers
+// are done reading them in R_EndAliasBatch.
+typedef struct
+{
+	VkDeviceMemory	memory;
+	byte			*data;
+} rtaliasmapping_t;
+
+static rtaliasmapping_t	*rt_alias_mappings;
+static int				rt_num_alias_mappings;
+static int				rt_max_alias_mappings;
+
 /*
 =============
 GLARB_GetXYZOffset
@@ -390,6 +451,460 @@ void R_SetupAliasLighting (entity_t	*e)
 	VectorScale (lightcolor, 1.0f / 200.0f, lightcolor);
 }
 
+/*
+=================
+R_DecodeAliasPose
+
+Converts the xyz bytes of one pose in the mesh VBO to x, y and z float arrays
+=================
+*/
+static void R_DecodeAliasPose (const byte *pose, int num_verts, float *soa)
+{
+	const int stride = ALIAS_SOA_STRIDE(num_verts);
+	int i;
+
+	for (i = 0; i < num_verts; i++)
+	{
+		const byte *pos = pose + i * sizeof(meshxyz_t);
+		soa[i] = (float)pos[0] / 255;
+		soa[stride + i] = (float)pos[1] / 255;
+		soa[stride * 2 + i] = (float)pos[2] / 255;
+	}
+	for (; i < stride; i++)
+		soa[i] = soa[stride + i] = soa[stride * 2 + i] = 0.0f;
+}
+
+/*
+=================
+R_LerpTransformAliasVertices
+
+Blends two decoded poses and transforms the result by the entity matrix. pose1
+is NULL if the entity isn't lerping.
+=================
+*/
+static void R_LerpTransformAliasVertices (const float *pose1, const float *pose2, float blend, const float m[16], const rt_vertex_t *attributes, int num_verts, rt_vertex_t *out)
+{
+	const int stride = ALIAS_SOA_STRIDE(num_verts);
+	int i;
+
+	for (i = 0; i < num_verts; i++)
+	{
+		float x = pose2[i];
+		float y = pose2[stride + i];
+		float z = pose2[stride * 2 + i];
+
+		if (pose1)
+		{
+			x = pose1[i] + (x - pose1[i]) * blend;
+			y = pose1[stride + i] + (y - pose1[stride + i]) * blend;
+			z = pose1[stride * 2 + i] + (z - pose1[stride * 2 + i]) * blend;
+		}
+
+		out[i] = attributes[i];
+		out[i].vertex_pos[0] = m[0] * x + m[4] * y + m[8] * z + m[12];
+		out[i].vertex_pos[1] = m[1] * x + m[5] * y + m[9] * z + m[13];
+		out[i].vertex_pos[2] = m[2] * x + m[6] * y + m[10] * z + m[14];
+	}
+}
+
+#ifdef USE_SSE2
+/*
+=================
+R_DecodeAliasPoseSIMD
+
+Decodes 4 vertices per iteration, results are identical to R_DecodeAliasPose
+=================
+*/
+static void R_DecodeAliasPoseSIMD (const byte *pose, int num_verts, float *soa)
+{
+	const int stride = ALIAS_SOA_STRIDE(num_verts);
+	const __m128i byte_mask = _mm_set1_epi32(0xFF);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	int i;
+
+	for (i = 0; i + 4 <= num_verts; i += 4)
+	{
+		// Each meshxyz_t is xyz in the low and the normal in the high dword, keep the even dwords
+		const __m128i v01 = _mm_loadu_si128((const __m128i *)(pose + i * sizeof(meshxyz_t)));
+		const __m128i v23 = _mm_loadu_si128((const __m128i *)(pose + (i + 2) * sizeof(meshxyz_t)));
+		const __m128i packed = _mm_unpacklo_epi64(_mm_shuffle_epi32(v01, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(v23, _MM_SHUFFLE(3, 1, 2, 0)));
+
+		__m128 x = _mm_cvtepi32_ps(_mm_and_si128(packed, byte_mask));
+		__m128 y = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 8), byte_mask));
+		__m128 z = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 16), byte_mask));
+		_mm_storeu_ps(soa + i, _mm_div_ps(x, scale));
+		_mm_storeu_ps(soa + stride + i, _mm_div_ps(y, scale));
+		_mm_storeu_ps(soa + stride * 2 + i, _mm_div_ps(z, scale));
+	}
+
+	for (; i < stride; i++)
+	{
+		if (i < num_verts)
+		{
+			const byte *pos = pose + i * sizeof(meshxyz_t);
+			soa[i] = (float)pos[0] / 255;
+			soa[stride + i] = (float)pos[1] / 255;
+			soa[stride * 2 + i] = (float)pos[2] / 255;
+		}
+		else
+			soa[i] = soa[stride + i] = soa[stride * 2 + i] = 0.0f;
+	}
+}
+
+/*
+=================
+R_LerpTransformAliasVerticesSIMD
+
+Lerps and transforms 4 vertices per iteration, results are identical to
+R_LerpTransformAliasVertices
+=================
+*/
+static void R_LerpTransformAliasVerticesSIMD (const float *pose1, const float *pose2, float blend, const float m[16], const rt_vertex_t *attributes, int num_verts, rt_vertex_t *out)
+{
+	const int stride = ALIAS_SOA_STRIDE(num_verts);
+	const __m128 b = _mm_set1_ps(blend);
+	const __m128 m0 = _mm_set1_ps(m[0]), m1 = _mm_set1_ps(m[1]), m2 = _mm_set1_ps(m[2]);
+	const __m128 m4 = _mm_set1_ps(m[4]), m5 = _mm_set1_ps(m[5]), m6 = _mm_set1_ps(m[6]);
+	const __m128 m8 = _mm_set1_ps(m[8]), m9 = _mm_set1_ps(m[9]), m10 = _mm_set1_ps(m[10]);
+	const __m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+	int i, j;
+
+	for (i = 0; i < num_verts; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(pose2 + i);
+		__m128 y = _mm_loadu_ps(pose2 + stride + i);
+		__m128 z = _mm_loadu_ps(pose2 + stride * 2 + i);
+
+		if (pose1)
+		{
+			const __m128 x1 = _mm_loadu_ps(pose1 + i);
+			const __m128 y1 = _mm_loadu_ps(pose1 + stride + i);
+			const __m128 z1 = _mm_loadu_ps(pose1 + stride * 2 + i);
+			x = _mm_add_ps(x1, _mm_mul_ps(_mm_sub_ps(x, x1), b));
+			y = _mm_add_ps(y1, _mm_mul_ps(_mm_sub_ps(y, y1), b));
+			z = _mm_add_ps(z1, _mm_mul_ps(_mm_sub_ps(z, z1), b));
+		}
+
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m4, y)), _mm_mul_ps(m8, z)), m12);
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, x), _mm_mul_ps(m5, y)), _mm_mul_ps(m9, z)), m13);
+		__m128 tz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, x), _mm_mul_ps(m6, y)), _mm_mul_ps(m10, z)), m14);
+		__m128 tw = _mm_setzero_ps();
+		_MM_TRANSPOSE4_PS(tx, ty, tz, tw);
+
+		const __m128 positions[4] = {tx, ty, tz, tw};
+		const int count = q_min(4, num_verts - i);
+		for (j = 0; j < count; j++)
+		{
+			// The 16 byte store spills into vertex_tx_coords[0], the attribute copy fixes it up
+			_mm_storeu_ps(out[i + j].vertex_pos, positions[j]);
+			memcpy(out[i + j].vertex_tx_coords, attributes[i + j].vertex_tx_coords, sizeof(rt_vertex_t) - offsetof(rt_vertex_t, vertex_tx_coords));
+		}
+	}
+}
+#endif // def USE_SSE2
+
+/*
+=================
+R_FillAliasGroup
+
+Decodes the poses of an instance group into object space vertices. Runs on worker threads.
+=================
+*/
+static void R_FillAliasGroup (int index, void *data)
+{
+	const rtaliasgroup_t *group = (const rtaliasgroup_t *)data + index;
+	const int num_poses = (group->pose1_offset != group->pose2_offset) ? 2 : 1;
+	float *poses = (float *)(rt_alias_templates + group->template_offset);
+	rt_vertex_t *vertices = (rt_vertex_t *)(poses + num_poses * 3 * ALIAS_SOA_STRIDE(group->num_verts));
+	uint16_t *indices = (uint16_t *)(vertices + group->num_verts);
+	char_to_float_convert_t tx_float1;
+	char_to_float_convert_t tx_float2;
+	int i;
+
+#ifdef USE_SSE2
+	if (use_simd)
+	{
+		R_DecodeAliasPoseSIMD(group->vertex_data + group->pose2_offset, group->num_verts, poses);
+		if (num_poses == 2)
+			R_DecodeAliasPoseSIMD(group->vertex_data + group->pose1_offset, group->num_verts, poses + 3 * ALIAS_SOA_STRIDE(group->num_verts));
+	}
+	else
+#endif
+	{
+		R_DecodeAliasPose(group->vertex_data + group->pose2_offset, group->num_verts, poses);
+		if (num_poses == 2)
+			R_DecodeAliasPose(group->vertex_data + group->pose1_offset, group->num_verts, poses + 3 * ALIAS_SOA_STRIDE(group->num_verts));
+	}
+
+	for (i = 0; i < group->num_verts; i++)
+	{
+		const byte *st = group->vertex_data + group->st_offset + i * sizeof(float) * 2;
+		rt_vertex_t *rt_vertex = &vertices[i];
+
+		// Positions are written per entity by R_FillAliasJob
+		rt_vertex->vertex_pos[0] = 0.0f;
+		rt_vertex->vertex_pos[1] = 0.0f;
+		rt_vertex->vertex_pos[2] = 0.0f;
+
+		// Vertex texture coordinates (char arrays are converted to float values)
+		memcpy(tx_float1.byte, st, 4);
+		memcpy(tx_float2.byte, st + 4, 4);
+		rt_vertex->vertex_tx_coords[0] = tx_float1.real;
+		rt_vertex->vertex_tx_coords[1] = tx_float2.real;
+		rt_vertex->vertex_fb_coords[0] = tx_float1.real;
+		rt_vertex->vertex_fb_coords[1] = tx_float2.real;
+
+		rt_vertex->tx_index = group->tx_index;
+		rt_vertex->fb_index = group->fb_index;
+		rt_vertex->material_index = -1; // future use
+	}
+
+	memcpy(indices, group->index_data, group->num_indexes * sizeof(uint16_t));
+}
+
+/*
+=================
+R_FillAliasJob
+
+Lerps and transforms the group template of one alias entity and rebases its indices. Runs on worker threads.
+=================
+*/
+static void R_FillAliasJob (int index, void *data)
+{
+	const rtaliasjob_t *job = (const rtaliasjob_t *)data + index;
+	const rtaliasgroup_t *group = &rt_alias_groups[job->group];
+	const int stride = ALIAS_SOA_STRIDE(group->num_verts);
+	const float *pose2 = (const float *)(rt_alias_templates + group->template_offset);
+	const float *pose1 = (group->pose1_offset != group->pose2_offset) ? pose2 + 3 * stride : NULL;
+	const rt_vertex_t *attributes = (const rt_vertex_t *)(pose2 + (pose1 ? 6 : 3) * stride);
+	const uint16_t *src_indices = (const uint16_t *)(attributes + group->num_verts);
+	rt_vertex_t *vertices = (rt_vertex_t *)job->vertex_out;
+	uint32_t *indices = (uint32_t *)job->index_out;
+	int i;
+
+#ifdef USE_SSE2
+	if (use_simd)
+		R_LerpTransformAliasVerticesSIMD(pose1, pose2, job->blend, job->model_matrix, attributes, group->num_verts, vertices);
+	else
+#endif
+		R_LerpTransformAliasVertices(pose1, pose2, job->blend, job->model_matrix, attributes, group->num_verts, vertices);
+
+	for (i = 0; i < group->num_indexes; i++)
+		indices[i] = src_indices[i] + job->base_vertex;
+}
+
+/*
+=================
+R_MapAliasHeap
+
+Returns the host pointer of a mesh heap, mapping it once per batch
+=================
+*/
+static byte *R_MapAliasHeap (VkDeviceMemory memory)
+{
+	rtaliasmapping_t *mapping;
+	VkResult err;
+	int i;
+
+	for (i = 0; i < rt_num_alias_mappings; i++)
+		if (rt_alias_mappings[i].memory == memory)
+			return rt_alias_mappings[i].data;
+
+	if (rt_num_alias_mappings == rt_max_alias_mappings)
+	{
+		rt_max_alias_mappings = q_max(16, rt_max_alias_mappings * 2);
+		rt_alias_mappings = (rtaliasmapping_t *)realloc(rt_alias_mappings, rt_max_alias_mappings * sizeof(rtaliasmapping_t));
+		if (!rt_alias_mappings)
+			Sys_Error("R_MapAliasHeap: out of memory");
+	}
+
+	mapping = &rt_alias_mappings[rt_num_alias_mappings++];
+	mapping->memory = memory;
+	err = vkMapMemory(vulkan_globals.device, memory, 0, VK_WHOLE_SIZE, 0, (void **)&mapping->data);
+	if (err != VK_SUCCESS)
+		Sys_Error("vkMapMemory failed");
+
+	return mapping->data;
+}
+
+/*
+=================
+R_FindAliasGroup
+
+Returns the instance group for the model, pose pair and skin, creating it if needed
+=================
+*/
+static int R_FindAliasGroup (qmodel_t *model, aliashdr_t *paliashdr, int pose1, int pose2, int tx_index, int fb_index)
+{
+	const VkDeviceSize pose1_offset = GLARB_GetXYZOffset(paliashdr, pose1);
+	const VkDeviceSize pose2_offset = GLARB_GetXYZOffset(paliashdr, pose2);
+	const unsigned int hash = ((uintptr_t)model / sizeof(qmodel_t) + pose1 * 17 + pose2 * 31 + tx_index * 7 + fb_index) & (ALIAS_GROUP_HASH_SIZE - 1);
+	const int num_poses = (pose1 != pose2) ? 2 : 1;
+	rtaliasgroup_t *group;
+	int i, template_size;
+
+	for (i = rt_alias_group_hash[hash]; i != -1; i = rt_alias_groups[i].next)
+	{
+		group = &rt_alias_groups[i];
+		if (group->model == model && group->pose1_offset == pose1_offset && group->pose2_offset == pose2_offset && group->tx_index == tx_index && group->fb_index == fb_index)
+			return i;
+	}
+
+	if (rt_num_alias_groups == rt_max_alias_groups)
+	{
+		rt_max_alias_groups = q_max(64, rt_max_alias_groups * 2);
+		rt_alias_groups = (rtaliasgroup_t *)realloc(rt_alias_groups, rt_max_alias_groups * sizeof(rtaliasgroup_t));
+		if (!rt_alias_groups)
+			Sys_Error("R_FindAliasGroup: out of memory");
+	}
+
+	template_size = num_poses * 3 * ALIAS_SOA_STRIDE(paliashdr->numverts_vbo) * sizeof(float)
+		+ paliashdr->numverts_vbo * sizeof(rt_vertex_t) + paliashdr->numindexes * sizeof(uint16_t);
+	template_size = (template_size + 15) & ~15;
+	if (rt_alias_templates_used + template_size > rt_alias_templates_size)
+	{
+		rt_alias_templates_size = q_max(rt_alias_templates_size * 2, rt_alias_templates_used + template_size);
+		rt_alias_templates = (byte *)realloc(rt_alias_templates, rt_alias_templates_size);
+		if (!rt_alias_templates)
+			Sys_Error("R_FindAliasGroup: out of memory");
+	}
+
+	i = rt_num_alias_groups++;
+	group = &rt_alias_groups[i];
+	group->model = model;
+	group->vertex_data = R_MapAliasHeap(model->vertex_heap->memory) + model->vertex_heap_node->offset;
+	group->index_data = (const uint16_t *)(R_MapAliasHeap(model->index_heap->memory) + model->index_heap_node->offset);
+	group->pose1_offset = pose1_offset;
+	group->pose2_offset = pose2_offset;
+	group->st_offset = model->vbostofs;
+	group->num_verts = paliashdr->numverts_vbo;
+	group->num_indexes = paliashdr->numindexes;
+	group->tx_index = tx_index;
+	group->fb_index = fb_index;
+	group->template_offset = rt_alias_templates_used;
+	group->next = rt_alias_group_hash[hash];
+	rt_alias_group_hash[hash] = i;
+	rt_alias_templates_used += template_size;
+
+	return i;
+}
+
+/*
+=================
+R_BeginAliasBatch
+
+Defers the vertex transforms of R_DrawAliasModel until R_EndAliasBatch
+=================
+*/
+void R_BeginAliasBatch (void)
+{
+	int i;
+
+	for (i = 0; i < ALIAS_GROUP_HASH_SIZE; i++)
+		rt_alias_group_hash[i] = -1;
+	rt_num_alias_groups = 0;
+	rt_alias_templates_used = 0;
+	rt_num_alias_jobs = 0;
+	rt_alias_batching = true;
+}
+
+/*
+=================
+R_EndAliasBatch
+=================
+*/
+void R_EndAliasBatch (void)
+{
+	int i;
+
+	Task_ParallelFor(rt_num_alias_groups, R_FillAliasGroup, rt_alias_groups);
+	Task_ParallelFor(rt_num_alias_jobs, R_FillAliasJob, rt_alias_jobs);
+	for (i = 0; i < rt_num_alias_mappings; i++)
+		vkUnmapMemory(vulkan_globals.device, rt_alias_mappings[i].memory);
+	rt_num_alias_mappings = 0;
+	rs_aliasgroups += rt_num_alias_groups;
+	rs_aliasinstances += rt_num_alias_jobs;
+	rt_num_alias_groups = 0;
+	rt_num_alias_jobs = 0;
+	rt_alias_batching = false;
+}
+
+/*
+=================
+R_AliasBenchmark_f
+
+Times the scalar and SIMD alias pose decode, lerp and transform on synthetic
+vertices and checks that both produce the same output.
+usage: r_aliasbench [vertices] [iterations]
+=================
+*/
+void R_AliasBenchmark_f (void)
+{
+	const int num_verts = (Cmd_Argc() > 1) ? q_max(4, atoi(Cmd_Argv(1))) : 4096;
+	const int iterations = (Cmd_Argc() > 2) ? q_max(1, atoi(Cmd_Argv(2))) : 256;
+	const int stride = ALIAS_SOA_STRIDE(num_verts);
+	float m[16];
+	byte *poses;
+	float *soa;
+	rt_vertex_t *attributes, *out_scalar, *out_simd;
+	double start, scalar_time, simd_time;
+	int i;
+
+	poses = (byte *)malloc(num_verts * sizeof(meshxyz_t) * 2);
+	soa = (float *)malloc(stride * 6 * sizeof(float));
+	attributes = (rt_vertex_t *)calloc(num_verts, sizeof(rt_vertex_t));
+	out_scalar = (rt_vertex_t *)malloc(num_verts * sizeof(rt_vertex_t));
+	out_simd = (rt_vertex_t *)malloc(num_verts * sizeof(rt_vertex_t));
+	if (!poses || !soa || !attributes || !out_scalar || !out_simd)
+	{
+		Con_Printf("r_aliasbench: out of memory\n");
+		goto done;
+	}
+
+	for (i = 0; i < num_verts * (int)sizeof(meshxyz_t) * 2; i++)
+		poses[i] = rand() & 255;
+	IdentityMatrix(m);
+	m[0] = 1.5f; m[5] = 0.75f; m[10] = 2.0f;
+	m[12] = 100.0f; m[13] = -50.0f; m[14] = 25.0f;
+
+	start = Sys_DoubleTime();
+	for (i = 0; i < iterations; i++)
+	{
+		R_DecodeAliasPose(poses, num_verts, soa);
+		R_DecodeAliasPose(poses + num_verts * sizeof(meshxyz_t), num_verts, soa + 3 * stride);
+		R_LerpTransformAliasVertices(soa + 3 * stride, soa, 0.3f, m, attributes, num_verts, out_scalar);
+	}
+	scalar_time = Sys_DoubleTime() - start;
+
+#ifdef USE_SSE2
+	start = Sys_DoubleTime();
+	for (i = 0; i < iterations; i++)
+	{
+		R_DecodeAliasPoseSIMD(poses, num_verts, soa);
+		R_DecodeAliasPoseSIMD(poses + num_verts * sizeof(meshxyz_t), num_verts, soa + 3 * stride);
+		R_LerpTransformAliasVerticesSIMD(soa + 3 * stride, soa, 0.3f, m, attributes, num_verts, out_simd);
+	}
+	simd_time = Sys_DoubleTime() - start;
+
+	Con_Printf("%d vertices x %d iterations\n", num_verts, iterations);
+	Con_Printf("scalar: %7.3f ms (%.2f ns/vertex)\n", scalar_time * 1000.0, scalar_time * 1e9 / ((double)num_verts * iterations));
+	Con_Printf("simd:   %7.3f ms (%.2f ns/vertex), %.2fx\n", simd_time * 1000.0, simd_time * 1e9 / ((double)num_verts * iterations), scalar_time / q_max(simd_time, 1e-9));
+	Con_Printf("results %s\n", memcmp(out_scalar, out_simd, num_verts * sizeof(rt_vertex_t)) ? "DIFFER" : "match");
+#else
+	(void)simd_time;
+	(void)out_simd;
+	Con_Printf("%d vertices x %d iterations\n", num_verts, iterations);
+	Con_Printf("scalar: %7.3f ms (%.2f ns/vertex), no SIMD path in this build\n", scalar_time * 1000.0, scalar_time * 1e9 / ((double)num_verts * iterations));
+#endif
+
+done:
+	free(poses);
+	free(soa);
+	free(attributes);
+	free(out_scalar);
+	free(out_simd);
+}
+
 /*
 =================
 R_DrawAliasModel -- johnfitz -- almost completely rewritten
@@ -500,129 +1015,56 @@ void R_DrawAliasModel (entity_t *e) //(entity_t *e, qboolean rt)
 	}
 
 
-	//Collects vertex data used in this frame. Normals are removed and tx and fb coords are casted to float values
-	VkDeviceMemory vertex_heapmemory = currententity->model->vertex_heap->memory;
-	glheapnode_t* vertex_heapnode = currententity->model->vertex_heap_node;
-
-	// animation vertex offset
-	VkDeviceSize animation_vertex_offset = GLARB_GetXYZOffset(paliashdr, lerpdata.pose2);
-	animation_vertex_offset;
-
 	//calculating texture index
-	int tx_imageview_index = -1;
-	int fb_imageview_index = -1;
-
-	if (tx) {
-		glheapnode_t* txheapnode = tx->heap_node;
-
-		while (txheapnode->prev != NULL) {
-			txheapnode = txheapnode->prev;
-			tx_imageview_index++;
-		}
-	}
-
-	if (fb) {
-		glheapnode_t* fbheapnode = fb->heap_node;
-
-		while (fbheapnode->prev != NULL) {
-			fbheapnode = fbheapnode->prev;
-			fb_imageview_index++;
-		}
-	}
-
-	void* vdata;
-	vkMapMemory(vulkan_globals.device, vertex_heapmemory, vertex_heapnode->offset, vertex_heapnode->size, 0, &vdata);
-	vkUnmapMemory(vulkan_globals.device, vertex_heapmemory);
-	unsigned char* vdatacast = (unsigned char*)vdata;
+	TexMgr_TouchTexture(tx);
+	TexMgr_TouchTexture(fb);
+	int tx_imageview_index = TexMgr_DescriptorIndex(tx);
+	int fb_imageview_index = TexMgr_DescriptorIndex(fb);
+
+	// A finished or not yet started lerp shares the single pose group of its entity
+	if (lerpdata.blend >= 1.0f)
+		lerpdata.pose1 = lerpdata.pose2;
+	else if (lerpdata.blend <= 0.0f)
+		lerpdata.pose2 = lerpdata.pose1;
+	if (lerpdata.pose1 == lerpdata.pose2)
+		lerpdata.blend = 1.0f;
 
 	int current_blas_index = vulkan_globals.rt_current_blas_index;
-	rt_blas_data_t current_blas_data = vulkan_globals.rt_blas_data_pointer[current_blas_index];
-
-	int current_model_count = 0;
-	for (i = 0; i <= vulkan_globals.rt_current_blas_index; i++) {
-		current_model_count += vulkan_globals.rt_blas_data_pointer[i].model_count;
-	}
-
-	int vbostofs = currententity->model->vbostofs;
 	int maxVerts = paliashdr->numverts_vbo;
+	int vertices_allocate_size = maxVerts * sizeof(rt_vertex_t);
+	int indices_allocate_size = paliashdr->numindexes * sizeof(uint32_t);
 
-	char_to_float_convert_t tx_float1;
-	char_to_float_convert_t tx_float2;
-
-	rt_vertex_t rt_vertex;
-
-	VkBuffer dynamic_vertex_buffer;
 	VkDeviceSize dynamic_vertex_buffer_offset;
-	byte* vertex_pointer = R_VertexAllocate(maxVerts * sizeof(rt_vertex_t), &dynamic_vertex_buffer, &dynamic_vertex_buffer_offset);
-	
-	for (i = 0; i < maxVerts; i++) {
-		int offset = i * sizeof(float) * 2;
-
-		int posoffset = animation_vertex_offset + offset;
-		int txoffset = vbostofs + offset;
-
-		// Vertex position
-		float vertex[16];
-		vertex[0] = (float)vdatacast[posoffset + 0] / 255;
-		vertex[1] = (float)vdatacast[posoffset + 1] / 255;
-		vertex[2] = (float)vdatacast[posoffset + 2] / 255;
-		vertex[3] = 1;
-
-		float matrix_copy[16];
-		memcpy(matrix_copy, model_matrix, 16 * sizeof(float));
-		MatrixMultiply(matrix_copy, vertex);
-
-		rt_vertex.vertex_pos[0] = matrix_copy[0];
-		rt_vertex.vertex_pos[1] = matrix_copy[1];
-		rt_vertex.vertex_pos[2] = matrix_copy[2];
+	VkDeviceSize dynamic_index_buffer_offset;
+	byte *vertex_out, *index_out;
 
-		unsigned char* tx1 = tx_float1.byte;
-		*tx1++ = vdatacast[txoffset + 0]; *tx1++ = vdatacast[txoffset + 1];
-		*tx1++ = vdatacast[txoffset + 2]; *tx1++ = vdatacast[txoffset + 3];
+	// The ring buffer is full for this frame, it grows before the next one
+	if (!R_RTGeometryAllocate(vertices_allocate_size, indices_allocate_size, &vertex_out, &dynamic_vertex_buffer_offset, &index_out, &dynamic_index_buffer_offset))
+		return;
 
-		unsigned char* tx2 = tx_float2.byte;
-		*tx2++ = vdatacast[txoffset + 4]; *tx2++ = vdatacast[txoffset + 5];
-		*tx2++ = vdatacast[txoffset + 6]; *tx2++ = vdatacast[txoffset + 7];
+	// Outside of a batch the entity is an instance group of its own
+	const qboolean single = !rt_alias_batching;
+	if (single)
+		R_BeginAliasBatch();
 
-		// Vertex texture coordinates (char arrays are converted to float values)
-		rt_vertex.vertex_tx_coords[0] = tx_float1.real;
-		rt_vertex.vertex_tx_coords[1] = tx_float2.real;
-		
-		rt_vertex.vertex_fb_coords[0] = tx_float1.real;
-		rt_vertex.vertex_fb_coords[1] = tx_float2.real;
-		
-		rt_vertex.tx_index = tx_imageview_index;
-		rt_vertex.fb_index = fb_imageview_index;
-		rt_vertex.material_index = -1; // future use
-
-		memcpy(vertex_pointer + i * sizeof(rt_vertex_t), &rt_vertex, sizeof(rt_vertex_t));
+	if (rt_num_alias_jobs == rt_max_alias_jobs)
+	{
+		rt_max_alias_jobs = q_max(64, rt_max_alias_jobs * 2);
+		rt_alias_jobs = (rtaliasjob_t *)realloc(rt_alias_jobs, rt_max_alias_jobs * sizeof(rtaliasjob_t));
+		if (!rt_alias_jobs)
+			Sys_Error("R_DrawAliasModel: out of memory");
 	}
 
-	// Collects index data
-	VkDeviceMemory index_heapmemory = currententity->model->index_heap->memory;
-	glheapnode_t* index_heapnode = currententity->model->index_heap_node;
-
-	void* idata;
-	vkMapMemory(vulkan_globals.device, index_heapmemory, index_heapnode->offset, index_heapnode->size, 0, &idata);
-	vkUnmapMemory(vulkan_globals.device, index_heapmemory);
-	uint16_t* idatacast = (uint16_t*)idata;
-
-	int current_index_count = current_blas_data.index_count;
-	current_index_count;
-	int current_vertex_count = current_blas_data.vertex_count;
-
-	VkDeviceSize indices_allocate_size = paliashdr->numindexes * sizeof(uint32_t);
-
-	VkBuffer dynamic_index_buffer;
-	VkDeviceSize dynamic_index_buffer_offset;
-	byte* indices_pointer = R_IndexAllocate(indices_allocate_size, &dynamic_index_buffer, &dynamic_index_buffer_offset);
-
-	uint32_t* indices = (uint32_t*)malloc(indices_allocate_size);
-	for (int j = 0; j < paliashdr->numindexes; j++) {
-		indices[j] = idatacast[j] + current_vertex_count;
-	}
+	rtaliasjob_t *job = &rt_alias_jobs[rt_num_alias_jobs++];
+	job->group = R_FindAliasGroup(e->model, paliashdr, lerpdata.pose1, lerpdata.pose2, tx_imageview_index, fb_imageview_index);
+	job->blend = lerpdata.blend;
+	job->vertex_out = vertex_out;
+	job->index_out = index_out;
+	memcpy(job->model_matrix, model_matrix, sizeof(job->model_matrix));
+	job->base_vertex = vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count;
 
-	memcpy(indices_pointer, indices, indices_allocate_size);
+	if (single)
+		R_EndAliasBatch();
 
 	vulkan_globals.rt_blas_data_pointer[current_blas_index].index_count += paliashdr->numindexes;
 	vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count += paliashdr->numverts_vbo;
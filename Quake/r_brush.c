@@ -37,8 +37,6 @@ int					lightmap_count;
 int					last_lightmap_allocated;
 int					allocated[LMBLOCK_WIDTH];
 
-unsigned	blocklights[LMBLOCK_WIDTH*LMBLOCK_HEIGHT*3 + 1]; //johnfitz -- was 18*18, added lit support (*3) and loosened surface extents maximum (LMBLOCK_WIDTH*LMBLOCK_HEIGHT)
-
 VkDeviceMemory			bmodel_memory;
 VkBuffer				bmodel_vertex_buffer;
 
@@ -384,6 +382,90 @@ void R_DrawBrushModel_ShowTris(entity_t *e)
 =============================================================
 */
 
+static msurface_t	**lightmap_queue;
+static int			lightmap_queue_count;
+static int			lightmap_queue_size;
+static int			lightmap_queue_sequence = 1;
+
+/*
+================
+R_QueueLightmapSurface
+
+Grows the dirty rectangle of the surface's block and queues the surface
+for the next R_ComposeLightmaps
+================
+*/
+static void R_QueueLightmapSurface (msurface_t *fa)
+{
+	struct lightmap_s *lm = &lightmaps[fa->lightmaptexturenum];
+	glRect_t    *theRect;
+	int smax, tmax;
+
+	if (fa->lightmapqueued == lightmap_queue_sequence)
+		return;
+	fa->lightmapqueued = lightmap_queue_sequence;
+
+	lm->modified = true;
+	theRect = &lm->rectchange;
+	if (fa->light_t < theRect->t) {
+		if (theRect->h)
+			theRect->h += theRect->t - fa->light_t;
+		theRect->t = fa->light_t;
+	}
+	if (fa->light_s < theRect->l) {
+		if (theRect->w)
+			theRect->w += theRect->l - fa->light_s;
+		theRect->l = fa->light_s;
+	}
+	smax = (fa->extents[0]>>4)+1;
+	tmax = (fa->extents[1]>>4)+1;
+	if ((theRect->w + theRect->l) < (fa->light_s + smax))
+		theRect->w = (fa->light_s-theRect->l)+smax;
+	if ((theRect->h + theRect->t) < (fa->light_t + tmax))
+		theRect->h = (fa->light_t-theRect->t)+tmax;
+
+	if (lightmap_queue_count == lightmap_queue_size)
+	{
+		lightmap_queue_size = q_max (lightmap_queue_size * 2, 1024);
+		lightmap_queue = (msurface_t **) realloc (lightmap_queue, sizeof(*lightmap_queue) * lightmap_queue_size);
+	}
+	lightmap_queue[lightmap_queue_count++] = fa;
+}
+
+/*
+================
+R_ComposeLightmapTask
+================
+*/
+static void R_ComposeLightmapTask (int index, void *data)
+{
+	msurface_t	*surf = ((msurface_t **)data)[index];
+	byte		*base;
+
+	base = lightmaps[surf->lightmaptexturenum].data;
+	base += (surf->light_t * LMBLOCK_WIDTH + surf->light_s) * lightmap_bytes;
+	R_BuildLightMap (surf, base, LMBLOCK_WIDTH*lightmap_bytes);
+}
+
+/*
+================
+R_ComposeLightmaps
+
+Rebuilds every queued surface from its raw samples, the current light
+styles and the dynamic lights. Surfaces own disjoint rectangles of their
+block, so they are composed on all worker threads.
+================
+*/
+void R_ComposeLightmaps (void)
+{
+	if (lightmap_queue_count == 0)
+		return;
+
+	Task_ParallelFor (lightmap_queue_count, R_ComposeLightmapTask, lightmap_queue);
+	lightmap_queue_count = 0;
+	lightmap_queue_sequence++;
+}
+
 /*
 ================
 R_RenderDynamicLightmaps
@@ -392,14 +474,14 @@ called during rendering
 */
 void R_RenderDynamicLightmaps (msurface_t *fa)
 {
-	byte		*base;
 	int			maps;
-	glRect_t    *theRect;
-	int smax, tmax;
 
 	if (fa->flags & SURF_DRAWTILED) //johnfitz -- not a lightmapped surface
 		return;
 
+	if (r_lightmaps_unused)
+		return;
+
 	// check for lightmap modification
 	for (maps=0; maps < MAXLIGHTMAPS && fa->styles[maps] != 255; maps++)
 		if (d_lightstylevalue[fa->styles[maps]] != fa->cached_light[maps])
@@ -410,30 +492,7 @@ void R_RenderDynamicLightmaps (msurface_t *fa)
 	{
 dynamic:
 		if (r_dynamic.value)
-		{
-			struct lightmap_s *lm = &lightmaps[fa->lightmaptexturenum];
-			lm->modified = true;
-			theRect = &lm->rectchange;
-			if (fa->light_t < theRect->t) {
-				if (theRect->h)
-					theRect->h += theRect->t - fa->light_t;
-				theRect->t = fa->light_t;
-			}
-			if (fa->light_s < theRect->l) {
-				if (theRect->w)
-					theRect->w += theRect->l - fa->light_s;
-				theRect->l = fa->light_s;
-			}
-			smax = (fa->extents[0]>>4)+1;
-			tmax = (fa->extents[1]>>4)+1;
-			if ((theRect->w + theRect->l) < (fa->light_s + smax))
-				theRect->w = (fa->light_s-theRect->l)+smax;
-			if ((theRect->h + theRect->t) < (fa->light_t + tmax))
-				theRect->h = (fa->light_t-theRect->t)+tmax;
-			base = lm->data;
-			base += fa->light_t * LMBLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-			R_BuildLightMap (fa, base, LMBLOCK_WIDTH*lightmap_bytes);
-		}
+			R_QueueLightmapSurface (fa);
 	}
 }
 
@@ -512,15 +571,12 @@ GL_CreateSurfaceLightmap
 void GL_CreateSurfaceLightmap (msurface_t *surf)
 {
 	int		smax, tmax;
-	byte	*base;
 
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
 
 	surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
-	base = lightmaps[surf->lightmaptexturenum].data;
-	base += (surf->light_t * LMBLOCK_WIDTH + surf->light_s) * lightmap_bytes;
-	R_BuildLightMap (surf, base, LMBLOCK_WIDTH*lightmap_bytes);
+	R_QueueLightmapSurface (surf);
 }
 
 /*
@@ -652,6 +708,8 @@ void GL_BuildLightmaps (void)
 		}
 	}
 
+	R_ComposeLightmaps ();
+
 	//
 	// upload all lightmaps that were filled
 	//
@@ -713,6 +771,9 @@ void GL_BuildBModelRTVertexAndIndexBuffer (void)
 	int remaining_size;
 	int copy_offset;
 
+	// textures of the previous BLAS are no longer referenced
+	TexMgr_UnpinTextures ();
+
 	// count all verts in all models
 	numverts = 0;
 	numindices = 0;
@@ -756,27 +817,13 @@ void GL_BuildBModelRTVertexAndIndexBuffer (void)
 
 			rt_vertex_t* rt_verts = (rt_vertex_t*)malloc(sizeof(rt_vertex_t) * s->numedges);
 
-			// add texture_index and material number (future use)
-			int tx_imageview_index = -1;
-			int fb_imageview_index = -1;
+			// the BLAS samples these for as long as it exists, keep them resident
+			TexMgr_PinTexture (s->texinfo->texture->gltexture);
+			TexMgr_PinTexture (s->texinfo->texture->fullbright);
 
-			if (s->texinfo->texture->gltexture) {
-				glheapnode_t* txheapnode = s->texinfo->texture->gltexture->heap_node;
-
-				while (txheapnode->prev != NULL) {
-					txheapnode = txheapnode->prev;
-					tx_imageview_index++;
-				}
-			}
-
-			if (s->texinfo->texture->fullbright) {
-				glheapnode_t* fbheapnode = s->texinfo->texture->fullbright->heap_node;
-
-				while (fbheapnode->prev != NULL) {
-					fbheapnode = fbheapnode->prev;
-					fb_imageview_index++;
-				}
-			}
+			// add texture_index and material number (future use)
+			int tx_imageview_index = TexMgr_DescriptorIndex(s->texinfo->texture->gltexture);
+			int fb_imageview_index = TexMgr_DescriptorIndex(s->texinfo->texture->fullbright);
 
 			// fullbright textures are considered emissive materials
 			if (fb_imageview_index != -1) {
@@ -882,6 +929,9 @@ void GL_BuildBModelRTVertexAndIndexBuffer (void)
 	
 	vulkan_globals.rt_static_index_count = numindices;
 
+	// the static BLAS of every frame is rebuilt once from the new buffers
+	vulkan_globals.rt_static_generation++;
+
 	remaining_size = iarray_bytes;
 	copy_offset = 0;
 
@@ -1035,29 +1085,30 @@ void GL_BuildBModelVertexBuffer (void)
 	free (varray);
 }
 
+typedef struct
+{
+	float	rad, minlight;
+	float	local[2];
+	float	color[3];
+} surfdlight_t;
+
 /*
 ===============
-R_AddDynamicLights
+R_GatherDynamicLights
+
+Projects the dynamic lights touching the surface onto its lightmap plane
 ===============
 */
-void R_AddDynamicLights (msurface_t *surf)
+static int R_GatherDynamicLights (msurface_t *surf, surfdlight_t *lights)
 {
-	int			lnum;
-	int			sd, td;
+	int			lnum, i, numlights;
 	float		dist, rad, minlight;
-	vec3_t		impact, local;
-	int			s, t;
-	int			i;
-	int			smax, tmax;
+	vec3_t		impact;
 	mtexinfo_t	*tex;
-	//johnfitz -- lit support via lordhavoc
-	float		cred, cgreen, cblue, brightness;
-	unsigned	*bl;
-	//johnfitz
+	surfdlight_t	*l;
 
-	smax = (surf->extents[0]>>4)+1;
-	tmax = (surf->extents[1]>>4)+1;
 	tex = surf->texinfo;
+	numlights = 0;
 
 	for (lnum=0 ; lnum<MAX_DLIGHTS ; lnum++)
 	{
@@ -1071,7 +1122,6 @@ void R_AddDynamicLights (msurface_t *surf)
 		minlight = cl_dlights[lnum].minlight;
 		if (rad < minlight)
 			continue;
-		minlight = rad - minlight;
 
 		for (i=0 ; i<3 ; i++)
 		{
@@ -1079,43 +1129,60 @@ void R_AddDynamicLights (msurface_t *surf)
 					surf->plane->normal[i]*dist;
 		}
 
-		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3];
-		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3];
+		l = &lights[numlights++];
+		l->rad = rad;
+		l->minlight = rad - minlight;
+		l->local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3] - surf->texturemins[0];
+		l->local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3] - surf->texturemins[1];
+		//johnfitz -- lit support via lordhavoc
+		l->color[0] = cl_dlights[lnum].color[0] * 256.0f;
+		l->color[1] = cl_dlights[lnum].color[1] * 256.0f;
+		l->color[2] = cl_dlights[lnum].color[2] * 256.0f;
+		//johnfitz
+	}
 
-		local[0] -= surf->texturemins[0];
-		local[1] -= surf->texturemins[1];
+	return numlights;
+}
 
-		//johnfitz -- lit support via lordhavoc
+/*
+===============
+R_AddDynamicLights
+
+Adds the gathered lights to row 't' of the surface
+===============
+*/
+static void R_AddDynamicLights (unsigned *blocklights, const surfdlight_t *lights, int numlights, int t, int smax)
+{
+	int			i, s, sd, td;
+	float		dist, brightness;
+	unsigned	*bl;
+	const surfdlight_t	*l;
+
+	for (i=0, l=lights ; i<numlights ; i++, l++)
+	{
 		bl = blocklights;
-		cred = cl_dlights[lnum].color[0] * 256.0f;
-		cgreen = cl_dlights[lnum].color[1] * 256.0f;
-		cblue = cl_dlights[lnum].color[2] * 256.0f;
-		//johnfitz
-		for (t = 0 ; t<tmax ; t++)
+		td = l->local[1] - t*16;
+		if (td < 0)
+			td = -td;
+		for (s=0 ; s<smax ; s++)
 		{
-			td = local[1] - t*16;
-			if (td < 0)
-				td = -td;
-			for (s=0 ; s<smax ; s++)
+			sd = l->local[0] - s*16;
+			if (sd < 0)
+				sd = -sd;
+			if (sd > td)
+				dist = sd + (td>>1);
+			else
+				dist = td + (sd>>1);
+			if (dist < l->minlight)
+			//johnfitz -- lit support via lordhavoc
 			{
-				sd = local[0] - s*16;
-				if (sd < 0)
-					sd = -sd;
-				if (sd > td)
-					dist = sd + (td>>1);
-				else
-					dist = td + (sd>>1);
-				if (dist < minlight)
-				//johnfitz -- lit support via lordhavoc
-				{
-					brightness = rad - dist;
-					bl[0] += (int) (brightness * cred);
-					bl[1] += (int) (brightness * cgreen);
-					bl[2] += (int) (brightness * cblue);
-				}
-				bl += 3;
-				//johnfitz
+				brightness = l->rad - dist;
+				bl[0] += (int) (brightness * l->color[0]);
+				bl[1] += (int) (brightness * l->color[1]);
+				bl[2] += (int) (brightness * l->color[2]);
 			}
+			bl += 3;
+			//johnfitz
 		}
 	}
 }
@@ -1126,12 +1193,11 @@ void R_AddDynamicLights (msurface_t *surf)
 R_AccumulateLightmap
 
 Scales 'lightmap' contents (RGB8) by 'scale' and accumulates
-the result in the 'blocklights' array (RGB32)
+the result in the 'bl' array (RGB32)
 ===============
 */
-void R_AccumulateLightmap(byte* lightmap, unsigned scale, int texels)
+static void R_AccumulateLightmap(unsigned *bl, const byte* lightmap, unsigned scale, int texels)
 {
-	unsigned *bl = blocklights;
 	int size = texels * 3;
 
 #ifdef USE_SSE2
@@ -1172,50 +1238,39 @@ void R_AccumulateLightmap(byte* lightmap, unsigned scale, int texels)
 ===============
 R_StoreLightmap
 
-Converts contiguous lightmap info accumulated in 'blocklights'
+Converts one row of lightmap info accumulated in 'src'
 from RGB32 (with 8 fractional bits) to RGBA8, saturates and
 stores the result in 'dest'
 ===============
 */
-void R_StoreLightmap(byte* dest, int width, int height, int stride)
+static void R_StoreLightmap(const unsigned *src, byte* dest, int width)
 {
-	unsigned *src = blocklights;
+	int i;
 
 #ifdef USE_SSE2
 	if (use_simd)
 	{
 		__m128i vzero = _mm_setzero_si128();
 
-		while (height-- > 0)
+		for (i = 0; i < width; i++)
 		{
-			int i;
-			for (i = 0; i < width; i++)
-			{
-				__m128i v = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)src), 8);
-				v = _mm_packs_epi32(v, vzero);
-				v = _mm_packus_epi16(v, vzero);
-				((uint32_t*)dest)[i] = _mm_cvtsi128_si32(v) | 0xff000000;
-				src += 3;
-			}
-			dest += stride;
+			__m128i v = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)src), 8);
+			v = _mm_packs_epi32(v, vzero);
+			v = _mm_packus_epi16(v, vzero);
+			((uint32_t*)dest)[i] = _mm_cvtsi128_si32(v) | 0xff000000;
+			src += 3;
 		}
 	}
 	else
 #endif // def USE_SSE2
 	{
-		stride -= width * 4;
-		while (height-- > 0)
+		for (i = 0; i < width; i++)
 		{
-			int i;
-			for (i = 0; i < width; i++)
-			{
-				unsigned c;
-				c = *src++ >> 8; *dest++ = q_min(c, 255);
-				c = *src++ >> 8; *dest++ = q_min(c, 255);
-				c = *src++ >> 8; *dest++ = q_min(c, 255);
-				*dest++ = 255;
-			}
-			dest += stride;
+			unsigned c;
+			c = *src++ >> 8; *dest++ = q_min(c, 255);
+			c = *src++ >> 8; *dest++ = q_min(c, 255);
+			c = *src++ >> 8; *dest++ = q_min(c, 255);
+			*dest++ = 255;
 		}
 	}
 }
@@ -1224,55 +1279,74 @@ void R_StoreLightmap(byte* dest, int width, int height, int stride)
 ===============
 R_BuildLightMap -- johnfitz -- revised for lit support via lordhavoc
 
-Combine and scale multiple lightmaps into the 8.8 format in blocklights
+Combine and scale multiple lightmaps into the 8.8 format, one row at a time.
+Only the surface itself and its rectangle of 'dest' are written, so
+surfaces can be built concurrently.
 ===============
 */
 void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 {
+	unsigned	blocklights[LMBLOCK_WIDTH*3 + 1]; //johnfitz -- lit support via lordhavoc, +1 for the 16 byte loads in R_StoreLightmap
+	unsigned	scales[MAXLIGHTMAPS];
+	surfdlight_t	lights[MAX_DLIGHTS];
 	int			smax, tmax;
 	int			size;
-	byte		*lightmap;
-	unsigned	scale;
-	int			maps;
+	const byte	*lightmap;
+	int			maps, numstyles, numlights;
+	int			t;
 
 	surf->cached_dlight = (surf->dlightframe == r_framecount);
 
 	smax = (surf->extents[0]>>4)+1;
 	tmax = (surf->extents[1]>>4)+1;
 	size = smax*tmax;
-	lightmap = surf->samples;
 
+	numstyles = 0;
+	numlights = 0;
 	if (cl.worldmodel->lightdata)
 	{
-		// clear to no light
-		memset (&blocklights[0], 0, size * 3 * sizeof (unsigned int)); //johnfitz -- lit support via lordhavoc
-
-		// add all the lightmaps
-		if (lightmap)
+		if (surf->samples)
 		{
 			for (maps = 0 ; maps < MAXLIGHTMAPS && surf->styles[maps] != 255 ;
 				 maps++)
 			{
-				scale = d_lightstylevalue[surf->styles[maps]];
-				surf->cached_light[maps] = scale;	// 8.8 fraction
-				//johnfitz -- lit support via lordhavoc
-				R_AccumulateLightmap(lightmap, scale, size);
-				lightmap += size * 3;
-				//johnfitz
+				scales[maps] = d_lightstylevalue[surf->styles[maps]];
+				surf->cached_light[maps] = scales[maps];	// 8.8 fraction
 			}
+			numstyles = maps;
 		}
 
-		// add all the dynamic lights
-		if (surf->dlightframe == r_framecount)
-			R_AddDynamicLights (surf);
+		if (surf->cached_dlight)
+			numlights = R_GatherDynamicLights (surf, lights);
 	}
-	else
+
+	for (t = 0 ; t < tmax ; t++, dest += stride)
 	{
-		// set to full bright if no light data
-		memset (&blocklights[0], 255, size * 3 * sizeof (unsigned int)); //johnfitz -- lit support via lordhavoc
-	}
+		if (!cl.worldmodel->lightdata)
+		{
+			// set to full bright if no light data
+			memset (&blocklights[0], 255, smax * 3 * sizeof (unsigned int)); //johnfitz -- lit support via lordhavoc
+		}
+		else
+		{
+			// clear to no light
+			memset (&blocklights[0], 0, smax * 3 * sizeof (unsigned int)); //johnfitz -- lit support via lordhavoc
 
-	R_StoreLightmap(dest, smax, tmax, stride);
+			// add all the lightmaps
+			if (numstyles)
+			{
+				lightmap = surf->samples + t * smax * 3;
+				for (maps = 0 ; maps < numstyles ; maps++, lightmap += size * 3)
+					R_AccumulateLightmap (blocklights, lightmap, scales[maps], smax);
+			}
+
+			// add all the dynamic lights
+			if (numlights)
+				R_AddDynamicLights (blocklights, lights, numlights, t, smax);
+		}
+
+		R_StoreLightmap (blocklights, dest, smax);
+	}
 }
 
 /*
@@ -1290,15 +1364,19 @@ static void R_UploadLightmap(int lmap, gltexture_t * lightmap_tex)
 
 	lm->modified = false;
 
-	const int staging_size = LMBLOCK_WIDTH * lm->rectchange.h * 4;
+	// only the dirty rectangle is copied, not whole rows of the block
+	const int row_size = lm->rectchange.w * lightmap_bytes;
+	const int staging_size = row_size * lm->rectchange.h;
 
 	VkBuffer staging_buffer;
 	VkCommandBuffer command_buffer;
 	int staging_offset;
 	unsigned char * staging_memory = R_StagingAllocate(staging_size, 4, &command_buffer, &staging_buffer, &staging_offset);
 
-	byte * data = lm->data+lm->rectchange.t*LMBLOCK_WIDTH*lightmap_bytes;
-	memcpy(staging_memory, data, staging_size);
+	int y;
+	byte * data = lm->data + (lm->rectchange.t*LMBLOCK_WIDTH + lm->rectchange.l)*lightmap_bytes;
+	for (y = 0; y < lm->rectchange.h; y++)
+		memcpy(staging_memory + y*row_size, data + y*LMBLOCK_WIDTH*lightmap_bytes, row_size);
 
 	VkBufferImageCopy region;
 	memset(&region, 0, sizeof(region));
@@ -1306,9 +1384,10 @@ static void R_UploadLightmap(int lmap, gltexture_t * lightmap_tex)
 	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	region.imageSubresource.layerCount = 1;
 	region.imageSubresource.mipLevel = 0;
-	region.imageExtent.width = LMBLOCK_WIDTH;
+	region.imageExtent.width = lm->rectchange.w;
 	region.imageExtent.height = lm->rectchange.h;
 	region.imageExtent.depth = 1;
+	region.imageOffset.x = lm->rectchange.l;
 	region.imageOffset.y = lm->rectchange.t;
 
 	VkImageMemoryBarrier image_memory_barrier;
@@ -1349,6 +1428,8 @@ void R_UploadLightmaps (void)
 {
 	int lmap;
 
+	R_ComposeLightmaps ();
+
 	for (lmap = 0; lmap < lightmap_count; lmap++)
 	{
 		if (!lightmaps[lmap].modified)
@@ -33,7 +33,10 @@ int		ramp1[8] = {0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61};
 int		ramp2[8] = {0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66};
 int		ramp3[8] = {0x6d, 0x6b, 6, 5, 4, 3};
 
-particle_t	*active_particles, *free_particles, *particles;
+#define PARTICLE_TASK_SIZE		512		// particles simulated or emitted per worker task
+
+particle_t	*particles;
+static int	num_active_particles;	// particles[0 .. num_active_particles-1] are alive
 
 vec3_t			r_pright, r_pup, r_ppn;
 
@@ -250,6 +253,21 @@ void R_InitParticles (void)
 	R_InitParticleIndexBuffer();
 }
 
+/*
+===============
+R_AllocParticle
+
+Live particles are packed at the front of the particles array so the
+simulation and vertex emission can split them into independent ranges
+===============
+*/
+static particle_t *R_AllocParticle (void)
+{
+	if (num_active_particles >= r_numparticles)
+		return NULL;
+	return &particles[num_active_particles++];
+}
+
 /*
 ===============
 R_EntityParticles
@@ -303,12 +321,9 @@ void R_EntityParticles (entity_t *ent)
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 0.01;
 		p->color = 0x6f;
@@ -327,14 +342,7 @@ R_ClearParticles
 */
 void R_ClearParticles (void)
 {
-	int		i;
-
-	free_particles = &particles[0];
-	active_particles = NULL;
-
-	for (i=0 ;i<r_numparticles ; i++)
-		particles[i].next = &particles[i+1];
-	particles[r_numparticles-1].next = NULL;
+	num_active_particles = 0;
 }
 
 /*
@@ -373,15 +381,12 @@ void R_ReadPointFile_f (void)
 			break;
 		c++;
 
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 		{
 			Con_Printf ("Not enough free particles\n");
 			break;
 		}
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = 99999;
 		p->color = (-c)&15;
@@ -433,12 +438,9 @@ void R_ParticleExplosion (vec3_t org)
 
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 5;
 		p->color = ramp1[0];
@@ -477,12 +479,9 @@ void R_ParticleExplosion2 (vec3_t org, int colorStart, int colorLength)
 
 	for (i=0; i<512; i++)
 	{
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 0.3;
 		p->color = colorStart + (colorMod % colorLength);
@@ -509,12 +508,9 @@ void R_BlobExplosion (vec3_t org)
 
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 1 + (rand()&8)*0.05;
 
@@ -553,12 +549,9 @@ void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		if (count == 1024)
 		{	// rocket explosion
@@ -614,12 +607,9 @@ void R_LavaSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j++)
 			for (k=0 ; k<1 ; k++)
 			{
-				if (!free_particles)
+				p = R_AllocParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 
 				p->die = cl.time + 2 + (rand()&31) * 0.02;
 				p->color = 224 + (rand()&7);
@@ -655,12 +645,9 @@ void R_TeleportSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j+=4)
 			for (k=-24 ; k<32 ; k+=4)
 			{
-				if (!free_particles)
+				p = R_AllocParticle ();
+				if (!p)
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 
 				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
 				p->color = 7 + (rand()&7);
@@ -710,12 +697,9 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		p = R_AllocParticle ();
+		if (!p)
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		VectorCopy (vec3_origin, p->vel);
 		p->die = cl.time + 2;
@@ -790,52 +774,33 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	}
 }
 
+typedef struct
+{
+	float	frametime, time1, time2, time3, grav, dvel;
+} particlestep_t;
+
 /*
 ===============
-CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawParticles
+CL_RunParticlesTask
+
+Integrates one PARTICLE_TASK_SIZE range of live particles. Particles never
+interact, so the ranges can run on any worker in any order.
 ===============
 */
-void CL_RunParticles (void)
+static void CL_RunParticlesTask (int index, void *data)
 {
-	particle_t		*p, *kill;
-	int				i;
-	float			time1, time2, time3, dvel, frametime, grav;
-	extern	cvar_t	sv_gravity;
-
-	frametime = cl.time - cl.oldtime;
-	time3 = frametime * 15;
-	time2 = frametime * 10;
-	time1 = frametime * 5;
-	grav = frametime * sv_gravity.value * 0.05;
-	dvel = 4*frametime;
-
-	for ( ;; )
+	const particlestep_t *step = (const particlestep_t *)data;
+	const float frametime = step->frametime;
+	const float grav = step->grav;
+	const float dvel = step->dvel;
+	const int first = index * PARTICLE_TASK_SIZE;
+	const int last = q_min (first + PARTICLE_TASK_SIZE, num_active_particles);
+	particle_t *p;
+	int i, j;
+
+	for (j = first; j < last; ++j)
 	{
-		kill = active_particles;
-		if (kill && kill->die < cl.time)
-		{
-			active_particles = kill->next;
-			kill->next = free_particles;
-			free_particles = kill;
-			continue;
-		}
-		break;
-	}
-
-	for (p=active_particles ; p ; p=p->next)
-	{
-		for ( ;; )
-		{
-			kill = p->next;
-			if (kill && kill->die < cl.time)
-			{
-				p->next = kill->next;
-				kill->next = free_particles;
-				free_particles = kill;
-				continue;
-			}
-			break;
-		}
+		p = &particles[j];
 
 		p->org[0] += p->vel[0]*frametime;
 		p->org[1] += p->vel[1]*frametime;
@@ -846,7 +811,7 @@ void CL_RunParticles (void)
 		case pt_static:
 			break;
 		case pt_fire:
-			p->ramp += time1;
+			p->ramp += step->time1;
 			if (p->ramp >= 6)
 				p->die = -1;
 			else
@@ -855,7 +820,7 @@ void CL_RunParticles (void)
 			break;
 
 		case pt_explode:
-			p->ramp += time2;
+			p->ramp += step->time2;
 			if (p->ramp >=8)
 				p->die = -1;
 			else
@@ -866,7 +831,7 @@ void CL_RunParticles (void)
 			break;
 
 		case pt_explode2:
-			p->ramp += time3;
+			p->ramp += step->time3;
 			if (p->ramp >=8)
 				p->die = -1;
 			else
@@ -898,53 +863,85 @@ void CL_RunParticles (void)
 
 /*
 ===============
-R_DrawParticlesFaces
+CL_RunParticles -- johnfitz -- all the particle behavior, separated from R_DrawParticles
 ===============
 */
-static void R_DrawParticlesFaces(void)
+void CL_RunParticles (void)
 {
-	particle_t		*p;
-	float			scale, texcoord_scale;
-	vec3_t			up, right, up_right, p_up, p_right, p_up_right;
-	extern	cvar_t	r_particles; //johnfitz
-
-	if (!r_particles.value)
-		return;
+	particlestep_t	step;
+	int				i;
+	extern	cvar_t	sv_gravity;
 
-	if (!active_particles)
-		return;
+	step.frametime = cl.time - cl.oldtime;
+	step.time3 = step.frametime * 15;
+	step.time2 = step.frametime * 10;
+	step.time1 = step.frametime * 5;
+	step.grav = step.frametime * sv_gravity.value * 0.05;
+	step.dvel = 4*step.frametime;
 
-	if (r_quadparticles.value)
+	// remove expired particles by moving the last live particle into their slot
+	for (i = 0; i < num_active_particles; )
 	{
-		VectorScale(vup, 0.75, up);
-		VectorScale(vright, 0.75, right);
-		texcoord_scale = 0.5f;
-	}
-	else
-	{
-		VectorScale(vup, 1.5, up);
-		VectorScale(vright, 1.5, right);
-		texcoord_scale = 1.0f;
+		if (particles[i].die < cl.time)
+			particles[i] = particles[--num_active_particles];
+		else
+			++i;
 	}
 
-	for (int i = 0; i < 3; ++i)
-		up_right[i] = up[i] + right[i];
+	Task_ParallelFor ((num_active_particles + PARTICLE_TASK_SIZE - 1) / PARTICLE_TASK_SIZE, CL_RunParticlesTask, &step);
+}
 
-	int num_particles = 0;
-	for (p = active_particles; p; p = p->next)
-		num_particles += 1;
+typedef struct
+{
+	basicvertex_t	*vertices;
+	int				vertices_per_particle;
+	float			texcoord_scale;
+	vec3_t			up, right, up_right;
+} particleemit_t;
 
-	VkBuffer vertex_buffer;
-	VkDeviceSize vertex_buffer_offset;
-	basicvertex_t * vertices;
-	if (r_quadparticles.value)
-		vertices = (basicvertex_t*)R_VertexAllocate(num_particles * 4 * sizeof(basicvertex_t), &vertex_buffer, &vertex_buffer_offset);
-	else
-		vertices = (basicvertex_t*)R_VertexAllocate(num_particles * 3 * sizeof(basicvertex_t), &vertex_buffer, &vertex_buffer_offset);
+/*
+===============
+R_SetParticleVertex
+===============
+*/
+static inline void R_SetParticleVertex (basicvertex_t *vertex, const vec3_t position, float s, float t, const byte *c)
+{
+	vertex->position[0] = position[0];
+	vertex->position[1] = position[1];
+	vertex->position[2] = position[2];
+	vertex->texcoord[0] = s;
+	vertex->texcoord[1] = t;
+	vertex->color[0] = c[0];
+	vertex->color[1] = c[1];
+	vertex->color[2] = c[2];
+	vertex->color[3] = 255;
+}
 
-	int current_vertex = 0;
-	for (p = active_particles; p; p = p->next)
+/*
+===============
+R_EmitParticlesTask
+
+Writes the vertices of one PARTICLE_TASK_SIZE range of particles. Every
+particle owns a fixed slot in the vertex buffer, so ranges never overlap.
+===============
+*/
+static void R_EmitParticlesTask (int index, void *data)
+{
+	particleemit_t *emit = (particleemit_t *)data;
+	const float texcoord_scale = emit->texcoord_scale;
+	const int first = index * PARTICLE_TASK_SIZE;
+	const int last = q_min (first + PARTICLE_TASK_SIZE, num_active_particles);
+	basicvertex_t *vertices = emit->vertices + first * emit->vertices_per_particle;
+	vec3_t p_up, p_right, p_up_right;
+	particle_t *p;
+	const byte *c;
+	float scale;
+	int i;
+
+	for (i = first; i < last; ++i)
 	{
+		p = &particles[i];
+
 		// hack a scale up to keep particles from disapearing
 		scale = (p->org[0] - r_origin[0]) * vpn[0]
 			+ (p->org[1] - r_origin[1]) * vpn[1]
@@ -956,61 +953,67 @@ static void R_DrawParticlesFaces(void)
 
 		scale *= texturescalefactor; //johnfitz -- compensate for apparent size of different particle textures
 
-		byte * c = (byte*)&d_8to24table[(int)p->color];
-
-		vertices[current_vertex].position[0] = p->org[0];
-		vertices[current_vertex].position[1] = p->org[1];
-		vertices[current_vertex].position[2] = p->org[2];
-		vertices[current_vertex].texcoord[0] = 0.0f;
-		vertices[current_vertex].texcoord[1] = 0.0f;
-		vertices[current_vertex].color[0] = c[0];
-		vertices[current_vertex].color[1] = c[1];
-		vertices[current_vertex].color[2] = c[2];
-		vertices[current_vertex].color[3] = 255;
-		current_vertex++;
-
-		VectorMA(p->org, scale, up, p_up);
-		vertices[current_vertex].position[0] = p_up[0];
-		vertices[current_vertex].position[1] = p_up[1];
-		vertices[current_vertex].position[2] = p_up[2];
-		vertices[current_vertex].texcoord[0] = texcoord_scale;
-		vertices[current_vertex].texcoord[1] = 0.0f;
-		vertices[current_vertex].color[0] = c[0];
-		vertices[current_vertex].color[1] = c[1];
-		vertices[current_vertex].color[2] = c[2];
-		vertices[current_vertex].color[3] = 255;
-		current_vertex++;
-
-		if (r_quadparticles.value)
+		c = (const byte*)&d_8to24table[(int)p->color];
+
+		R_SetParticleVertex (vertices++, p->org, 0.0f, 0.0f, c);
+
+		VectorMA(p->org, scale, emit->up, p_up);
+		R_SetParticleVertex (vertices++, p_up, texcoord_scale, 0.0f, c);
+
+		if (emit->vertices_per_particle == 4)
 		{
-			VectorMA(p->org, scale, up_right, p_up_right);
-			vertices[current_vertex].position[0] = p_up_right[0];
-			vertices[current_vertex].position[1] = p_up_right[1];
-			vertices[current_vertex].position[2] = p_up_right[2];
-			vertices[current_vertex].texcoord[0] = texcoord_scale;
-			vertices[current_vertex].texcoord[1] = texcoord_scale;
-			vertices[current_vertex].color[0] = c[0];
-			vertices[current_vertex].color[1] = c[1];
-			vertices[current_vertex].color[2] = c[2];
-			vertices[current_vertex].color[3] = 255;
-			current_vertex++;
+			VectorMA(p->org, scale, emit->up_right, p_up_right);
+			R_SetParticleVertex (vertices++, p_up_right, texcoord_scale, texcoord_scale, c);
 		}
 
-		VectorMA(p->org, scale, right, p_right);
-		vertices[current_vertex].position[0] = p_right[0];
-		vertices[current_vertex].position[1] = p_right[1];
-		vertices[current_vertex].position[2] = p_right[2];
-		vertices[current_vertex].texcoord[0] = 0.0f;
-		vertices[current_vertex].texcoord[1] = texcoord_scale;
-		vertices[current_vertex].color[0] = c[0];
-		vertices[current_vertex].color[1] = c[1];
-		vertices[current_vertex].color[2] = c[2];
-		vertices[current_vertex].color[3] = 255;
-		current_vertex++;
-
-		rs_particles++;
+		VectorMA(p->org, scale, emit->right, p_right);
+		R_SetParticleVertex (vertices++, p_right, 0.0f, texcoord_scale, c);
+	}
+}
+
+/*
+===============
+R_DrawParticlesFaces
+===============
+*/
+static void R_DrawParticlesFaces(void)
+{
+	particleemit_t	emit;
+	extern	cvar_t	r_particles; //johnfitz
+
+	if (!r_particles.value)
+		return;
+
+	if (!num_active_particles)
+		return;
+
+	if (r_quadparticles.value)
+	{
+		VectorScale(vup, 0.75, emit.up);
+		VectorScale(vright, 0.75, emit.right);
+		emit.texcoord_scale = 0.5f;
+		emit.vertices_per_particle = 4;
+	}
+	else
+	{
+		VectorScale(vup, 1.5, emit.up);
+		VectorScale(vright, 1.5, emit.right);
+		emit.texcoord_scale = 1.0f;
+		emit.vertices_per_particle = 3;
 	}
 
+	for (int i = 0; i < 3; ++i)
+		emit.up_right[i] = emit.up[i] + emit.right[i];
+
+	const int num_particles = num_active_particles;
+
+	VkBuffer vertex_buffer;
+	VkDeviceSize vertex_buffer_offset;
+	emit.vertices = (basicvertex_t*)R_VertexAllocate(num_particles * emit.vertices_per_particle * sizeof(basicvertex_t), &vertex_buffer, &vertex_buffer_offset);
+
+	Task_ParallelFor ((num_particles + PARTICLE_TASK_SIZE - 1) / PARTICLE_TASK_SIZE, R_EmitParticlesTask, &emit);
+	rs_particles += num_particles;
+
 	vulkan_globals.vk_cmd_bind_vertex_buffers(vulkan_globals.command_buffer, 0, 1, &vertex_buffer, &vertex_buffer_offset);
 	if (r_quadparticles.value)
 	{
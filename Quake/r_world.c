@@ -330,6 +330,8 @@ void R_MarkSurfaces (void)
 	else
 #endif
 	  R_MarkVisSurfaces(vis);
+
+	R_ComposeLightmaps ();
 }
 
 //==============================================================================
@@ -560,141 +562,113 @@ void R_DrawTextureChains_Water (qmodel_t *model, entity_t *ent, texchain_t chain
 	}
 }
 
+/*
+================
+RT_SkipChainTexture
+================
+*/
+static qboolean RT_SkipChainTexture (texture_t *t, texchain_t chain)
+{
+	return !t || !t->texturechains[chain] || (t->texturechains[chain]->flags & (SURF_DRAWTILED | SURF_NOTEXTURE));
+}
+
 /*
 ================
 RT_LoadBrushModelIndices
+
+Transforms the surfaces of a texture chain into the RT geometry ring. Sizes
+are counted first so the whole model is written with a single allocation.
 ================
 */
 void RT_LoadBrushModelIndices(qmodel_t* model, entity_t* ent, texchain_t chain, float mvp[16])
 {
-	int			i;
+	int			i, j;
 	msurface_t* s;
 	texture_t* t;
-	qboolean	bound;
-	qboolean	fullbright_enabled = false;
-	gltexture_t* fullbright = NULL;
-
-	// sets current overall index_count
-	int current_blas_index = vulkan_globals.rt_current_blas_index;
+	int			num_verts = 0;
+	int			num_indices = 0;
+	int			index_count = 0;
+	uint32_t	*index_out;
+	rt_vertex_t	*vertex_out;
+	byte		*index_bytes, *vertex_bytes;
+	VkDeviceSize vertex_offset, index_offset_bytes;
 
-	int index_count = 0;
-	int index_offset = vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count;
-
-	uint32_t* index_data_pointer = (uint32_t*)malloc(16000 * sizeof(uint32_t));
-	
-	// copy brush vertices from buffer;
-		// Make buffer mappable or somehow gather data from data
-	rt_vertex_t* vertex_data = (rt_vertex_t*)buffer_map(&vulkan_globals.rt_static_vertex_buffer_resource);
-	buffer_unmap(&vulkan_globals.rt_static_vertex_buffer_resource);
+	const int current_blas_index = vulkan_globals.rt_current_blas_index;
+	const int base_vertex = vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count;
 
 	for (i = 0; i < model->numtextures; ++i)
 	{
 		t = model->textures[i];
-
-		if (!t || !t->texturechains[chain] || t->texturechains[chain]->flags & (SURF_DRAWTILED | SURF_NOTEXTURE))
+		if (RT_SkipChainTexture (t, chain))
 			continue;
-
-		if (gl_fullbrights.value && (fullbright = R_TextureAnimation(t, ent != NULL ? ent->frame : 0)->fullbright) && !r_lightmap_cheatsafe)
-		{
-			fullbright_enabled = true;
-		}
-		else
-			fullbright_enabled = false;
-
-		//R_ClearBatch();
-
-		/*int tx_imageview_index = -1;
-		int fb_imageview_index = -1;*/
-
-		bound = false;
 		for (s = t->texturechains[chain]; s; s = s->texturechain)
 		{
+			num_verts += s->numedges;
+			num_indices += R_NumTriangleIndicesForSurf (s);
+		}
+	}
 
-			if (!bound) //only bind once we are sure we need this texture
-			{
-				// TODO: Reintroduce TextureAnimation
-				/*texture_t* texture = R_TextureAnimation(t, ent != NULL ? ent->frame : 0);
-				gltexture_t* gl_texture = texture->gltexture;
-				if (!r_lightmap_cheatsafe) {
-					glheapnode_t* txheapnode = gl_texture->heap_node;
-
-					while (txheapnode->prev != NULL) {
-						txheapnode = txheapnode->prev;
-						tx_imageview_index++;
-					}
-				}*/
-					
-				//alpha_test = (t->texturechains[chain]->flags & SURF_DRAWFENCE) != 0;
-				bound = true;
-			}
-
-			// Batch surface
-			{
-				int num_surf_indices;
+	if (num_verts == 0)
+		return;
 
-				num_surf_indices = R_NumTriangleIndicesForSurf(s);
+	// The ring buffer is full for this frame, it grows before the next one
+	if (!R_RTGeometryAllocate (num_verts * sizeof(rt_vertex_t), num_indices * sizeof(uint32_t), &vertex_bytes, &vertex_offset, &index_bytes, &index_offset_bytes))
+		return;
+	vertex_out = (rt_vertex_t *)vertex_bytes;
+	index_out = (uint32_t *)index_bytes;
 
-				R_TriangleAndTextureIndicesForSurf(s, index_data_pointer, index_count);	// cumulative index count of previous models (offset) + current index_count
+	const rt_vertex_t *vertex_data = (const rt_vertex_t *)buffer_map (&vulkan_globals.rt_static_vertex_buffer_resource);
 
-				for (int j = index_count; j < index_count + num_surf_indices; j++) {
-					int index = index_data_pointer[j] - s->vbo_firstvert + index_offset;
-					index_data_pointer[j] = index;
-				}
+	num_verts = 0;
+	for (i = 0; i < model->numtextures; ++i)
+	{
+		t = model->textures[i];
+		if (RT_SkipChainTexture (t, chain))
+			continue;
 
-				index_count += num_surf_indices;
-				vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count += s->numedges;
-				index_offset = vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count;
-			}
+		texture_t *anim = R_TextureAnimation (t, ent != NULL ? ent->frame : 0);
+		TexMgr_TouchTexture (anim->gltexture);
+		TexMgr_TouchTexture (anim->fullbright);
 
-			rt_vertex_t* brush_vertex_data = (rt_vertex_t*)malloc(s->numedges * sizeof(rt_vertex_t));
+		for (s = t->texturechains[chain]; s; s = s->texturechain)
+		{
+			const int num_surf_indices = R_NumTriangleIndicesForSurf (s);
 
-			for (int j = 0; j < s->numedges; j++) {
-				int index = j + s->vbo_firstvert;
-				rt_vertex_t current_vertex = vertex_data[index];
+			R_TriangleAndTextureIndicesForSurf (s, index_out, index_count);
+			for (j = index_count; j < index_count + num_surf_indices; j++)
+				index_out[j] = index_out[j] - s->vbo_firstvert + base_vertex + num_verts;
+			index_count += num_surf_indices;
 
+			for (j = 0; j < s->numedges; j++)
+			{
+				rt_vertex_t current_vertex = vertex_data[s->vbo_firstvert + j];
 				float vertex[16];
+				float matrix_copy[16];
+
 				vertex[0] = current_vertex.vertex_pos[0];
 				vertex[1] = current_vertex.vertex_pos[1];
 				vertex[2] = current_vertex.vertex_pos[2];
 				vertex[3] = 1;
 
-				float matrix_copy[16];
-				memcpy(matrix_copy, mvp, 16 * sizeof(float));
-				MatrixMultiply(matrix_copy, vertex);
+				memcpy (matrix_copy, mvp, 16 * sizeof(float));
+				MatrixMultiply (matrix_copy, vertex);
 
 				current_vertex.vertex_pos[0] = matrix_copy[0];
 				current_vertex.vertex_pos[1] = matrix_copy[1];
 				current_vertex.vertex_pos[2] = matrix_copy[2];
-
-				brush_vertex_data[j] = current_vertex;
+				vertex_out[num_verts + j] = current_vertex;
 			}
-
-			VkBuffer dynamic_vertex_buffer;
-			VkDeviceSize dynamic_vertex_buffer_offset;
-			byte* vertices = R_VertexAllocate(s->numedges * sizeof(rt_vertex_t), &dynamic_vertex_buffer, &dynamic_vertex_buffer_offset);
-			memcpy(vertices, brush_vertex_data, s->numedges * sizeof(rt_vertex_t));
-			
-			free(brush_vertex_data);
+			num_verts += s->numedges;
 
 			rs_brushpasses++;
 		}
-
-		vulkan_globals.rt_blas_data_pointer[current_blas_index].model_count += 1;
-		if (vulkan_globals.rt_blas_data_pointer[current_blas_index].model_count == 3) {
-			num_vbo_indices = 0;
-		}
 	}
 
-	vulkan_globals.rt_blas_data_pointer[current_blas_index].index_count += index_count;
+	buffer_unmap (&vulkan_globals.rt_static_vertex_buffer_resource);
 
-	num_vbo_indices = 0;
-
-	VkBuffer dynamic_index_buffer;
-	VkDeviceSize dynamic_index_buffer_offset;
-	byte* indices = R_IndexAllocate(index_count * sizeof(uint32_t), &dynamic_index_buffer, &dynamic_index_buffer_offset);
-	memcpy(indices, index_data_pointer, index_count * sizeof(uint32_t));
-
-	free(index_data_pointer);
+	vulkan_globals.rt_blas_data_pointer[current_blas_index].vertex_count += num_verts;
+	vulkan_globals.rt_blas_data_pointer[current_blas_index].index_count += index_count;
+	vulkan_globals.rt_blas_data_pointer[current_blas_index].model_count += 1;
 }
 
 /*
@@ -172,6 +172,9 @@ typedef struct client_s
 	} *previousentities;
 	size_t numpreviousentities;
 	size_t maxpreviousentities;
+	struct entity_num_state_s *snapshotentities;	//the snapshot being built, swapped with previousentities once the deltas are known
+	size_t numsnapshotentities;
+	size_t maxsnapshotentities;
 	unsigned int snapshotresume;
 	unsigned int *pendingentities_bits;	//UF_ flags for each entity
 	size_t numpendingentities;	//realloc if too small
@@ -317,6 +320,8 @@ void SV_ClientPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 void SV_BroadcastPrintf (const char *fmt, ...) FUNC_PRINTF(1,2);
 
 void SV_Physics (void);
+void SV_PhysicsStats_f (void);
+void SV_PhysicsBench_f (void);
 
 qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
@@ -347,10 +347,6 @@ static void MSGFTE_WriteEntityUpdate(unsigned int bits, entity_state_t *state, s
 	}
 }
 
-static struct entity_num_state_s *snapshot_entstate;
-static size_t snapshot_numents;
-static size_t snapshot_maxents;
-
 void SVFTE_DestroyFrames(client_t *client)
 {
 	int i;
@@ -366,6 +362,11 @@ void SVFTE_DestroyFrames(client_t *client)
 	client->previousentities = NULL;
 	client->numpreviousentities = 0;
 	client->maxpreviousentities = 0;
+	if (client->snapshotentities)
+		free(client->snapshotentities);
+	client->snapshotentities = NULL;
+	client->numsnapshotentities = 0;
+	client->maxsnapshotentities = 0;
 
 
 	if (client->pendingentities_bits)
@@ -574,8 +575,8 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 		client->pendingentities_bits[0] = UF_REMOVE;
 	}
 
-	news = snapshot_entstate;
-	newstop = news + snapshot_numents;
+	news = client->snapshotentities;
+	newstop = news + client->numsnapshotentities;
 	olds = client->previousentities;
 	oldstop = (olds != NULL) ? (olds+client->numpreviousentities) : NULL;
 
@@ -615,13 +616,13 @@ static void SVFTE_CalcEntityDeltas(client_t *client)
 	olds = client->previousentities;
 	oldstop = (olds != NULL) ? (olds + client->maxpreviousentities) : NULL;
 
-	client->previousentities = snapshot_entstate;
-	client->numpreviousentities = snapshot_numents;
-	client->maxpreviousentities = snapshot_maxents;
+	client->previousentities = client->snapshotentities;
+	client->numpreviousentities = client->numsnapshotentities;
+	client->maxpreviousentities = client->maxsnapshotentities;
 
-	snapshot_entstate = olds;
-	snapshot_numents = 0;
-	snapshot_maxents = (olds != NULL) ? (oldstop - olds) : 0;
+	client->snapshotentities = olds;
+	client->numsnapshotentities = 0;
+	client->maxsnapshotentities = (olds != NULL) ? (oldstop - olds) : 0;
 }
 static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t overflowsize)
 {
@@ -723,8 +724,10 @@ static void SVFTE_WriteEntitiesToClient(client_t *client, sizebuf_t *msg, size_t
 
 	//remember how far we got, so we can keep things flushed, instead of only updating the first N entities.
 	client->snapshotresume = entnum;
-
-
+}
+//kept out of SVFTE_WriteEntitiesToClient so that it can run on the workers
+static void SVFTE_NotePacketSize(sizebuf_t *msg)
+{
 	if (msg->cursize > 1024 && dev_peakstats.packetsize <= 1024)
 		Con_DWarning ("%i byte packet exceeds standard limit of 1024.\n", msg->cursize);
 	dev_stats.packetsize = msg->cursize;
@@ -782,62 +785,157 @@ void SV_BuildEntityState(edict_t *ent, entity_state_t *state)
 	state->velocity[0] = state->velocity[1] = state->velocity[2] = 0;
 }
 
+/*
+=============================================================================
+
+ENTITY STATE MIRROR
+
+The visibility and snapshot loops walk every edict once for every client,
+touching the scattered model, alpha, leaf and state fields of a whole edict_t
+each time. SV_FillEntityMirror copies what those loops read into flat arrays
+once per frame after physics, so the per-client passes only stream through
+the arrays and SV_BuildEntityState runs once per edict instead of once per
+client that can see it.
+
+=============================================================================
+*/
+
+#define	ENTMIRROR_MODEL		1	// has a model to send
+#define	ENTMIRROR_HIDDEN	2	// fully transparent and without effects
+#define	ENTMIRROR_NOLEAFS	4	// not in any leaf
+#define	ENTMIRROR_ALLLEAFS	8	// in too many leafs to be vis culled
+#define	ENTMIRROR_STATE		16	// states holds the entity state
+
+typedef struct
+{
+	int				numedicts;
+	int				maxedicts;
+	byte			*flags;			// ENTMIRROR_ bits
+	entity_state_t	*states;		// SV_BuildEntityState of edicts that can be sent
+	int				*firstleafword;	// into leafwords and leafwordmasks
+	byte			*numleafwords;
+	int				*leafwords;		// leafwords of all edicts back to back
+	unsigned int	*leafwordmasks;
+	int				maxleafwords;
+} entmirror_t;
+
+static entmirror_t	entmirror;
+
+/*
+=============
+SV_FillEntityMirror
+
+Copies the edicts into entmirror. Entity states are only built with
+buildstates, for the edicts a snapshot can include.
+=============
+*/
+static void SV_FillEntityMirror (edict_t *edicts, int numedicts, qboolean buildstates)
+{
+	edict_t		*ent;
+	eval_t		*val;
+	int			e, numwords;
+	byte		flags;
+
+	if (numedicts > entmirror.maxedicts)
+	{
+		e = entmirror.maxedicts;
+		entmirror.maxedicts = q_max (numedicts, qcvm->max_edicts);
+		entmirror.flags = (byte *) realloc (entmirror.flags, entmirror.maxedicts);
+		entmirror.states = (entity_state_t *) realloc (entmirror.states, entmirror.maxedicts * sizeof(entity_state_t));
+		entmirror.firstleafword = (int *) realloc (entmirror.firstleafword, entmirror.maxedicts * sizeof(int));
+		entmirror.numleafwords = (byte *) realloc (entmirror.numleafwords, entmirror.maxedicts);
+		if (!entmirror.flags || !entmirror.states || !entmirror.firstleafword || !entmirror.numleafwords)
+			Sys_Error ("SV_FillEntityMirror: realloc() failed on %d edicts", entmirror.maxedicts);
+		// SV_BuildEntityState leaves pad and solidsize alone
+		memset (entmirror.states + e, 0, (entmirror.maxedicts - e) * sizeof(entity_state_t));
+	}
+
+	numwords = 0;
+	for (e = 0, ent = edicts; e < numedicts; e++, ent = NEXT_EDICT(ent))
+	{
+		flags = 0;
+		if (ent->v.modelindex && PR_GetString (ent->v.model)[0])
+			flags |= ENTMIRROR_MODEL;
+		if ((flags & ENTMIRROR_MODEL) || (e > 0 && e <= svs.maxclients))
+		{
+			//johnfitz -- alpha, was updated for every client that was sent the entity
+			if ((val = GetEdictFieldValue (ent, qcvm->extfields.alpha)))
+				ent->alpha = ENTALPHA_ENCODE (val->_float);
+			if (buildstates)
+			{
+				SV_BuildEntityState (ent, &entmirror.states[e]);
+				flags |= ENTMIRROR_STATE;
+			}
+		}
+		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+			flags |= ENTMIRROR_HIDDEN;
+		if (!ent->num_leafs)
+			flags |= ENTMIRROR_NOLEAFS;
+		else if (ent->num_leafs >= MAX_ENT_LEAFS)
+			flags |= ENTMIRROR_ALLLEAFS;
+		entmirror.flags[e] = flags;
+
+		if (numwords + (int)ent->num_leafwords > entmirror.maxleafwords)
+		{
+			entmirror.maxleafwords = q_max (entmirror.maxleafwords * 2, numwords + MAX_ENT_LEAFS);
+			entmirror.leafwords = (int *) realloc (entmirror.leafwords, entmirror.maxleafwords * sizeof(int));
+			entmirror.leafwordmasks = (unsigned int *) realloc (entmirror.leafwordmasks, entmirror.maxleafwords * sizeof(unsigned int));
+			if (!entmirror.leafwords || !entmirror.leafwordmasks)
+				Sys_Error ("SV_FillEntityMirror: realloc() failed on %d leaf words", entmirror.maxleafwords);
+		}
+		entmirror.firstleafword[e] = numwords;
+		entmirror.numleafwords[e] = ent->num_leafwords;
+		memcpy (entmirror.leafwords + numwords, ent->leafwords, ent->num_leafwords * sizeof(int));
+		memcpy (entmirror.leafwordmasks + numwords, ent->leafwordmasks, ent->num_leafwords * sizeof(unsigned int));
+		numwords += ent->num_leafwords;
+	}
+
+	entmirror.numedicts = numedicts;
+}
+
 byte *SV_FatPVS (vec3_t org, qmodel_t *worldmodel);
-static void SVFTE_BuildSnapshotForClient (client_t *client)
+static byte *SV_ClientFatPVS (client_t *client);
+static qboolean SV_EntityTouchesClientPVS (client_t *client, unsigned int e, const byte *pvs);
+/*
+Reads the edicts through entmirror only, so that it can run on the workers.
+*/
+static void SVFTE_BuildSnapshotForClient (client_t *client, const byte *pvs)
 {
-	unsigned int	e, i;
-	byte			*pvs;
-	vec3_t			org;
-	edict_t			*ent, *parent;
+	unsigned int	e;
 	unsigned int	maxentities = client->limit_entities;
 	edict_t			*clent = client->edict;
+	unsigned int	clentnum = NUM_FOR_EDICT(clent);
 	unsigned char	eflags;
+	byte			flags;
 
-	struct entity_num_state_s *ents = snapshot_entstate;
+	struct entity_num_state_s *ents = client->snapshotentities;
 	size_t numents = 0;
-	size_t maxents = snapshot_maxents;
-
-// find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org, qcvm->worldmodel);
+	size_t maxents = client->maxsnapshotentities;
 
-	if (maxentities > (unsigned int)qcvm->num_edicts)
-		maxentities = (unsigned int)qcvm->num_edicts;
+	if (maxentities > (unsigned int)entmirror.numedicts)
+		maxentities = (unsigned int)entmirror.numedicts;
 
 // send over all entities (excpet the client) that touch the pvs
-	ent = NEXT_EDICT(qcvm->edicts);
-	for (e=1 ; e<maxentities ; e++, ent = NEXT_EDICT(ent))
+	for (e=1 ; e<maxentities ; e++)
 	{
 		eflags = 0;
-		if (ent != clent)	// clent is ALLWAYS sent
+		flags = entmirror.flags[e];
+		if (e != clentnum)	// clent is ALLWAYS sent
 		{
 			// ignore ents without visible models
-			if ((!ent->v.modelindex || !PR_GetString(ent->v.model)[0]))
-			{
-invisible:
+			if (!(flags & ENTMIRROR_MODEL))
 				continue;
-			}
 
-			{
-				//attached entities should use the pvs of the parent rather than the child (because the child will typically be bugging out around '0 0 0', so won't be useful)
-				parent = ent;
-				if (parent->num_leafs)
-				{
-					// ignore if not touching a PV leaf
-					for (i=0 ; i < parent->num_leafs ; i++)
-						if (pvs[parent->leafnums[i] >> 3] & (1 << (parent->leafnums[i]&7) ))
-							break;
-
-					// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
-					//
-					// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
-					// for us to say whether it's in the PVS, so don't try to vis cull it.
-					// this commonly happens with rotators, because they often have huge bboxes
-					// spanning the entire map, or really tall lifts, etc.
-					if (i == parent->num_leafs && parent->num_leafs < MAX_ENT_LEAFS)
-						goto invisible;		// not visible
-				}
-			}
+			// ignore if not touching a PV leaf
+
+			// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
+			//
+			// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
+			// for us to say whether it's in the PVS, so don't try to vis cull it.
+			// this commonly happens with rotators, because they often have huge bboxes
+			// spanning the entire map, or really tall lifts, etc.
+			if (!(flags & (ENTMIRROR_NOLEAFS|ENTMIRROR_ALLLEAFS)) && !SV_EntityTouchesClientPVS (client, e, pvs))
+				continue;		// not visible
 		}
 
 		//okay, we care about this entity.
@@ -849,19 +947,22 @@ invisible:
 		}
 		
 		ents[numents].num = e;
-		SV_BuildEntityState(ent, &ents[numents].state);
+		if (flags & ENTMIRROR_STATE)
+			ents[numents].state = entmirror.states[e];
+		else
+			SV_BuildEntityState(EDICT_NUM(e), &ents[numents].state);
 		if ((unsigned int)ents[numents].state.modelindex >= client->limit_models)
 			ents[numents].state.modelindex = 0;
-		if (ent == clent)	//add velocity, but we only care for the local player (should add prediction for other entities some time too).
+		if (e == clentnum)	//add velocity, but we only care for the local player (should add prediction for other entities some time too).
 		{
 			ents[numents].state.pmovetype = 0;//ent->v.movetype;	//fixme: we don't do prediction, so don't tell the client that it can try
-			if ((int)ent->v.flags & FL_ONGROUND)
+			if ((int)clent->v.flags & FL_ONGROUND)
 				eflags |= EFLAGS_ONGROUND;
-			ents[numents].state.velocity[0] = ent->v.velocity[0]*8;
-			ents[numents].state.velocity[1] = ent->v.velocity[1]*8;
-			ents[numents].state.velocity[2] = ent->v.velocity[2]*8;
+			ents[numents].state.velocity[0] = clent->v.velocity[0]*8;
+			ents[numents].state.velocity[1] = clent->v.velocity[1]*8;
+			ents[numents].state.velocity[2] = clent->v.velocity[2]*8;
 		}
-		else if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)	//don't send invisible entities unless they have effects
+		else if (flags & ENTMIRROR_HIDDEN)	//don't send invisible entities unless they have effects
 			continue;
 		//EFLAGS_VIEWMODEL was handled above
 		ents[numents].state.eflags |= eflags;
@@ -869,9 +970,9 @@ invisible:
 		numents++;
 	}
 
-	snapshot_entstate = ents;
-	snapshot_numents = numents;
-	snapshot_maxents = maxents;
+	client->snapshotentities = ents;
+	client->numsnapshotentities = numents;
+	client->maxsnapshotentities = maxents;
 }
 
 void MSG_WriteStaticOrBaseLine(sizebuf_t *buf, int idx, entity_state_t *state, unsigned int protocol_pext2, unsigned int protocol, unsigned int protocolflags)
@@ -935,6 +1036,7 @@ void MSG_WriteStaticOrBaseLine(sizebuf_t *buf, int idx, entity_state_t *state, u
 	}
 }
 static void SV_Pext_f(void);
+static void SV_EntityMirrorBench_f (void);
 
 /*
 ===============
@@ -1035,6 +1137,9 @@ void SV_Init (void)
 	extern	cvar_t	sv_gravity;
 	extern	cvar_t	sv_nostep;
 	extern	cvar_t	sv_freezenonclients;
+	extern	cvar_t	sv_parallelphysics;
+	extern	cvar_t	sv_tracecache;
+	extern	cvar_t	sv_parallelsnapshots;
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_edgefriction;
 	extern	cvar_t	sv_stopspeed;
@@ -1058,11 +1163,22 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_aim);
 	Cvar_RegisterVariable (&sv_nostep);
 	Cvar_RegisterVariable (&sv_freezenonclients);
+	Cvar_RegisterVariable (&sv_parallelphysics);
+	Cvar_RegisterVariable (&sv_tracecache);
+	Cvar_RegisterVariable (&sv_parallelsnapshots);
 	Cvar_RegisterVariable (&pr_checkextension);
 	Cvar_RegisterVariable (&sv_altnoclip); //johnfitz
 
 	Cmd_AddCommand("pext", SV_Pext_f);
 	Cmd_AddCommand ("sv_protocol", &SV_Protocol_f); //johnfitz
+	Cmd_AddCommand ("sv_tracerecord", SV_TraceRecord_f);
+	Cmd_AddCommand ("sv_tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("sv_hullbench", SV_HullBench_f);
+	Cmd_AddCommand ("sv_entmirrorbench", SV_EntityMirrorBench_f);
+	Cmd_AddCommand ("sv_hullnodebench", SV_HullNodeBench_f);
+	Cmd_AddCommand ("sv_physicsstats", SV_PhysicsStats_f);
+	Cmd_AddCommand ("sv_physicsbench", SV_PhysicsBench_f);
+	Cmd_AddCommand ("sv_linkstats", SV_LinkStats_f);
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -1731,6 +1847,400 @@ qboolean SV_VisibleToClient (edict_t *client, edict_t *test, qmodel_t *worldmode
 	return false;
 }
 
+/*
+=============================================================================
+
+CLIENT VISIBILITY
+
+Every client keeps its fat PVS until the set of leafs within 8 units of its
+view changes. Before the client messages are built, SV_BuildEntityVisibility
+tests every entity against the PVS of every client in one pass, a word of the
+PVS at a time.
+
+=============================================================================
+*/
+
+#define	FATPVS_MAXLEAFS		64	// with more leafs around the view the pvs is rebuilt every time
+
+typedef struct
+{
+	int				generation;		// sv_pvsgeneration when the pvs was built
+	int				numleafs;		// leafs the pvs was built from, -1 for too many
+	mleaf_t			*leafs[FATPVS_MAXLEAFS];
+	unsigned int	*pvs;
+	int				pvswords;
+	unsigned int	version;		// bumped every time the pvs is rebuilt
+	unsigned int	bulkversion;	// version entvis was built against
+	qboolean		inbulk;
+} clientpvs_t;
+
+static clientpvs_t	*clientpvs;
+static int			*bulkclients;
+static const unsigned int	**bulkpvs;
+static int			numclientpvs;
+static int			sv_pvsgeneration;
+
+static unsigned int	*entvis;			// bit per client for every edict
+static int			entvis_maxedicts;
+static int			entvis_numedicts;
+static int			entvis_clientwords;
+static qboolean		entvis_valid;
+
+/*
+=============
+SV_FatPVSLeafs
+
+Collects the leafs SV_AddToFatPVS would merge, in the same order. Returns
+-1 if there are more than FATPVS_MAXLEAFS.
+=============
+*/
+static int SV_FatPVSLeafs (vec3_t org, mnode_t *node, mleaf_t **leafs, int numleafs)
+{
+	mplane_t	*plane;
+	float		d;
+
+	while (1)
+	{
+		if (node->contents < 0)
+		{
+			if (node->contents != CONTENTS_SOLID)
+			{
+				if (numleafs == FATPVS_MAXLEAFS)
+					return -1;
+				leafs[numleafs++] = (mleaf_t *)node;
+			}
+			return numleafs;
+		}
+
+		plane = node->plane;
+		d = DotProduct (org, plane->normal) - plane->dist;
+		if (d > 8)
+			node = node->children[0];
+		else if (d < -8)
+			node = node->children[1];
+		else
+		{	// go down both
+			numleafs = SV_FatPVSLeafs (org, node->children[0], leafs, numleafs);
+			if (numleafs < 0)
+				return -1;
+			node = node->children[1];
+		}
+	}
+}
+
+/*
+=============
+SV_ClientFatPVS
+
+SV_FatPVS for the view of a client, rebuilt only when the leafs around the
+view change. The pvs is padded with zeros to a multiple of 32 bits.
+=============
+*/
+static byte *SV_ClientFatPVS (client_t *client)
+{
+	qmodel_t	*worldmodel = qcvm->worldmodel;
+	clientpvs_t	*cache;
+	mleaf_t		*leafs[FATPVS_MAXLEAFS];
+	edict_t		*clent = client->edict;
+	vec3_t		org;
+	byte		*pvs, *row;
+	int			i, j, numleafs, fatbytes, words;
+
+	if (numclientpvs < svs.maxclientslimit)
+	{
+		clientpvs = (clientpvs_t *) realloc (clientpvs, svs.maxclientslimit * sizeof(clientpvs_t));
+		bulkclients = (int *) realloc (bulkclients, svs.maxclientslimit * sizeof(int));
+		bulkpvs = (const unsigned int **) realloc ((void *)bulkpvs, svs.maxclientslimit * sizeof(*bulkpvs));
+		if (!clientpvs || !bulkclients || !bulkpvs)
+			Sys_Error ("SV_ClientFatPVS: realloc() failed on %d clients", svs.maxclientslimit);
+		memset (clientpvs + numclientpvs, 0, (svs.maxclientslimit - numclientpvs) * sizeof(clientpvs_t));
+		numclientpvs = svs.maxclientslimit;
+	}
+	cache = &clientpvs[client - svs.clients];
+
+	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
+	numleafs = SV_FatPVSLeafs (org, worldmodel->nodes, leafs, 0);
+	if (cache->pvs && cache->generation == sv_pvsgeneration && numleafs >= 0 && numleafs == cache->numleafs
+		&& !memcmp (leafs, cache->leafs, numleafs * sizeof(mleaf_t *)))
+		return (byte *)cache->pvs;
+
+	fatbytes = (worldmodel->numleafs+7)>>3;
+	words = (fatbytes + 3) >> 2;
+	if (words > cache->pvswords)
+	{
+		cache->pvswords = words;
+		cache->pvs = (unsigned int *) realloc (cache->pvs, words * sizeof(unsigned int));
+		if (!cache->pvs)
+			Sys_Error ("SV_ClientFatPVS: realloc() failed on %d bytes", words * (int)sizeof(unsigned int));
+	}
+
+	pvs = (byte *)cache->pvs;
+	memset (pvs, 0, words * sizeof(unsigned int));
+	if (numleafs < 0)
+		memcpy (pvs, SV_FatPVS (org, worldmodel), fatbytes);
+	else
+	{
+		for (i = 0; i < numleafs; i++)
+		{
+			row = Mod_LeafPVS (leafs[i], worldmodel);
+			for (j = 0; j < fatbytes; j++)
+				pvs[j] |= row[j];
+		}
+		memcpy (cache->leafs, leafs, numleafs * sizeof(mleaf_t *));
+	}
+
+	cache->generation = sv_pvsgeneration;
+	cache->numleafs = numleafs;
+	cache->version++;
+	return pvs;
+}
+
+/*
+=============
+SV_EntityTouchesPVS
+
+True if any of the mirrored leafs of edict e is set in a pvs from
+SV_ClientFatPVS
+=============
+*/
+static qboolean SV_EntityTouchesPVS (unsigned int e, const byte *pvs)
+{
+	const unsigned int	*words = (const unsigned int *)pvs;
+	const int			*leafwords = entmirror.leafwords + entmirror.firstleafword[e];
+	const unsigned int	*masks = entmirror.leafwordmasks + entmirror.firstleafword[e];
+	int					i;
+
+	for (i = 0; i < entmirror.numleafwords[e]; i++)
+		if (words[leafwords[i]] & masks[i])
+			return true;
+	return false;
+}
+
+/*
+=============
+SV_EntityTouchesClientPVS
+
+SV_EntityTouchesPVS for edict e and the pvs of client, from entvis if the
+client pvs didn't change since it was built. entvis and the leafs come from
+the same entmirror.
+=============
+*/
+static qboolean SV_EntityTouchesClientPVS (client_t *client, unsigned int e, const byte *pvs)
+{
+	const int		c = client - svs.clients;
+	clientpvs_t		*cache = &clientpvs[c];
+
+	if (entvis_valid && cache->inbulk && cache->bulkversion == cache->version && e < (unsigned int)entvis_numedicts)
+		return (entvis[e * entvis_clientwords + (c >> 5)] >> (c & 31)) & 1;
+	return SV_EntityTouchesPVS (e, pvs);
+}
+
+/*
+=============
+SV_BuildEntityVisibility
+
+Tests all edicts in entmirror against the pvs of every client that gets
+entity updates
+=============
+*/
+static void SV_BuildEntityVisibility (void)
+{
+	client_t			*client;
+	const int			*leafwords;
+	const unsigned int	*masks;
+	unsigned int		*bits, word, mask;
+	int					i, j, e, c, numbulk, words;
+
+	entvis_valid = false;
+	numbulk = 0;
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		if (!client->active || !client->spawned || !client->netconnection)
+			continue;
+		SV_ClientFatPVS (client);
+		bulkclients[numbulk++] = i;
+	}
+	for (i = 0; i < numclientpvs; i++)
+		clientpvs[i].inbulk = false;
+	if (numbulk < 2)
+		return;	// testing the leafs of one client as they are sent is just as fast
+
+	words = (svs.maxclients + 31) >> 5;
+	if (entmirror.numedicts > entvis_maxedicts || words != entvis_clientwords)
+	{
+		entvis_maxedicts = q_max (entmirror.numedicts, qcvm->max_edicts);
+		entvis = (unsigned int *) realloc (entvis, entvis_maxedicts * words * sizeof(unsigned int));
+		if (!entvis)
+			Sys_Error ("SV_BuildEntityVisibility: realloc() failed on %d edicts", entvis_maxedicts);
+	}
+	entvis_clientwords = words;
+
+	for (j = 0; j < numbulk; j++)
+	{
+		clientpvs[bulkclients[j]].inbulk = true;
+		clientpvs[bulkclients[j]].bulkversion = clientpvs[bulkclients[j]].version;
+		bulkpvs[j] = clientpvs[bulkclients[j]].pvs;
+	}
+
+	for (e = 0; e < entmirror.numedicts; e++)
+	{
+		bits = &entvis[e * words];
+		memset (bits, 0, words * sizeof(unsigned int));
+		leafwords = entmirror.leafwords + entmirror.firstleafword[e];
+		masks = entmirror.leafwordmasks + entmirror.firstleafword[e];
+		for (i = 0; i < entmirror.numleafwords[e]; i++)
+		{
+			word = leafwords[i];
+			mask = masks[i];
+			for (j = 0; j < numbulk; j++)
+			{
+				if (bulkpvs[j][word] & mask)
+				{
+					c = bulkclients[j];
+					bits[c >> 5] |= 1u << (c & 31);
+				}
+			}
+		}
+	}
+
+	entvis_numedicts = entmirror.numedicts;
+	entvis_valid = true;
+}
+
+/*
+==================
+SV_EntityMirrorBench_f
+
+usage: sv_entmirrorbench [edicts] [clients]
+
+Repeats the live edicts into a scratch map of 4096 edicts, then times a frame
+of snapshot culling and entity state building for every client straight from
+the edicts, against filling entmirror once and reading that per client
+==================
+*/
+static void SV_EntityMirrorBench_f (void)
+{
+	const int	frames = 16;
+	int			count = (Cmd_Argc () > 1) ? atoi (Cmd_Argv (1)) : 4096;
+	const int	numclients = (Cmd_Argc () > 2) ? q_max (1, atoi (Cmd_Argv (2))) : 8;
+	const unsigned int	*words;
+	byte		*scratch, *pvs, flags;
+	edict_t		*ent;
+	eval_t		*val;
+	entity_state_t	*edictstates, *mirrorstates;
+	double		start, edict_time, fill_time, mirror_time;
+	int			f, c, e, i, pvsbytes, numedictstates, nummirrorstates;
+	qboolean	visible, match;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+	count = q_max (count, qcvm->num_edicts);
+	pvsbytes = ((((qcvm->worldmodel->numleafs+7)>>3) + 3) >> 2) * sizeof(unsigned int);
+	scratch = (byte *) malloc ((size_t)count * qcvm->edict_size);
+	edictstates = (entity_state_t *) calloc (count, sizeof(entity_state_t));
+	mirrorstates = (entity_state_t *) calloc (count, sizeof(entity_state_t));
+	pvs = (byte *) malloc (pvsbytes);
+	if (!scratch || !edictstates || !mirrorstates || !pvs)
+	{
+		Con_Printf ("sv_entmirrorbench: out of memory\n");
+		free (scratch); free (edictstates); free (mirrorstates); free (pvs);
+		PR_SwitchQCVM (NULL);
+		return;
+	}
+
+	// edicts past the live ones repeat edicts 1 and up
+	for (e = 0; e < count; e++)
+		memcpy (scratch + (size_t)e * qcvm->edict_size,
+			EDICT_NUM((e < qcvm->num_edicts) ? e : 1 + (e - 1) % (qcvm->num_edicts - 1)), qcvm->edict_size);
+
+	// cull against the view of the first client, or nothing without one
+	if (svs.clients[0].active && svs.clients[0].spawned)
+		memcpy (pvs, SV_ClientFatPVS (&svs.clients[0]), pvsbytes);
+	else
+		memset (pvs, 0xff, pvsbytes);
+	words = (const unsigned int *)pvs;
+
+	numedictstates = 0;
+	start = Sys_DoubleTime ();
+	for (f = 0; f < frames; f++)
+	{
+		for (c = 0; c < numclients; c++)
+		{
+			numedictstates = 0;
+			ent = NEXT_EDICT((edict_t *)scratch);
+			for (e = 1; e < count; e++, ent = NEXT_EDICT(ent))
+			{
+				if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+					continue;
+				if (ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
+				{
+					for (i = 0, visible = false; i < (int)ent->num_leafwords && !visible; i++)
+						visible = (words[ent->leafwords[i]] & ent->leafwordmasks[i]) != 0;
+					if (!visible)
+						continue;
+				}
+				if ((val = GetEdictFieldValue(ent, qcvm->extfields.alpha)))
+					ent->alpha = ENTALPHA_ENCODE(val->_float);
+				SV_BuildEntityState (ent, &edictstates[numedictstates]);
+				if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+					continue;
+				numedictstates++;
+			}
+		}
+	}
+	edict_time = Sys_DoubleTime () - start;
+
+	nummirrorstates = 0;
+	fill_time = mirror_time = 0;
+	for (f = 0; f < frames; f++)
+	{
+		start = Sys_DoubleTime ();
+		SV_FillEntityMirror ((edict_t *)scratch, count, true);
+		fill_time += Sys_DoubleTime () - start;
+
+		start = Sys_DoubleTime ();
+		for (c = 0; c < numclients; c++)
+		{
+			nummirrorstates = 0;
+			for (e = 1; e < count; e++)
+			{
+				flags = entmirror.flags[e];
+				if (!(flags & ENTMIRROR_MODEL))
+					continue;
+				if (!(flags & (ENTMIRROR_NOLEAFS|ENTMIRROR_ALLLEAFS)) && !SV_EntityTouchesPVS (e, pvs))
+					continue;
+				if (flags & ENTMIRROR_HIDDEN)
+					continue;
+				mirrorstates[nummirrorstates++] = entmirror.states[e];
+			}
+		}
+		mirror_time += Sys_DoubleTime () - start;
+	}
+
+	match = (numedictstates == nummirrorstates) && !memcmp (edictstates, mirrorstates, numedictstates * sizeof(entity_state_t));
+
+	Con_Printf ("%d edicts, %d clients, %d visible, times in ms per frame\n", count, numclients, numedictstates);
+	Con_Printf ("edicts: %7.3f\n", edict_time * 1000.0 / frames);
+	Con_Printf ("mirror: %7.3f (fill %.3f, clients %.3f)\n", (fill_time + mirror_time) * 1000.0 / frames,
+		fill_time * 1000.0 / frames, mirror_time * 1000.0 / frames);
+	Con_Printf ("states %s\n", match ? "match" : "DIFFER");
+
+	free (scratch);
+	free (edictstates);
+	free (mirrorstates);
+	free (pvs);
+
+	// put the live edicts back for the next frame's entvis
+	SV_FillEntityMirror (qcvm->edicts, qcvm->num_edicts, false);
+	entvis_valid = false;
+	PR_SwitchQCVM (NULL);
+}
+
 //=============================================================================
 
 /*
@@ -1742,13 +2252,12 @@ SV_WriteEntitiesToClient
 void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 {
 	edict_t	*clent = client->edict;
-	unsigned int		e, i, maxedict=qcvm->num_edicts;
+	unsigned int		e, i, maxedict=entmirror.numedicts;
 	int		bits;
 	byte	*pvs;
-	vec3_t	org;
+	byte	flags;
 	float	miss;
 	edict_t	*ent;
-	eval_t	*val;
 	int maxsize = msg->maxsize;
 
 	//try to avoid sounds getting lost. flickering entities are weird, but missing sounds+particles are just eerie.
@@ -1759,18 +2268,17 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 		maxedict = client->limit_entities;
 
 // find the client's PVS
-	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-	pvs = SV_FatPVS (org, qcvm->worldmodel);
+	pvs = SV_ClientFatPVS (client);
 
 // send over all entities (excpet the client) that touch the pvs
 	ent = NEXT_EDICT(qcvm->edicts);
 	for (e=1 ; e<maxedict ; e++, ent = NEXT_EDICT(ent))
 	{
-
+		flags = entmirror.flags[e];
 		if (ent != clent)	// clent is ALLWAYS sent
 		{
 			// ignore ents without visible models
-			if (!ent->v.modelindex || !PR_GetString(ent->v.model)[0])
+			if (!(flags & ENTMIRROR_MODEL))
 				continue;
 
 			//johnfitz -- don't send model>255 entities if protocol is 15
@@ -1778,17 +2286,14 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 				continue;
 
 			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->num_leafs ; i++)
-				if (pvs[ent->leafnums[i] >> 3] & (1 << (ent->leafnums[i]&7) ))
-					break;
-			
+
 			// ericw -- added ent->num_leafs < MAX_ENT_LEAFS condition.
 			//
 			// if ent->num_leafs == MAX_ENT_LEAFS, the ent is visible from too many leafs
 			// for us to say whether it's in the PVS, so don't try to vis cull it.
 			// this commonly happens with rotators, because they often have huge bboxes
 			// spanning the entire map, or really tall lifts, etc.
-			if (i == ent->num_leafs && ent->num_leafs < MAX_ENT_LEAFS)
+			if (!(flags & ENTMIRROR_ALLLEAFS) && !SV_EntityTouchesClientPVS (client, e, pvs))
 				continue;		// not visible
 		}
 
@@ -1843,14 +2348,9 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 		if (ent->baseline.modelindex != ent->v.modelindex)
 			bits |= U_MODEL;
 
-		//johnfitz -- alpha
-		// TODO: find a cleaner place to put this code
-		val = GetEdictFieldValue(ent, qcvm->extfields.alpha);
-		if (val)
-			ent->alpha = ENTALPHA_ENCODE(val->_float);
-
+		//johnfitz -- alpha, SV_FillEntityMirror updated ent->alpha
 		//don't send invisible entities unless they have effects
-		if (ent->alpha == ENTALPHA_ZERO && !ent->v.effects)
+		if (flags & ENTMIRROR_HIDDEN)
 			continue;
 		//johnfitz
 
@@ -2155,6 +2655,116 @@ void SV_WriteClientdataToMessage (client_t *client, sizebuf_t *msg)
 }
 
 
+/*
+=============================================================================
+
+PARALLEL CLIENT DATAGRAMS
+
+Once physics has run the snapshot of a delta protocol client only reads edict
+state. SV_PrepareClientDatagrams writes the damage and stats of every such
+client on the main thread, then builds the snapshots, entity deltas and first
+entity updates on the workers, each into a datagram buffer of its own client.
+SV_SendClientDatagram sends the prepared buffers, the sends stay serial.
+
+=============================================================================
+*/
+
+#define	CLIENT_DATAGRAM_SIZE	(MAX_DATAGRAM+1000)
+
+cvar_t	sv_parallelsnapshots = {"sv_parallelsnapshots", "1", CVAR_NONE};
+
+typedef struct
+{
+	qboolean	prepared;
+	const byte	*pvs;
+	sizebuf_t	msg;
+} clientdatagram_t;
+
+static clientdatagram_t	*clientdatagrams;
+static byte				*clientdatagram_data;
+static int				*datagramjobs;
+static int				numclientdatagrams;
+
+/*
+=============
+SV_PrepareClientDatagramTask
+=============
+*/
+static void SV_PrepareClientDatagramTask (int index, void *data)
+{
+	const int			c = ((int *)data)[index];
+	client_t			*client = &svs.clients[c];
+	clientdatagram_t	*dgram = &clientdatagrams[c];
+
+	SVFTE_BuildSnapshotForClient (client, dgram->pvs);
+	SVFTE_CalcEntityDeltas (client);
+	client->snapshotresume = 0;
+	SVFTE_WriteEntitiesToClient (client, &dgram->msg, CLIENT_DATAGRAM_SIZE);	//must always write some data, or the stats will break
+}
+
+/*
+=============
+SV_PrepareClientDatagrams
+
+Does the work of SV_PresendClientDatagram and the first packet of
+SV_SendClientDatagram for all spawned delta protocol clients at once
+=============
+*/
+static void SV_PrepareClientDatagrams (void)
+{
+	client_t			*client;
+	clientdatagram_t	*dgram;
+	int					i, numjobs;
+
+	if (numclientdatagrams < svs.maxclientslimit)
+	{
+		clientdatagrams = (clientdatagram_t *) realloc (clientdatagrams, svs.maxclientslimit * sizeof(clientdatagram_t));
+		clientdatagram_data = (byte *) realloc (clientdatagram_data, (size_t)svs.maxclientslimit * CLIENT_DATAGRAM_SIZE);
+		datagramjobs = (int *) realloc (datagramjobs, svs.maxclientslimit * sizeof(int));
+		if (!clientdatagrams || !clientdatagram_data || !datagramjobs)
+			Sys_Error ("SV_PrepareClientDatagrams: realloc() failed on %d clients", svs.maxclientslimit);
+		numclientdatagrams = svs.maxclientslimit;
+	}
+
+	numjobs = 0;
+	for (i = 0, client = svs.clients; i < svs.maxclients; i++, client++)
+	{
+		clientdatagrams[i].prepared = false;
+		if (!client->active || !client->netconnection || !client->spawned)
+			continue;
+		if (!(client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS))
+			continue;
+		datagramjobs[numjobs++] = i;
+	}
+	if (!sv_parallelsnapshots.value || numjobs < 2 || !Tasks_NumWorkers ())
+		return;
+
+// damage and stats write to the edicts and the string stats
+	for (i = 0; i < numjobs; i++)
+	{
+		client = &svs.clients[datagramjobs[i]];
+		dgram = &clientdatagrams[datagramjobs[i]];
+
+		dgram->pvs = SV_ClientFatPVS (client);
+		dgram->msg.allowoverflow = false;
+		dgram->msg.overflowed = false;
+		dgram->msg.data = clientdatagram_data + (size_t)datagramjobs[i] * CLIENT_DATAGRAM_SIZE;
+		dgram->msg.maxsize = q_min (CLIENT_DATAGRAM_SIZE, client->limit_unreliable);
+		dgram->msg.cursize = 0;
+
+		host_client = client;
+		sv_player = client->edict;
+		SV_WriteDamageToMessage (client->edict, &dgram->msg);
+		if (!(client->protocol_pext2 & PEXT2_PREDINFO))
+			SV_WriteClientdataToMessage (client, &dgram->msg);
+		else
+			SVFTE_WriteStats (client, &dgram->msg);
+		dgram->prepared = true;
+	}
+
+	Task_ParallelFor (numjobs, SV_PrepareClientDatagramTask, datagramjobs);
+}
+
 void SV_PresendClientDatagram (client_t *client)
 {
 	if (!client->netconnection)
@@ -2163,7 +2773,7 @@ void SV_PresendClientDatagram (client_t *client)
 		return;	//not ready yet.
 	if (!(client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS))
 		return; //brute force networking.
-	SVFTE_BuildSnapshotForClient(client);
+	SVFTE_BuildSnapshotForClient(client, SV_ClientFatPVS(client));
 	SVFTE_CalcEntityDeltas(client);
 	client->snapshotresume = 0;
 }
@@ -2175,7 +2785,7 @@ SV_SendClientDatagram
 */
 qboolean SV_SendClientDatagram (client_t *client)
 {
-	byte		buf[MAX_DATAGRAM+1000];
+	byte		buf[CLIENT_DATAGRAM_SIZE];
 	sizebuf_t	msg;
 
 	if (!client->netconnection)
@@ -2197,12 +2807,21 @@ qboolean SV_SendClientDatagram (client_t *client)
 
 		if (client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS)
 		{
-			SV_WriteDamageToMessage(client->edict, &msg);
-			if (!(client->protocol_pext2 & PEXT2_PREDINFO))
-				SV_WriteClientdataToMessage (client, &msg);
+			if (clientdatagrams && clientdatagrams[client - svs.clients].prepared)
+			{	//damage, stats and the first entity update were written by SV_PrepareClientDatagrams
+				clientdatagrams[client - svs.clients].prepared = false;
+				msg = clientdatagrams[client - svs.clients].msg;
+			}
 			else
-				SVFTE_WriteStats(client, &msg);
-			SVFTE_WriteEntitiesToClient(client, &msg, sizeof(buf));	//must always write some data, or the stats will break
+			{
+				SV_WriteDamageToMessage(client->edict, &msg);
+				if (!(client->protocol_pext2 & PEXT2_PREDINFO))
+					SV_WriteClientdataToMessage (client, &msg);
+				else
+					SVFTE_WriteStats(client, &msg);
+				SVFTE_WriteEntitiesToClient(client, &msg, sizeof(buf));	//must always write some data, or the stats will break
+			}
+			SVFTE_NotePacketSize(&msg);
 
 			//this delta protocol doesn't wipe old state just because there's a new packet.
 			//the server isn't required to sync with the client frames either
@@ -2212,6 +2831,7 @@ qboolean SV_SendClientDatagram (client_t *client)
 				NET_SendUnreliableMessage (client->netconnection, &msg);
 				SZ_Clear(&msg);
 				SVFTE_WriteEntitiesToClient(client, &msg, sizeof(buf));
+				SVFTE_NotePacketSize(&msg);
 			}
 		}
 		else
@@ -2443,13 +3063,27 @@ SV_SendClientMessages
 void SV_SendClientMessages (void)
 {
 	int			i;
+	qboolean	deltaclients;
 
 // update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+// copy what the entity loops read out of the edicts, states only for the delta protocol
+	deltaclients = false;
+	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
+		if (host_client->active && host_client->spawned && host_client->netconnection && (host_client->protocol_pext2 & PEXT2_REPLACEMENTDELTAS))
+			deltaclients = true;
+	SV_FillEntityMirror (qcvm->edicts, qcvm->num_edicts, deltaclients);
+
+// test every entity against every client's pvs at once
+	SV_BuildEntityVisibility ();
+
+// build the snapshots and entity updates of delta protocol clients on the workers
+	SV_PrepareClientDatagrams ();
+
 	for (i=0, host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 	{
-		if (!host_client->active)
+		if (!host_client->active || clientdatagrams[i].prepared)
 			continue;
 
 		SV_PresendClientDatagram (host_client);	//generates client snapshots (and updates csqc pending flags)
@@ -2574,6 +3208,8 @@ void SV_SendClientMessages (void)
 	}
 
 
+	entvis_valid = false;	// edicts move before the next send
+
 // clear muzzle flashes
 	SV_CleanupEnts ();
 }
@@ -2846,6 +3482,7 @@ void SV_SpawnServer (const char *server)
 // clear world interaction links
 //
 	SV_ClearWorld ();
+	sv_pvsgeneration++;	// the leafs cached with the client pvs belong to the old map
 
 	sv.sound_precache[0] = dummy;
 	sv.model_precache[0] = dummy;
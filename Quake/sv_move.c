@@ -39,8 +39,10 @@ int c_yes, c_no;
 qboolean SV_CheckBottom (edict_t *ent)
 {
 	vec3_t	mins, maxs, start, stop;
-	trace_t	trace;
-	int		x, y;
+	vec3_t	corners[4], stops[4];
+	int		contents[4];
+	trace_t	trace, traces[4];
+	int		x, y, i;
 	float	mid, bottom;
 
 	VectorAdd (ent->v.origin, ent->v.mins, mins);
@@ -49,16 +51,20 @@ qboolean SV_CheckBottom (edict_t *ent)
 // if all of the points under the corners are solid world, don't bother
 // with the tougher checks
 // the corners must be within 16 of the midpoint
-	start[2] = mins[2] - 1;
-	for	(x=0 ; x<=1 ; x++)
-		for	(y=0 ; y<=1 ; y++)
+	for	(x=0, i=0 ; x<=1 ; x++)
+		for	(y=0 ; y<=1 ; y++, i++)
 		{
-			start[0] = x ? maxs[0] : mins[0];
-			start[1] = y ? maxs[1] : mins[1];
-			if (SV_PointContents (start) != CONTENTS_SOLID)
-				goto realcheck;
+			corners[i][0] = x ? maxs[0] : mins[0];
+			corners[i][1] = y ? maxs[1] : mins[1];
+			corners[i][2] = mins[2] - 1;
 		}
 
+	// the current contents don't matter here, so the true contents will do
+	SV_HullPointContentsBatch (&qcvm->worldmodel->hulls[0], 0, 4, corners, contents);
+	for (i=0 ; i<4 ; i++)
+		if (contents[i] != CONTENTS_SOLID)
+			goto realcheck;
+
 	c_yes++;
 	return true;		// we got out easy
 
@@ -80,19 +86,21 @@ realcheck:
 	mid = bottom = trace.endpos[2];
 
 // the corners must be within 16 of the midpoint
-	for	(x=0 ; x<=1 ; x++)
-		for	(y=0 ; y<=1 ; y++)
-		{
-			start[0] = stop[0] = x ? maxs[0] : mins[0];
-			start[1] = stop[1] = y ? maxs[1] : mins[1];
-
-			trace = SV_Move (start, vec3_origin, vec3_origin, stop, true, ent);
+	for (i=0 ; i<4 ; i++)
+	{
+		corners[i][2] = start[2];
+		VectorCopy (corners[i], stops[i]);
+		stops[i][2] = stop[2];
+	}
+	SV_MoveBatch (4, corners, vec3_origin, vec3_origin, stops, true, ent, traces);
 
-			if (trace.fraction != 1.0 && trace.endpos[2] > bottom)
-				bottom = trace.endpos[2];
-			if (trace.fraction == 1.0 || mid - trace.endpos[2] > STEPSIZE)
-				return false;
-		}
+	for (i=0 ; i<4 ; i++)
+	{
+		if (traces[i].fraction != 1.0 && traces[i].endpos[2] > bottom)
+			bottom = traces[i].endpos[2];
+		if (traces[i].fraction == 1.0 || mid - traces[i].endpos[2] > STEPSIZE)
+			return false;
+	}
 
 	c_yes++;
 	return true;
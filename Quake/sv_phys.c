@@ -47,6 +47,7 @@ cvar_t	sv_gravity = {"sv_gravity","800",CVAR_NOTIFY|CVAR_SERVERINFO};
 cvar_t	sv_maxvelocity = {"sv_maxvelocity","2000",CVAR_NONE};
 cvar_t	sv_nostep = {"sv_nostep","0",CVAR_NONE};
 cvar_t	sv_freezenonclients = {"sv_freezenonclients","0",CVAR_NONE};
+cvar_t	sv_parallelphysics = {"sv_parallelphysics","0",CVAR_NONE};	// 2 = verify against serial traces
 
 
 #define	MOVE_EPSILON	0.01
@@ -102,6 +103,7 @@ void SV_CheckVelocity (edict_t *ent)
 		{
 			Con_Printf ("Got a NaN origin on %s\n", PR_GetString(ent->v.classname));
 			ent->v.origin[i] = 0;
+			SV_MarkAreaDirty (ent);
 		}
 		if (ent->v.velocity[i] > sv_maxvelocity.value)
 			ent->v.velocity[i] = sv_maxvelocity.value;
@@ -283,6 +285,7 @@ int SV_FlyMove (edict_t *ent, float time, trace_t *steptrace)
 		if (trace.fraction > 0)
 		{	// actually covered some distance
 			VectorCopy (trace.endpos, ent->v.origin);
+			SV_MarkAreaDirty (ent);		// SV_Impact runs QC before the caller relinks
 			VectorCopy (ent->v.velocity, original_velocity);
 			numplanes = 0;
 		}
@@ -560,6 +563,7 @@ void SV_PushMove (edict_t *pusher, float movetime)
 			{	// corpse
 				check->v.mins[0] = check->v.mins[1] = 0;
 				VectorCopy (check->v.mins, check->v.maxs);
+				SV_MarkAreaDirty (check);
 				continue;
 			}
 
@@ -667,6 +671,7 @@ void SV_CheckStuck (edict_t *ent)
 
 	VectorCopy (ent->v.origin, org);
 	VectorCopy (ent->v.oldorigin, ent->v.origin);
+	SV_MarkAreaDirty (ent);
 	if (!SV_TestEntityPosition(ent))
 	{
 		Con_DPrintf ("Unstuck.\n");
@@ -813,6 +818,7 @@ int SV_TryUnstick (edict_t *ent, vec3_t oldvel)
 
 // go back to the original pos and try again
 		VectorCopy (oldorg, ent->v.origin);
+		SV_MarkAreaDirty (ent);
 	}
 
 	VectorCopy (vec3_origin, ent->v.velocity);
@@ -917,6 +923,7 @@ void SV_WalkMove (edict_t *ent)
 // cause the player to hop up higher on a slope too steep to climb
 		VectorCopy (nosteporg, ent->v.origin);
 		VectorCopy (nostepvel, ent->v.velocity);
+		SV_MarkAreaDirty (ent);
 	}
 }
 
@@ -1191,6 +1198,244 @@ void SV_Physics_Step (edict_t *ent)
 
 //============================================================================
 
+/*
+===============================================================================
+
+SPECULATIVE MOVES
+
+===============================================================================
+*/
+
+static int		sv_gravityofs;
+static edict_t	**speculative_ents;
+static int		max_speculative_ents;
+static double	physics_time;
+static int		physics_frames;
+
+/*
+=============
+SV_PredictVelocity
+
+SV_CheckVelocity on a copy. Edicts it would print about aren't predicted.
+=============
+*/
+static qboolean SV_PredictVelocity (edict_t *ent, vec3_t velocity)
+{
+	int		i;
+
+	for (i=0 ; i<3 ; i++)
+	{
+		if (IS_NAN(velocity[i]) || IS_NAN(ent->v.origin[i]))
+			return false;
+		if (velocity[i] > sv_maxvelocity.value)
+			velocity[i] = sv_maxvelocity.value;
+		else if (velocity[i] < -sv_maxvelocity.value)
+			velocity[i] = -sv_maxvelocity.value;
+	}
+	return true;
+}
+
+/*
+=============
+SV_PredictGravity
+
+SV_AddGravity on a copy
+=============
+*/
+static void SV_PredictGravity (edict_t *ent, vec3_t velocity)
+{
+	float	ent_gravity;
+	eval_t	*val;
+
+	val = GetEdictFieldValue(ent, sv_gravityofs);
+	if (val && val->_float)
+		ent_gravity = val->_float;
+	else
+		ent_gravity = 1.0;
+
+	velocity[2] -= ent_gravity * sv_gravity.value * host_frametime;
+}
+
+/*
+=============
+SV_PredictMove
+
+Computes the first SV_Move of SV_Physics_Step or SV_Physics_Toss the way they
+will, without changing the edict. Runs on worker threads.
+=============
+*/
+static qboolean SV_PredictMove (edict_t *ent, vec3_t end, int *type)
+{
+	vec3_t	velocity, move;
+	float	time_left;
+	int		i;
+
+	VectorCopy (ent->v.velocity, velocity);
+
+	if (ent->v.movetype == MOVETYPE_STEP)
+	{
+		// gravity first, then the first SV_FlyMove trace
+		SV_PredictGravity (ent, velocity);
+		if (!SV_PredictVelocity (ent, velocity))
+			return false;
+		if (!velocity[0] && !velocity[1] && !velocity[2])
+			return false;
+
+		time_left = host_frametime;
+		for (i=0 ; i<3 ; i++)
+			end[i] = ent->v.origin[i] + time_left * velocity[i];
+		*type = MOVE_NORMAL;
+		return true;
+	}
+
+	// velocity check, gravity, then SV_PushEntity
+	if (!SV_PredictVelocity (ent, velocity))
+		return false;
+	if (ent->v.movetype != MOVETYPE_FLY
+	&& ent->v.movetype != MOVETYPE_FLYMISSILE)
+		SV_PredictGravity (ent, velocity);
+
+	VectorScale (velocity, host_frametime, move);
+	VectorAdd (ent->v.origin, move, end);
+
+	if (ent->v.movetype == MOVETYPE_FLYMISSILE)
+		*type = MOVE_MISSILE;
+	else if (ent->v.solid == SOLID_TRIGGER || ent->v.solid == SOLID_NOT)
+		*type = MOVE_NOMONSTERS;
+	else
+		*type = MOVE_NORMAL;
+	return true;
+}
+
+/*
+=============
+SV_GatherSpeculativeMoves
+
+Collects every falling or flying edict whose first move can be traced before
+the serial entity loop. Clients and pushers always run serially, and edicts
+whose think function runs before their move this frame are left out.
+=============
+*/
+static int SV_GatherSpeculativeMoves (int entity_cap)
+{
+	edict_t	*ent;
+	float	thinktime;
+	int		i, count;
+
+	if (max_speculative_ents < qcvm->max_edicts)
+	{
+		max_speculative_ents = qcvm->max_edicts;
+		speculative_ents = (edict_t **) realloc (speculative_ents, max_speculative_ents * sizeof(edict_t *));
+		if (!speculative_ents)
+			Sys_Error ("SV_GatherSpeculativeMoves: out of memory");
+	}
+
+	count = 0;
+	for (i = svs.maxclients + 1; i < entity_cap; i++)
+	{
+		ent = EDICT_NUM(i);
+		if (ent->free)
+			continue;
+
+		if (ent->v.movetype == MOVETYPE_STEP)
+		{
+			if ((int)ent->v.flags & (FL_ONGROUND | FL_FLY | FL_SWIM))
+				continue;
+		}
+		else if (ent->v.movetype == MOVETYPE_TOSS
+		|| ent->v.movetype == MOVETYPE_GIB
+		|| ent->v.movetype == MOVETYPE_BOUNCE
+		|| ent->v.movetype == MOVETYPE_FLY
+		|| ent->v.movetype == MOVETYPE_FLYMISSILE)
+		{
+			thinktime = ent->v.nextthink;
+			if (!(thinktime <= 0 || thinktime > qcvm->time + host_frametime))
+				continue;
+			if ((int)ent->v.flags & FL_ONGROUND)
+				continue;
+		}
+		else
+			continue;
+
+		speculative_ents[count++] = ent;
+	}
+
+	sv_gravityofs = ED_FindFieldOffset ("gravity");
+	return count;
+}
+
+/*
+=============
+SV_SpeculateMoves
+
+Traces the first move of the gathered edicts in parallel before the serial
+entity loop. QC only ever runs on the main thread, in the original order.
+=============
+*/
+static void SV_SpeculateMoves (int entity_cap)
+{
+	const int count = SV_GatherSpeculativeMoves (entity_cap);
+	SV_BeginSpeculativeMoves (speculative_ents, count, SV_PredictMove, sv_parallelphysics.value >= 2);
+}
+
+/*
+=============
+SV_PhysicsBench_f
+
+usage: sv_physicsbench [iterations]
+
+Times the moves the current frame would speculate, traced one after the
+other and spread over the workers
+=============
+*/
+void SV_PhysicsBench_f (void)
+{
+	const int	iterations = (Cmd_Argc () > 1) ? q_max (1, atoi (Cmd_Argv (1))) : 100;
+	double		serial_time, parallel_time;
+	int			count;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+	count = SV_GatherSpeculativeMoves (sv_freezenonclients.value ? svs.maxclients + 1 : qcvm->num_edicts);
+	if (!SV_BenchSpeculativeMoves (speculative_ents, count, SV_PredictMove, iterations, &serial_time, &parallel_time))
+	{
+		PR_SwitchQCVM (NULL);
+		Con_Printf ("Speculative moves need pr_checkextension\n");
+		return;
+	}
+	PR_SwitchQCVM (NULL);
+
+	Con_Printf ("%d moves, %d iterations, %d workers\n", count, iterations, Tasks_NumWorkers ());
+	Con_Printf ("serial   %8.3f ms per frame\n", serial_time * 1000.0 / iterations);
+	Con_Printf ("parallel %8.3f ms per frame", parallel_time * 1000.0 / iterations);
+	if (parallel_time > 0)
+		Con_Printf (", %.2fx", serial_time / parallel_time);
+	Con_Printf ("\n");
+}
+
+/*
+=============
+SV_PhysicsStats_f
+
+Average time of the server entity loop since the last call, then the
+speculative move counters
+=============
+*/
+void SV_PhysicsStats_f (void)
+{
+	if (physics_frames)
+		Con_Printf ("%d frames, %.3f ms entity physics per frame (sv_parallelphysics %g)\n",
+			physics_frames, physics_time * 1000.0 / physics_frames, sv_parallelphysics.value);
+	physics_frames = 0;
+	physics_time = 0;
+	SV_SpeculativeMoveStats_f ();
+}
+
 /*
 ================
 SV_Physics
@@ -1202,6 +1447,7 @@ void SV_Physics (void)
 	int	i;
 	int	entity_cap; // For sv_freezenonclients 
 	edict_t	*ent;
+	double	start_time = 0;
 
 	int physics_mode;
 	if (qcvm->extglobals.physics_mode)
@@ -1226,6 +1472,12 @@ void SV_Physics (void)
 		return;
 	}
 
+	if (qcvm == &sv.qcvm)
+	{
+		SV_FlushTraceCache (true);
+		SV_LinkCountersFrame ();
+	}
+
 // let the progs know that a new frame has started
 	if (pr_global_struct->StartFrame)
 	{
@@ -1247,6 +1499,12 @@ void SV_Physics (void)
 	else
 		entity_cap = qcvm->num_edicts; 
 
+	if (qcvm == &sv.qcvm)
+		start_time = Sys_DoubleTime ();
+
+	if (sv_parallelphysics.value && qcvm == &sv.qcvm && !pr_global_struct->force_retouch)
+		SV_SpeculateMoves (entity_cap);
+
 	//for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
 	for (i=0 ; i<entity_cap ; i++, ent = NEXT_EDICT(ent))
 	{
@@ -1278,6 +1536,14 @@ void SV_Physics (void)
 			Host_EndGame ("SV_Physics: bad movetype %i", (int)ent->v.movetype);
 	}
 
+	SV_EndSpeculativeMoves ();
+
+	if (qcvm == &sv.qcvm)
+	{
+		physics_time += Sys_DoubleTime () - start_time;
+		physics_frames++;
+	}
+
 	if (pr_global_struct->force_retouch)
 		pr_global_struct->force_retouch--;
 
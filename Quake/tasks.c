@@ -0,0 +1,153 @@
+/*
+Copyright (C) 2016 Axel Gneiting
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// tasks.c -- worker threads for data parallel loops
+
+#include "quakedef.h"
+
+#if defined(SDL_FRAMEWORK) || defined(NO_SDL_CONFIG)
+#include <SDL2/SDL.h>
+#else
+#include "SDL.h"
+#endif
+
+cvar_t	host_parallel = {"host_parallel", "1", CVAR_ARCHIVE};
+
+static int			num_workers;
+static SDL_Thread	*workers[MAX_WORKER_THREADS];
+static SDL_sem		*work_start;
+static SDL_sem		*work_done;
+
+static taskfunc_t	task_func;
+static void			*task_data;
+static int			task_count;
+static SDL_atomic_t	task_next_index;
+
+/*
+===============
+Task_Run
+
+Grabs indices until there are none left
+===============
+*/
+static void Task_Run (void)
+{
+	int index;
+
+	while ((index = SDL_AtomicAdd (&task_next_index, 1)) < task_count)
+		task_func (index, task_data);
+}
+
+/*
+===============
+Task_WorkerThread
+===============
+*/
+static int Task_WorkerThread (void *unused)
+{
+	for (;;)
+	{
+		SDL_SemWait (work_start);
+		Task_Run ();
+		SDL_SemPost (work_done);
+	}
+	return 0;
+}
+
+/*
+===============
+Tasks_Init
+===============
+*/
+void Tasks_Init (void)
+{
+	char	name[16];
+	int		i;
+
+	Cvar_RegisterVariable (&host_parallel);
+
+	i = COM_CheckParm ("-threads");
+	if (i && i < com_argc - 1)
+		num_workers = Q_atoi (com_argv[i + 1]) - 1;
+	else
+		num_workers = SDL_GetCPUCount () - 1;
+	num_workers = CLAMP (0, num_workers, MAX_WORKER_THREADS);
+
+	if (num_workers > 0)
+	{
+		work_start = SDL_CreateSemaphore (0);
+		work_done = SDL_CreateSemaphore (0);
+		if (!work_start || !work_done)
+			Sys_Error ("Tasks_Init: couldn't create semaphores: %s", SDL_GetError ());
+	}
+
+	for (i = 0; i < num_workers; ++i)
+	{
+		q_snprintf (name, sizeof(name), "worker %d", i);
+		workers[i] = SDL_CreateThread (Task_WorkerThread, name, NULL);
+		if (!workers[i])
+		{
+			Con_Printf ("Tasks_Init: couldn't create thread: %s\n", SDL_GetError ());
+			break;
+		}
+	}
+	num_workers = i;
+
+	Con_Printf ("Using %d worker threads\n", num_workers);
+}
+
+/*
+===============
+Tasks_NumWorkers
+
+Number of threads a parallel loop runs on, including the calling thread
+===============
+*/
+int Tasks_NumWorkers (void)
+{
+	return host_parallel.value ? num_workers + 1 : 1;
+}
+
+/*
+===============
+Task_ParallelFor
+===============
+*/
+void Task_ParallelFor (int count, taskfunc_t func, void *data)
+{
+	int i, num_wakeups;
+
+	if (count <= 0)
+		return;
+
+	task_func = func;
+	task_data = data;
+	task_count = count;
+	SDL_AtomicSet (&task_next_index, 0);
+
+	// Don't wake up more threads than there is work for
+	num_wakeups = q_min (Tasks_NumWorkers () - 1, count - 1);
+	for (i = 0; i < num_wakeups; ++i)
+		SDL_SemPost (work_start);
+
+	Task_Run ();
+
+	for (i = 0; i < num_wakeups; ++i)
+		SDL_SemWait (work_done);
+}
@@ -0,0 +1,43 @@
+/*
+Copyright (C) 2016 Axel Gneiting
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+
+#ifndef __TASKS_H
+#define __TASKS_H
+
+/*
+ worker threads
+
+Task_ParallelFor hands out the indices [0, count) to the worker threads and
+the calling thread and returns once every index has been processed. Tasks
+must only touch memory owned by their index: no Con_Printf, no hunk or zone
+allocations, no Vulkan calls.
+
+Only the main thread may call Task_ParallelFor, calls do not nest.
+*/
+
+#define MAX_WORKER_THREADS	16
+
+typedef void (*taskfunc_t) (int index, void *data);
+
+void Tasks_Init (void);
+int Tasks_NumWorkers (void);
+void Task_ParallelFor (int count, taskfunc_t func, void *data);
+
+#endif	/* __TASKS_H */
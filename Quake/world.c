@@ -33,6 +33,19 @@ line of sight checks trace->crosscontent, but bullets don't
 */
 
 
+#define	TRACECACHE_CANDIDATES	8	// most edicts a cached trace may depend on
+
+// Scratch hull for clipping against bounding boxes. Every trace owns one, so
+// traces can run on several threads at once.
+typedef struct
+{
+	hull_t		hull;
+	mplane_t	planes[6];
+	mhullnode_t	nodes[6];
+	qboolean	quiet;			// running on a worker thread, fail instead of printing
+	qboolean	failed;			// a quiet trace hit a case that prints, redo it serially
+} boxhull_t;
+
 typedef struct
 {
 	vec3_t		boxmins, boxmaxs;// enclose the test object along entire move
@@ -43,6 +56,10 @@ typedef struct
 	int			type;
 	unsigned int	hitcontents;	//content types to impact upon... (1<<-CONTENTS_FOO) bitmask
 	edict_t		*passedict;
+	boxhull_t	box;
+	qboolean	track;			// record the edicts the trace cache result depends on
+	int			numcandidates;
+	edict_t		*candidates[TRACECACHE_CANDIDATES];
 } moveclip_t;
 
 
@@ -57,9 +74,8 @@ HULL BOXES
 */
 
 
-static	hull_t		box_hull;
+static	boxhull_t	box_hull;
 static	mclipnode_t	box_clipnodes[6]; //johnfitz -- was dclipnode_t
-static	mplane_t	box_planes[6];
 
 /*
 ===================
@@ -74,10 +90,12 @@ void SV_InitBoxHull (void)
 	int		i;
 	int		side;
 
-	box_hull.clipnodes = box_clipnodes;
-	box_hull.planes = box_planes;
-	box_hull.firstclipnode = 0;
-	box_hull.lastclipnode = 5;
+	box_hull.hull.clipnodes = box_clipnodes;
+	box_hull.hull.planes = box_hull.planes;
+	box_hull.hull.firstclipnode = 0;
+	box_hull.hull.lastclipnode = 5;
+	box_hull.hull.nodes = box_hull.nodes;
+	box_hull.hull.numnodes = 6;
 
 	for (i=0 ; i<6 ; i++)
 	{
@@ -91,12 +109,36 @@ void SV_InitBoxHull (void)
 		else
 			box_clipnodes[i].children[side^1] = CONTENTS_SOLID;
 
-		box_planes[i].type = i>>1;
-		box_planes[i].normal[i>>1] = 1;
+		box_hull.planes[i].type = i>>1;
+		box_hull.planes[i].normal[i>>1] = 1;
+
+		// the clipnodes are already in depth first order
+		box_hull.nodes[i].children[0] = box_clipnodes[i].children[0];
+		box_hull.nodes[i].children[1] = box_clipnodes[i].children[1];
+		box_hull.nodes[i].type = i>>1;
+		box_hull.nodes[i].normal[i>>1] = 1;
 	}
 
 }
 
+/*
+===================
+SV_InitBoxHullCopy
+
+Gives a trace its own copy of the box hull
+===================
+*/
+static void SV_InitBoxHullCopy (boxhull_t *box, qboolean quiet)
+{
+	memcpy (box->planes, box_hull.planes, sizeof(box->planes));
+	memcpy (box->nodes, box_hull.nodes, sizeof(box->nodes));
+	box->hull = box_hull.hull;
+	box->hull.planes = box->planes;
+	box->hull.nodes = box->nodes;
+	box->quiet = quiet;
+	box->failed = false;
+}
+
 
 /*
 ===================
@@ -106,16 +148,21 @@ To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 ===================
 */
-hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
+static hull_t *SV_HullForBoxCopy (boxhull_t *box, vec3_t mins, vec3_t maxs)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = mins[0];
-	box_planes[2].dist = maxs[1];
-	box_planes[3].dist = mins[1];
-	box_planes[4].dist = maxs[2];
-	box_planes[5].dist = mins[2];
+	box->planes[0].dist = box->nodes[0].dist = maxs[0];
+	box->planes[1].dist = box->nodes[1].dist = mins[0];
+	box->planes[2].dist = box->nodes[2].dist = maxs[1];
+	box->planes[3].dist = box->nodes[3].dist = mins[1];
+	box->planes[4].dist = box->nodes[4].dist = maxs[2];
+	box->planes[5].dist = box->nodes[5].dist = mins[2];
+
+	return &box->hull;
+}
 
-	return &box_hull;
+hull_t	*SV_HullForBox (vec3_t mins, vec3_t maxs)
+{
+	return SV_HullForBoxCopy (&box_hull, mins, maxs);
 }
 
 
@@ -130,7 +177,7 @@ Offset is filled in to contain the adjustment that must be added to the
 testing object's origin to get a point to use with the returned hull.
 ================
 */
-hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+static hull_t *SV_HullForEntityBox (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset, boxhull_t *box)
 {
 	qmodel_t	*model;
 	vec3_t		size;
@@ -140,7 +187,9 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 // decide which clipping hull to use, based on the size
 	if (ent->v.solid == SOLID_BSP)
 	{	// explicit hulls in the BSP model
-		if (ent->v.movetype != MOVETYPE_PUSH && !pr_checkextension.value)
+		if (ent->v.movetype != MOVETYPE_PUSH && !pr_checkextension.value && box->quiet)
+			box->failed = true;
+		else if (ent->v.movetype != MOVETYPE_PUSH && !pr_checkextension.value)
 			Con_Warning ("SOLID_BSP without MOVETYPE_PUSH (%s at %f %f %f)\n",
 				    PR_GetString(ent->v.classname), ent->v.origin[0], ent->v.origin[1], ent->v.origin[2]);
 
@@ -148,6 +197,11 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 
 		if (!model || model->type != mod_brush)
 		{
+			if (box->quiet)
+			{
+				box->failed = true;
+				goto nohitmeshsupport;
+			}
 			Con_Warning ("SOLID_BSP with a non bsp model (%s at %f %f %f)\n",
 				    PR_GetString(ent->v.classname), ent->v.origin[0], ent->v.origin[1], ent->v.origin[2]);
 			goto nohitmeshsupport;
@@ -170,7 +224,7 @@ hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
 nohitmeshsupport:
 		VectorSubtract (ent->v.mins, maxs, hullmins);
 		VectorSubtract (ent->v.maxs, mins, hullmaxs);
-		hull = SV_HullForBox (hullmins, hullmaxs);
+		hull = SV_HullForBoxCopy (box, hullmins, hullmaxs);
 
 		VectorCopy (ent->v.origin, offset);
 	}
@@ -179,6 +233,11 @@ nohitmeshsupport:
 	return hull;
 }
 
+hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+{
+	return SV_HullForEntityBox (ent, mins, maxs, offset, &box_hull);
+}
+
 /*
 ===============================================================================
 
@@ -189,47 +248,132 @@ ENTITY AREA CHECKING
 
 /*
 ===============
-SV_CreateAreaNode
+SV_AllocAreaNode
 
+Returns a new leaf covering mins/maxs, or NULL if the node pool is exhausted
 ===============
 */
-areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
+static areanode_t *SV_AllocAreaNode (vec3_t mins, vec3_t maxs)
 {
 	areanode_t	*anode;
-	vec3_t		size;
-	vec3_t		mins1, maxs1, mins2, maxs2;
+
+	if (qcvm->numareanodes == AREA_NODES)
+		return NULL;
 
 	anode = &qcvm->areanodes[qcvm->numareanodes];
 	qcvm->numareanodes++;
 
+	anode->axis = -1;
+	anode->children[0] = anode->children[1] = NULL;
+	VectorCopy (mins, anode->mins);
+	VectorCopy (maxs, anode->maxs);
+	anode->numedicts = 0;
+	anode->stamp = ++qcvm->areastamp;
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
 
-	if (depth == AREA_DEPTH)
-	{
-		anode->axis = -1;
-		anode->children[0] = anode->children[1] = NULL;
-		return anode;
-	}
+	return anode;
+}
+
+/*
+===============
+SV_AreaChildForBox
+
+Returns the child of a split node that can hold the box, or -1 if the box
+has to stay in the node. Boxes that fit both loose children go to the side
+of their center.
+===============
+*/
+static int SV_AreaChildForBox (areanode_t *node, vec3_t absmin, vec3_t absmax)
+{
+	const int	axis = node->axis;
+	qboolean	fits0, fits1;
+
+	fits0 = absmin[axis] > node->loosedist[0];
+	fits1 = absmax[axis] < node->loosedist[1];
+	if (fits0 && (!fits1 || absmin[axis] + absmax[axis] >= 2 * node->dist))
+		return 0;
+	if (fits1)
+		return 1;
+	return -1;
+}
+
+/*
+===============
+SV_AreaLinkEdict
+
+===============
+*/
+static void SV_AreaLinkEdict (edict_t *ent, areanode_t *node, qboolean trigger)
+{
+	InsertLinkBefore (&ent->area, trigger ? &node->trigger_edicts : &node->solid_edicts);
+	ent->areanode = node;
+	node->numedicts++;
+	node->stamp = ++qcvm->areastamp;
+}
+
+/*
+===============
+SV_SplitAreaNode
+
+Turns a crowded leaf into a split node and pushes the edicts that fit into
+one of the new children down, keeping their relative order
+===============
+*/
+static void SV_SplitAreaNode (areanode_t *node)
+{
+	vec3_t		size;
+	vec3_t		mins1, maxs1, mins2, maxs2;
+	link_t		*list, *l, *next;
+	edict_t		*ent;
+	float		margin;
+	int			axis, child, i;
 
-	VectorSubtract (maxs, mins, size);
-	if (size[0] > size[1])
-		anode->axis = 0;
+	if (qcvm->numareanodes + 2 > AREA_NODES)
+		return;
+
+	VectorSubtract (node->maxs, node->mins, size);
+	if (size[0] >= size[1] && size[0] >= size[2])
+		axis = 0;
+	else if (size[1] >= size[2])
+		axis = 1;
 	else
-		anode->axis = 1;
+		axis = 2;
+	if (size[axis] < AREA_MIN_SIZE)
+		return;
 
-	anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
-	VectorCopy (mins, mins1);
-	VectorCopy (mins, mins2);
-	VectorCopy (maxs, maxs1);
-	VectorCopy (maxs, maxs2);
+	node->dist = 0.5 * (node->maxs[axis] + node->mins[axis]);
+	margin = size[axis] * AREA_LOOSENESS;
+	node->loosedist[0] = node->dist - margin;
+	node->loosedist[1] = node->dist + margin;
 
-	maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
+	VectorCopy (node->mins, mins1);
+	VectorCopy (node->mins, mins2);
+	VectorCopy (node->maxs, maxs1);
+	VectorCopy (node->maxs, maxs2);
 
-	anode->children[0] = SV_CreateAreaNode (depth+1, mins2, maxs2);
-	anode->children[1] = SV_CreateAreaNode (depth+1, mins1, maxs1);
+	maxs1[axis] = mins2[axis] = node->dist;
 
-	return anode;
+	node->children[0] = SV_AllocAreaNode (mins2, maxs2);
+	node->children[1] = SV_AllocAreaNode (mins1, maxs1);
+	node->axis = axis;
+	node->stamp = ++qcvm->areastamp;
+
+	for (i = 0; i < 2; i++)
+	{
+		list = i ? &node->trigger_edicts : &node->solid_edicts;
+		for (l = list->next ; l != list ; l = next)
+		{
+			next = l->next;
+			ent = EDICT_FROM_AREA(l);
+			child = SV_AreaChildForBox (node, ent->v.absmin, ent->v.absmax);
+			if (child == -1)
+				continue;
+			RemoveLink (l);
+			node->numedicts--;
+			SV_AreaLinkEdict (ent, node->children[child], i == 1);
+		}
+	}
 }
 
 /*
@@ -244,22 +388,67 @@ void SV_ClearWorld (void)
 
 	memset (qcvm->areanodes, 0, sizeof(qcvm->areanodes));
 	qcvm->numareanodes = 0;
-	SV_CreateAreaNode (0, qcvm->worldmodel->mins, qcvm->worldmodel->maxs);
+	qcvm->areastamp = 0;
+	if (!++qcvm->linkgeneration)
+		qcvm->linkgeneration = 1;
+	SV_AllocAreaNode (qcvm->worldmodel->mins, qcvm->worldmodel->maxs);
+	qcvm->numareadirty = 0;
+	PR_FindIndexInvalidate ();
+	SV_FlushTraceCache (true);
 }
 
 
 /*
 ===============
-SV_UnlinkEdict
+SV_UnlinkArea
 
 ===============
 */
-void SV_UnlinkEdict (edict_t *ent)
+static void SV_UnlinkArea (edict_t *ent)
 {
-	if (!ent->area.prev)
-		return;		// not linked in anywhere
+	if (ent->v.solid == SOLID_BSP && qcvm == &sv.qcvm)
+		SV_FlushTraceCache (false);
+	ent->areanode->stamp = ++qcvm->areastamp;
 	RemoveLink (&ent->area);
 	ent->area.prev = ent->area.next = NULL;
+	ent->areanode->numedicts--;
+	ent->areanode = NULL;
+	ent->linkgeneration = 0;
+}
+
+/*
+===============
+SV_RemoveAreaDirty
+===============
+*/
+static void SV_RemoveAreaDirty (edict_t *ent)
+{
+	const int	e = NUM_FOR_EDICT (ent);
+	int			i;
+
+	for (i = qcvm->numareadirty - 1; i >= 0; i--)
+		if (qcvm->areadirty[i] == e)
+			qcvm->areadirty[i] = qcvm->areadirty[--qcvm->numareadirty];
+	ent->areadirty = AREADIRTY_NONE;
+}
+
+/*
+===============
+SV_UnlinkEdict
+
+===============
+*/
+void SV_UnlinkEdict (edict_t *ent)
+{
+	if (ent->area.prev)		// linked in somewhere
+	{
+		SV_MarkAreaDirty (ent);
+		SV_UnlinkArea (ent);
+	}
+
+	// a free edict never matches a spatial query
+	if (ent->free && ent->areadirty != AREADIRTY_NONE)
+		SV_RemoveAreaDirty (ent);
 }
 
 
@@ -305,12 +494,130 @@ SV_AreaTriggerEdicts ( edict_t *ent, areanode_t *node, edict_t **list, int *list
 	if (node->axis == -1)
 		return;
 
-	if ( ent->v.absmax[node->axis] > node->dist )
+	if ( ent->v.absmax[node->axis] > node->loosedist[0] )
 		SV_AreaTriggerEdicts ( ent, node->children[0], list, listcount, listspace );
-	if ( ent->v.absmin[node->axis] < node->dist )
+	if ( ent->v.absmin[node->axis] < node->loosedist[1] )
 		SV_AreaTriggerEdicts ( ent, node->children[1], list, listcount, listspace );
 }
 
+/*
+====================
+SV_TouchAreaEdict
+
+Flags the area node of the edict as changed for speculative traces, and
+drops the cached traces if it is a SOLID_BSP edict
+====================
+*/
+void SV_TouchAreaEdict (edict_t *ent)
+{
+	if (ent->areanode)
+		ent->areanode->stamp = ++qcvm->areastamp;
+	if (ent->v.solid == SOLID_BSP && qcvm == &sv.qcvm)
+		SV_FlushTraceCache (false);
+}
+
+/*
+====================
+SV_MarkAreaDirty
+
+The area link of the edict may no longer match its origin, size or solid
+until it is linked again, so spatial queries have to test it directly
+====================
+*/
+void SV_MarkAreaDirty (edict_t *ent)
+{
+	SV_TouchAreaEdict (ent);
+	if (ent->free || ent->areadirty == AREADIRTY_CHANGED)
+		return;
+	if (ent->areadirty == AREADIRTY_NONE)
+	{
+		if (qcvm->numareadirty == qcvm->maxareadirty)
+		{
+			qcvm->maxareadirty = q_max (64, qcvm->maxareadirty * 2);
+			qcvm->areadirty = (int *) realloc (qcvm->areadirty, qcvm->maxareadirty * sizeof(int));
+			if (!qcvm->areadirty)
+				Sys_Error ("SV_MarkAreaDirty: out of memory");
+		}
+		qcvm->areadirty[qcvm->numareadirty++] = NUM_FOR_EDICT (ent);
+	}
+	ent->areadirty = AREADIRTY_CHANGED;
+}
+
+/*
+====================
+SV_AreaEdictsRecursive
+
+====================
+*/
+static void SV_AreaEdictsRecursive (areanode_t *node, vec3_t mins, vec3_t maxs, edict_t **list, int *count, int maxcount)
+{
+	link_t		*l, *start;
+	edict_t		*touch;
+	int			i;
+
+	for (i = 0; i < 2; i++)
+	{
+		start = i ? &node->trigger_edicts : &node->solid_edicts;
+		for (l = start->next ; l != start ; l = l->next)
+		{
+			touch = EDICT_FROM_AREA(l);
+			if (mins[0] > touch->v.absmax[0]
+			|| mins[1] > touch->v.absmax[1]
+			|| mins[2] > touch->v.absmax[2]
+			|| maxs[0] < touch->v.absmin[0]
+			|| maxs[1] < touch->v.absmin[1]
+			|| maxs[2] < touch->v.absmin[2] )
+				continue;
+			if (*count == maxcount)
+				return;
+			list[(*count)++] = touch;
+		}
+	}
+
+	if (node->axis == -1)
+		return;
+
+	if ( maxs[node->axis] > node->loosedist[0] )
+		SV_AreaEdictsRecursive ( node->children[0], mins, maxs, list, count, maxcount );
+	if ( mins[node->axis] < node->loosedist[1] )
+		SV_AreaEdictsRecursive ( node->children[1], mins, maxs, list, count, maxcount );
+}
+
+/*
+====================
+SV_AreaEdicts
+
+Fills list with the linked edicts whose absolute box touches mins/maxs, plus
+every edict that QC changed since its last link. Edicts can appear twice and
+the order is arbitrary.
+====================
+*/
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount)
+{
+	edict_t		*ent;
+	int			i, count;
+
+	count = 0;
+	SV_AreaEdictsRecursive (qcvm->areanodes, mins, maxs, list, &count, maxcount);
+
+	// drop relinked and freed edicts from the dirty list while collecting the others
+	for (i = 0; i < qcvm->numareadirty; )
+	{
+		ent = EDICT_NUM (qcvm->areadirty[i]);
+		if (ent->areadirty != AREADIRTY_CHANGED || ent->free)
+		{
+			ent->areadirty = AREADIRTY_NONE;
+			qcvm->areadirty[i] = qcvm->areadirty[--qcvm->numareadirty];
+			continue;
+		}
+		if (count < maxcount)
+			list[count++] = ent;
+		i++;
+	}
+
+	return count;
+}
+
 /*
 ====================
 SV_TouchLinks
@@ -412,24 +719,105 @@ void SV_FindTouchedLeafs (edict_t *ent, mnode_t *node)
 		SV_FindTouchedLeafs (ent, node->children[1]);
 }
 
+/*
+===============
+SV_FindLeafWords
+
+Groups the leafnums by the 32 bit word of a pvs they are in, so visibility
+can be tested a word at a time. The masks are laid out like the pvs bytes.
+===============
+*/
+static void SV_FindLeafWords (edict_t *ent)
+{
+	byte	mask[4];
+	int		word;
+	unsigned int	i, j;
+
+	ent->num_leafwords = 0;
+	for (i = 0; i < ent->num_leafs; i++)
+	{
+		word = ent->leafnums[i] >> 5;
+		for (j = 0; j < ent->num_leafwords; j++)
+			if (ent->leafwords[j] == word)
+				break;
+		if (j == ent->num_leafwords)
+		{
+			ent->leafwords[j] = word;
+			ent->leafwordmasks[j] = 0;
+			ent->num_leafwords++;
+		}
+		memcpy (mask, &ent->leafwordmasks[j], sizeof(mask));
+		mask[(ent->leafnums[i] >> 3) & 3] |= 1 << (ent->leafnums[i] & 7);
+		memcpy (&ent->leafwordmasks[j], mask, sizeof(mask));
+	}
+}
+
+// full links and links skipped because nothing moved, for sv.qcvm
+static int	link_counts[2];			// this frame
+static int	link_lastframe[2];
+static int	link_totals[2];			// since sv_linkstats was last run
+static int	link_frames;
+
+/*
+===============
+SV_LinkCountersFrame
+
+Called at the start of every server frame
+===============
+*/
+void SV_LinkCountersFrame (void)
+{
+	int		i;
+
+	for (i = 0; i < 2; i++)
+	{
+		link_lastframe[i] = link_counts[i];
+		link_totals[i] += link_counts[i];
+		link_counts[i] = 0;
+	}
+	link_frames++;
+}
+
+/*
+===============
+SV_LinkStats_f
+===============
+*/
+void SV_LinkStats_f (void)
+{
+	int		total;
+
+	Con_Printf ("last frame: %d links, %d skipped\n", link_lastframe[0], link_lastframe[1]);
+	if (link_frames)
+	{
+		total = link_totals[0] + link_totals[1];
+		Con_Printf ("%d frames: %.1f links, %.1f skipped per frame, %d%% skipped\n", link_frames,
+			(double)link_totals[0] / link_frames, (double)link_totals[1] / link_frames,
+			total ? (int)(link_totals[1] * 100.0 / total) : 0);
+	}
+	link_totals[0] = link_totals[1] = link_frames = 0;
+}
+
 /*
 ===============
 SV_LinkEdict
 
+If the box, solid and model of the edict didn't change since its last full
+link, its leafs and area link still hold and only the triggers are touched.
+SOLID_BSP edicts are always relinked, their angles matter to clipping.
 ===============
 */
 void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 {
 	areanode_t	*node;
+	int			child, i;
 
-	if (ent->area.prev)
-		SV_UnlinkEdict (ent);	// unlink from old position
-
-	if (ent == qcvm->edicts)
+	if (ent == qcvm->edicts || ent->free)
+	{
+		if (ent->area.prev)
+			SV_UnlinkArea (ent);	// unlink from old position
 		return;		// don't add the world
-
-	if (ent->free)
-		return;
+	}
 
 // set the abs box
 	if (ent->v.solid == SOLID_BSP && (ent->v.angles[0] || ent->v.angles[1] || ent->v.angles[2]) && pr_checkextension.value)
@@ -479,34 +867,61 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers)
 		ent->v.absmax[2] += 1;
 	}
 
+// the area link matches the fields again, unless the box can't be sorted into the tree
+	if (ent->areadirty == AREADIRTY_CHANGED)
+	{
+		for (i = 0; i < 3; i++)
+			if (IS_NAN (ent->v.absmin[i]) || IS_NAN (ent->v.absmax[i]))
+				break;
+		if (i == 3)
+			ent->areadirty = AREADIRTY_LINKED;
+	}
+
+// nothing moved, keep the leafs and the area link (a NaN box never compares equal)
+	if (ent->linkgeneration == qcvm->linkgeneration && ent->v.solid != SOLID_BSP
+		&& ent->linksolid == ent->v.solid && ent->linkmodel == (ent->v.modelindex != 0)
+		&& VectorCompare (ent->v.absmin, ent->linkmins) && VectorCompare (ent->v.absmax, ent->linkmaxs)
+		&& (ent->v.solid == SOLID_NOT) == (ent->area.prev == NULL))
+	{
+		if (qcvm == &sv.qcvm)
+			link_counts[1]++;
+		if (ent->v.solid != SOLID_NOT && touch_triggers)
+			SV_TouchLinks (ent);
+		return;
+	}
+
+	if (ent->area.prev)
+		SV_UnlinkArea (ent);	// unlink from old position
+	if (qcvm == &sv.qcvm)
+		link_counts[0]++;
+
 // link to PVS leafs
 	ent->num_leafs = 0;
 	if (ent->v.modelindex)
 		SV_FindTouchedLeafs (ent, qcvm->worldmodel->nodes);
+	SV_FindLeafWords (ent);
+
+	VectorCopy (ent->v.absmin, ent->linkmins);
+	VectorCopy (ent->v.absmax, ent->linkmaxs);
+	ent->linksolid = ent->v.solid;
+	ent->linkmodel = (ent->v.modelindex != 0);
+	ent->linkgeneration = qcvm->linkgeneration;
 
 	if (ent->v.solid == SOLID_NOT)
 		return;
 
-// find the first node that the ent's box crosses
+// find the deepest node whose loose bounds hold the ent's box
 	node = qcvm->areanodes;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if (ent->v.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if (ent->v.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
+	while (node->axis != -1 && (child = SV_AreaChildForBox (node, ent->v.absmin, ent->v.absmax)) != -1)
+		node = node->children[child];
 
-// link it in
+// link it in, splitting the leaf once it gets crowded
+	if (ent->v.solid == SOLID_BSP && qcvm == &sv.qcvm)
+		SV_FlushTraceCache (false);
 
-	if (ent->v.solid == SOLID_TRIGGER)
-		InsertLinkBefore (&ent->area, &node->trigger_edicts);
-	else
-		InsertLinkBefore (&ent->area, &node->solid_edicts);
+	SV_AreaLinkEdict (ent, node, ent->v.solid == SOLID_TRIGGER);
+	if (node->axis == -1 && node->numedicts > AREA_SPLIT_EDICTS)
+		SV_SplitAreaNode (node);
 
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -525,11 +940,41 @@ POINT TESTING IN HULLS
 
 /*
 ==================
-SV_HullPointContents
+SV_HullNodeContents
 
+SV_HullPointContents on the linear nodes of a hull
 ==================
 */
-int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
+static int SV_HullNodeContents (mhullnode_t *nodes, int num, vec3_t p)
+{
+	float		d;
+	mhullnode_t	*node;
+
+	while (num >= 0)
+	{
+		node = nodes + num;
+
+		if (node->type < 3)
+			d = p[node->type] - node->dist;
+		else
+			d = DoublePrecisionDotProduct (node->normal, p) - node->dist;
+		if (d < 0)
+			num = node->children[1];
+		else
+			num = node->children[0];
+	}
+
+	return num;
+}
+
+/*
+==================
+SV_HullClipnodeContents
+
+SV_HullPointContents on the clipnodes and planes of a hull
+==================
+*/
+static int SV_HullClipnodeContents (hull_t *hull, int num, vec3_t p)
 {
 	float		d;
 	mclipnode_t	*node; //johnfitz -- was dclipnode_t
@@ -556,6 +1001,19 @@ int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
 	return num;
 }
 
+/*
+==================
+SV_HullPointContents
+
+==================
+*/
+int SV_HullPointContents (hull_t *hull, int num, vec3_t p)
+{
+	if (hull->nodes && num == hull->firstclipnode)
+		return SV_HullNodeContents (hull->nodes, 0, p);
+	return SV_HullClipnodeContents (hull, num, p);
+}
+
 
 /*
 ==================
@@ -626,8 +1084,7 @@ struct rhtctx_s
 {
 	unsigned int hitcontents;
 	vec3_t start, end;
-	mclipnode_t	*clipnodes;
-	mplane_t	*planes;
+	mhullnode_t	*nodes;
 };
 #define VectorNegate(a,b)		((b)[0]=-(a)[0],(b)[1]=-(a)[1],(b)[2]=-(a)[2])
 #define FloatInterpolate(a, bness, b, c) ((c) = (a) + (b - a)*bness)
@@ -648,8 +1105,7 @@ ezQuake also has a version of this logic, but I trust mine more.
 */
 static int Q1BSP_RecursiveHullTrace (struct rhtctx_s *ctx, int num, float p1f, float p2f, vec3_t p1, vec3_t p2, trace_t *trace)
 {
-	mclipnode_t	*node;
-	mplane_t	*plane;
+	mhullnode_t	*node;
 	float		t1, t2;
 	vec3_t		mid;
 	int			side;
@@ -682,18 +1138,17 @@ reenter:
 	/*its a node*/
 
 	/*get the node info*/
-	node = ctx->clipnodes + num;
-	plane = ctx->planes + node->planenum;
+	node = ctx->nodes + num;
 
-	if (plane->type < 3)
+	if (node->type < 3)
 	{
-		t1 = p1[plane->type] - plane->dist;
-		t2 = p2[plane->type] - plane->dist;
+		t1 = p1[node->type] - node->dist;
+		t2 = p2[node->type] - node->dist;
 	}
 	else
 	{
-		t1 = DoublePrecisionDotProduct (plane->normal, p1) - plane->dist;
-		t2 = DoublePrecisionDotProduct (plane->normal, p2) - plane->dist;
+		t1 = DoublePrecisionDotProduct (node->normal, p1) - node->dist;
+		t2 = DoublePrecisionDotProduct (node->normal, p2) - node->dist;
 	}
 
 	/*if its completely on one side, resume on that side*/
@@ -710,15 +1165,15 @@ reenter:
 		goto reenter;
 	}
 
-	if (plane->type < 3)
+	if (node->type < 3)
 	{
-		t1 = ctx->start[plane->type] - plane->dist;
-		t2 = ctx->end[plane->type] - plane->dist;
+		t1 = ctx->start[node->type] - node->dist;
+		t2 = ctx->end[node->type] - node->dist;
 	}
 	else
 	{
-		t1 = DotProduct (plane->normal, ctx->start) - plane->dist;
-		t2 = DotProduct (plane->normal, ctx->end) - plane->dist;
+		t1 = DotProduct (node->normal, ctx->start) - node->dist;
+		t2 = DotProduct (node->normal, ctx->end) - node->dist;
 	}
 
 	side = t1 < 0;
@@ -738,15 +1193,15 @@ reenter:
 	if (side)
 	{
 		/*we impacted the back of the node, so flip the plane*/
-		trace->plane.dist = -plane->dist;
-		VectorNegate(plane->normal, trace->plane.normal);
+		trace->plane.dist = -node->dist;
+		VectorNegate(node->normal, trace->plane.normal);
 		midf = (t1 + DIST_EPSILON) / (t1 - t2);
 	}
 	else
 	{
 		/*we impacted the front of the node*/
-		trace->plane.dist = plane->dist;
-		VectorCopy(plane->normal, trace->plane.normal);
+		trace->plane.dist = node->dist;
+		VectorCopy(node->normal, trace->plane.normal);
 		midf = (t1 - DIST_EPSILON) / (t1 - t2);
 	}
 
@@ -924,28 +1379,235 @@ qboolean SV_RecursiveHullCheck (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *tra
 		}
 		return true;
 	}
+	else if (!hull->nodes)
+		return SV_SlowRecursiveHullCheck (hull, hull->firstclipnode, 0, 1, p1, p2, trace);
 	else
 	{
 		struct rhtctx_s ctx;
 		VectorCopy(p1, ctx.start);
 		VectorCopy(p2, ctx.end);
-		ctx.clipnodes = hull->clipnodes;
-		ctx.planes = hull->planes;
+		ctx.nodes = hull->nodes;
 		ctx.hitcontents = hitcontents;
-		return Q1BSP_RecursiveHullTrace(&ctx, hull->firstclipnode, 0, 1, p1, p2, trace) != rht_impact;
+		return Q1BSP_RecursiveHullTrace(&ctx, 0, 0, 1, p1, p2, trace) != rht_impact;
 	}
 }
 
 /*
-==================
-SV_ClipMoveToEntity
+===============================================================================
 
-Handles selection or creation of a clipping hull, and offseting (and
-eventually rotation) of the end points
-==================
+BATCHED HULL TRACES
+
+Traces that go through the same hull share the walk from the head node down
+to the first node where they split up or end up on different sides. With
+SSE2 that walk tests four of them against each plane at once, every trace
+then finishes on its own from that node with the scalar code. Descending
+through a node that a segment doesn't cross changes nothing but the node
+number, so the results are identical to tracing each one from the top.
+
+===============================================================================
 */
-trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, unsigned int hitcontents)
-{
+
+#define	HULL_PACKET_SIZE	4
+
+#ifdef USE_SSE2
+/*
+==================
+SV_HullPacketPlaneDist
+
+DoublePrecisionDotProduct (node->normal, p) - node->dist for four points,
+rounded to float like the scalar code does
+==================
+*/
+static __m128 SV_HullPacketPlaneDist (mhullnode_t *node, __m128 p[3])
+{
+	const __m128d	n0 = _mm_set1_pd (node->normal[0]);
+	const __m128d	n1 = _mm_set1_pd (node->normal[1]);
+	const __m128d	n2 = _mm_set1_pd (node->normal[2]);
+	const __m128d	dist = _mm_set1_pd (node->dist);
+	__m128d			lo, hi;
+
+	lo = _mm_add_pd (_mm_add_pd (_mm_mul_pd (n0, _mm_cvtps_pd (p[0])), _mm_mul_pd (n1, _mm_cvtps_pd (p[1]))), _mm_mul_pd (n2, _mm_cvtps_pd (p[2])));
+	hi = _mm_add_pd (_mm_add_pd (_mm_mul_pd (n0, _mm_cvtps_pd (_mm_movehl_ps (p[0], p[0]))),
+		_mm_mul_pd (n1, _mm_cvtps_pd (_mm_movehl_ps (p[1], p[1])))), _mm_mul_pd (n2, _mm_cvtps_pd (_mm_movehl_ps (p[2], p[2]))));
+
+	return _mm_movelh_ps (_mm_cvtpd_ps (_mm_sub_pd (lo, dist)), _mm_cvtpd_ps (_mm_sub_pd (hi, dist)));
+}
+
+/*
+==================
+SV_HullPacketDescend
+
+Walks up to four segments down the linear nodes of a hull as long as all of
+them are completely on the same side of every plane. Points are segments
+with p1 == p2. Unused lanes must repeat a used one.
+==================
+*/
+static int SV_HullPacketDescend (mhullnode_t *nodes, float p1[3][HULL_PACKET_SIZE], float p2[3][HULL_PACKET_SIZE])
+{
+	const __m128	zero = _mm_setzero_ps ();
+	__m128			v1[3], v2[3];
+	__m128			t1, t2, dist;
+	mhullnode_t		*node;
+	int				i, num, front, back;
+
+	for (i = 0; i < 3; i++)
+	{
+		v1[i] = _mm_loadu_ps (p1[i]);
+		v2[i] = _mm_loadu_ps (p2[i]);
+	}
+
+	num = 0;
+	while (num >= 0)
+	{
+		node = nodes + num;
+
+		if (node->type < 3)
+		{
+			dist = _mm_set1_ps (node->dist);
+			t1 = _mm_sub_ps (v1[node->type], dist);
+			t2 = _mm_sub_ps (v2[node->type], dist);
+		}
+		else
+		{
+			t1 = SV_HullPacketPlaneDist (node, v1);
+			t2 = SV_HullPacketPlaneDist (node, v2);
+		}
+
+		front = _mm_movemask_ps (_mm_and_ps (_mm_cmpge_ps (t1, zero), _mm_cmpge_ps (t2, zero)));
+		back = _mm_movemask_ps (_mm_and_ps (_mm_cmplt_ps (t1, zero), _mm_cmplt_ps (t2, zero)));
+		if (front == 15)
+			num = node->children[0];
+		else if (back == 15)
+			num = node->children[1];
+		else
+			break;
+	}
+
+	return num;
+}
+#endif // def USE_SSE2
+
+/*
+==================
+SV_HullPacketStart
+
+Returns the linear node the segments in lanes can start from
+==================
+*/
+static int SV_HullPacketStart (hull_t *hull, int count, int *lanes, vec3_t *p1, vec3_t *p2)
+{
+#ifdef USE_SSE2
+	float	v1[3][HULL_PACKET_SIZE], v2[3][HULL_PACKET_SIZE];
+	int		i, j, lane;
+
+	if (!use_simd || count < 2)
+		return 0;
+
+	for (i = 0; i < HULL_PACKET_SIZE; i++)
+	{
+		lane = lanes[q_min (i, count - 1)];
+		for (j = 0; j < 3; j++)
+		{
+			v1[j][i] = p1[lane][j];
+			v2[j][i] = p2[lane][j];
+		}
+	}
+	return SV_HullPacketDescend (hull->nodes, v1, v2);
+#else
+	return 0;
+#endif
+}
+
+/*
+==================
+SV_HullPointContentsBatch
+
+SV_HullPointContents (hull, num, p[i]) for count points
+==================
+*/
+void SV_HullPointContentsBatch (hull_t *hull, int num, int count, vec3_t *p, int *contents)
+{
+	int		lanes[HULL_PACKET_SIZE];
+	int		i, j, n, start;
+
+	if (!hull->nodes || num != hull->firstclipnode)
+	{
+		for (i = 0; i < count; i++)
+			contents[i] = SV_HullPointContents (hull, num, p[i]);
+		return;
+	}
+
+	for (i = 0; i < count; i += n)
+	{
+		n = q_min (count - i, HULL_PACKET_SIZE);
+		for (j = 0; j < n; j++)
+			lanes[j] = i + j;
+		start = SV_HullPacketStart (hull, n, lanes, p, p);
+		for (j = 0; j < n; j++)
+			contents[i + j] = SV_HullNodeContents (hull->nodes, start, p[i + j]);
+	}
+}
+
+/*
+==================
+SV_RecursiveHullCheckBatch
+
+SV_RecursiveHullCheck for count segments through the same hull. The traces
+have to be initialized the way SV_ClipMoveToEntity does.
+==================
+*/
+void SV_RecursiveHullCheckBatch (hull_t *hull, int count, vec3_t *p1, vec3_t *p2, trace_t *traces, unsigned int hitcontents)
+{
+	struct rhtctx_s	ctx;
+	int				lanes[HULL_PACKET_SIZE];
+	int				i, j, n, num;
+
+	if (!pr_checkextension.value || !hull->nodes)
+	{
+		for (i = 0; i < count; i++)
+			SV_RecursiveHullCheck (hull, p1[i], p2[i], &traces[i], hitcontents);
+		return;
+	}
+
+	ctx.nodes = hull->nodes;
+	ctx.hitcontents = hitcontents;
+
+	for (i = 0, n = 0; i <= count; i++)
+	{
+		if (i < count)
+		{
+			// points go through the point contents shortcut
+			if (p1[i][0]==p2[i][0] && p1[i][1]==p2[i][1] && p1[i][2]==p2[i][2])
+				SV_RecursiveHullCheck (hull, p1[i], p2[i], &traces[i], hitcontents);
+			else
+				lanes[n++] = i;
+			if (n < HULL_PACKET_SIZE)
+				continue;
+		}
+		if (!n)
+			continue;
+
+		num = SV_HullPacketStart (hull, n, lanes, p1, p2);
+		for (j = 0; j < n; j++)
+		{
+			VectorCopy (p1[lanes[j]], ctx.start);
+			VectorCopy (p2[lanes[j]], ctx.end);
+			Q1BSP_RecursiveHullTrace (&ctx, num, 0, 1, p1[lanes[j]], p2[lanes[j]], &traces[lanes[j]]);
+		}
+		n = 0;
+	}
+}
+
+/*
+==================
+SV_ClipMoveToEntity
+
+Handles selection or creation of a clipping hull, and offseting (and
+eventually rotation) of the end points
+==================
+*/
+static trace_t SV_ClipMoveToEntityBox (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, unsigned int hitcontents, boxhull_t *box)
+{
 	trace_t		trace;
 	vec3_t		offset;
 	vec3_t		start_l, end_l;
@@ -958,7 +1620,14 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	VectorCopy (end, trace.endpos);
 
 // get the clipping hull
-	hull = SV_HullForEntity (ent, mins, maxs, offset);
+	hull = SV_HullForEntityBox (ent, mins, maxs, offset, box);
+
+// hulls without linear nodes fall back to SV_SlowRecursiveHullCheck, which prints
+	if (box->quiet && !hull->nodes)
+	{
+		box->failed = true;
+		return trace;
+	}
 
 	VectorSubtract (start, offset, start_l);
 	VectorSubtract (end, offset, end_l);
@@ -1000,154 +1669,352 @@ trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t max
 	return trace;
 }
 
+trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, unsigned int hitcontents)
+{
+	return SV_ClipMoveToEntityBox (ent, start, mins, maxs, end, hitcontents, &box_hull);
+}
+
 //===========================================================================
 
 /*
-====================
-SV_ClipToLinks
+===============================================================================
 
-Mins and maxs enclose the entire area swept by the move
-====================
+TRACE CACHE
+
+With sv_tracecache, SV_Move remembers MOVE_NOMONSTERS traces for the rest of
+the server frame. Those only depend on the world and the SOLID_BSP edicts,
+so the cache is flushed whenever one of those links, unlinks or has a clip
+field written. A result is shared between passedicts as long as they skip
+the same edicts.
+
+===============================================================================
 */
-static void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+
+#define	TRACECACHE_SIZE		2048	// power of two
+
+typedef struct
 {
-	link_t		*l, *next;
-	edict_t		*touch;
+	float		key[12];		// start, mins, maxs, end
+	int			type;
+	unsigned int	generation;
+	int			numcandidates;
+	int			skipped;		// bit per candidate the passedict skipped
+	edict_t		*candidates[TRACECACHE_CANDIDATES];
 	trace_t		trace;
+} tracecache_t;
 
-// touch linked edicts
-	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
-	{
-		next = l->next;
-		touch = EDICT_FROM_AREA(l);
-		if (touch->v.solid == SOLID_NOT)
-			continue;
-		if (touch == clip->passedict)
-			continue;
-		if (touch->v.solid == SOLID_TRIGGER)
-			Sys_Error ("Trigger in clipping list");
+typedef struct
+{
+	qboolean	active;
+	unsigned int	hash;
+	float		key[12];
+	int			type;
+} tracekey_t;
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
+cvar_t	sv_tracecache = {"sv_tracecache","0",CVAR_NONE};
 
-		if (clip->boxmins[0] > touch->v.absmax[0]
-		|| clip->boxmins[1] > touch->v.absmax[1]
-		|| clip->boxmins[2] > touch->v.absmax[2]
-		|| clip->boxmaxs[0] < touch->v.absmin[0]
-		|| clip->boxmaxs[1] < touch->v.absmin[1]
-		|| clip->boxmaxs[2] < touch->v.absmin[2] )
-			continue;
+static tracecache_t	tracecache[TRACECACHE_SIZE];
+static unsigned int	tracecache_generation = 1;
+static int			tracecache_lookups, tracecache_hits, tracecache_flushes;
 
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
+/*
+==================
+SV_FlushTraceCache
 
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-		if (clip->passedict)
-		{
-		 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
+Drops every cached trace. Counts as a flush unless a new frame starts.
+==================
+*/
+void SV_FlushTraceCache (qboolean newframe)
+{
+	if (!++tracecache_generation)
+		tracecache_generation = 1;
+	if (!newframe)
+		tracecache_flushes++;
+}
 
-		if (touch->v.skin < 0)
-		{
-			if (!(clip->hitcontents & (1<<-(int)touch->v.skin)))
-				continue;	//not solid, don't bother trying to clip.
-			if ((int)touch->v.flags & FL_MONSTER)
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, ~(1u<<-CONTENTS_EMPTY));
-			else
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, ~(1u<<-CONTENTS_EMPTY));
-			if (trace.contents != CONTENTS_EMPTY)
-				trace.contents = touch->v.skin;
-		}
-		else
-		{
-			if ((int)touch->v.flags & FL_MONSTER)
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end, clip->hitcontents);
-			else
-				trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end, clip->hitcontents);
-		}
+/*
+==================
+SV_TraceCacheCounters
 
-		if (trace.allsolid || trace.startsolid ||
-		trace.fraction < clip->trace.fraction)
-		{
-			trace.ent = touch;
-		 	if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
-	}
+Returns the counters since the last call and resets them
+==================
+*/
+void SV_TraceCacheCounters (int *lookups, int *hits, int *flushes)
+{
+	*lookups = tracecache_lookups;
+	*hits = tracecache_hits;
+	*flushes = tracecache_flushes;
+	tracecache_lookups = tracecache_hits = tracecache_flushes = 0;
+}
 
-// recurse down both sides
-	if (node->axis == -1)
-		return;
+/*
+==================
+SV_PassedictSkips
 
-	if ( clip->boxmaxs[node->axis] > node->dist )
-		SV_ClipToLinks ( node->children[0], clip );
-	if ( clip->boxmins[node->axis] < node->dist )
-		SV_ClipToLinks ( node->children[1], clip );
+True if the passedict rules of SV_ClipToEdict don't clip against touch
+==================
+*/
+static qboolean SV_PassedictSkips (edict_t *touch, edict_t *passedict)
+{
+	if (touch == passedict)
+		return true;
+	if (!passedict)
+		return false;
+	if (passedict->v.size[0] && !touch->v.size[0])
+		return true;	// points never interact
+	if (PROG_TO_EDICT(touch->v.owner) == passedict)
+		return true;	// own missiles
+	if (PROG_TO_EDICT(passedict->v.owner) == touch)
+		return true;	// owner
+	return false;
 }
 
-static void World_ClipToNetwork ( moveclip_t *clip )
+/*
+==================
+SV_TraceCacheLookup
+
+Fills in key and returns true with the cached trace if there is one
+==================
+*/
+static qboolean SV_TraceCacheLookup (tracekey_t *key, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, trace_t *trace)
 {
-	entity_t	*touch;
-	trace_t		trace;
-	int i;
+	tracecache_t	*entry;
+	unsigned int	bits;
+	int				i;
 
-	for (i=1,touch=cl.entities+1 ; i<cl.num_entities ; i++,touch++)
+	key->active = sv_tracecache.value && (type & 3) == MOVE_NOMONSTERS && qcvm == &sv.qcvm;
+	if (!key->active)
+		return false;
+
+	VectorCopy (start, key->key);
+	VectorCopy (mins, (key->key + 3));
+	VectorCopy (maxs, (key->key + 6));
+	VectorCopy (end, (key->key + 9));
+	key->type = type;
+	key->hash = 2166136261u ^ (unsigned int)type;
+	for (i = 0; i < 12; i++)
 	{
-		if (!touch->model)
-			continue;
+		memcpy (&bits, &key->key[i], sizeof(bits));
+		key->hash = (key->hash ^ bits) * 16777619u;
+	}
+	key->hash ^= key->hash >> 15;
 
-		if (touch->netstate.solidsize == ES_SOLID_NOT)
-			continue;
-//		if (touch == clip->passedict)
-//			continue;
+	tracecache_lookups++;
+	entry = &tracecache[key->hash & (TRACECACHE_SIZE - 1)];
+	if (entry->generation != tracecache_generation || entry->type != type || memcmp (entry->key, key->key, sizeof(key->key)))
+		return false;
+	for (i = 0; i < entry->numcandidates; i++)
+		if (SV_PassedictSkips (entry->candidates[i], passedict) != ((entry->skipped >> i) & 1))
+			return false;
 
-		if (clip->type == MOVE_NOMONSTERS && touch->netstate.solidsize != ES_SOLID_BSP)
-			continue;
+	tracecache_hits++;
+	*trace = entry->trace;
+	return true;
+}
 
-/*		if (clip->boxmins[0] > touch->v.absmax[0]
-		|| clip->boxmins[1] > touch->v.absmax[1]
-		|| clip->boxmins[2] > touch->v.absmax[2]
-		|| clip->boxmaxs[0] < touch->v.absmin[0]
-		|| clip->boxmaxs[1] < touch->v.absmin[1]
-		|| clip->boxmaxs[2] < touch->v.absmin[2] )
-			continue;
+/*
+==================
+SV_TraceCacheStore
+==================
 */
+static void SV_TraceCacheStore (const tracekey_t *key, moveclip_t *clip)
+{
+	tracecache_t	*entry;
+	int				i;
 
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-/*		if (clip->passedict)
-		{
-			if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
-*/
+	if (!key->active || clip->numcandidates > TRACECACHE_CANDIDATES)
+		return;
 
-		//:: trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		{
-			vec3_t		offset;
-			vec3_t		start_l, end_l;
-			hull_t		*hull;
+	entry = &tracecache[key->hash & (TRACECACHE_SIZE - 1)];
+	memcpy (entry->key, key->key, sizeof(entry->key));
+	entry->type = key->type;
+	entry->generation = tracecache_generation;
+	entry->numcandidates = clip->numcandidates;
+	entry->skipped = 0;
+	for (i = 0; i < clip->numcandidates; i++)
+	{
+		entry->candidates[i] = clip->candidates[i];
+		if (SV_PassedictSkips (clip->candidates[i], clip->passedict))
+			entry->skipped |= 1 << i;
+	}
+	entry->trace = clip->trace;
+}
 
-		// fill in a default trace
-			memset (&trace, 0, sizeof(trace_t));
-			trace.fraction = 1;
-			trace.allsolid = true;
-			VectorCopy (clip->end, trace.endpos);
+//===========================================================================
+
+/*
+====================
+SV_ClipToEdict
+
+Clips the move against one linked solid edict
+====================
+*/
+static void SV_ClipToEdict ( edict_t *touch, moveclip_t *clip )
+{
+	trace_t		trace;
+
+	if (touch->v.solid == SOLID_NOT)
+		return;
+	if (touch == clip->passedict && !clip->track)
+		return;
+	if (touch->v.solid == SOLID_TRIGGER && touch != clip->passedict)
+	{
+		if (clip->box.quiet)
+		{
+			clip->box.failed = true;
+			return;
+		}
+		Sys_Error ("Trigger in clipping list");
+	}
+
+	if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+		return;
+
+	if (clip->boxmins[0] > touch->v.absmax[0]
+	|| clip->boxmins[1] > touch->v.absmax[1]
+	|| clip->boxmins[2] > touch->v.absmax[2]
+	|| clip->boxmaxs[0] < touch->v.absmin[0]
+	|| clip->boxmaxs[1] < touch->v.absmin[1]
+	|| clip->boxmaxs[2] < touch->v.absmin[2] )
+		return;
+
+	if (clip->track)
+	{	// the result holds for other passedicts that skip the same edicts
+		if (clip->numcandidates < TRACECACHE_CANDIDATES)
+			clip->candidates[clip->numcandidates] = touch;
+		clip->numcandidates++;
+		if (touch == clip->passedict)
+			return;
+	}
+
+	if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+		return;	// points never interact
+
+// might intersect, so do an exact clip
+	if (clip->trace.allsolid)
+		return;
+	if (clip->passedict)
+	{
+	 	if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+			return;	// don't clip against own missiles
+		if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+			return;	// don't clip against owner
+	}
+
+	if (touch->v.skin < 0)
+	{
+		if (!(clip->hitcontents & (1<<-(int)touch->v.skin)))
+			return;	//not solid, don't bother trying to clip.
+		if ((int)touch->v.flags & FL_MONSTER)
+			trace = SV_ClipMoveToEntityBox (touch, clip->start, clip->mins2, clip->maxs2, clip->end, ~(1u<<-CONTENTS_EMPTY), &clip->box);
+		else
+			trace = SV_ClipMoveToEntityBox (touch, clip->start, clip->mins, clip->maxs, clip->end, ~(1u<<-CONTENTS_EMPTY), &clip->box);
+		if (trace.contents != CONTENTS_EMPTY)
+			trace.contents = touch->v.skin;
+	}
+	else
+	{
+		if ((int)touch->v.flags & FL_MONSTER)
+			trace = SV_ClipMoveToEntityBox (touch, clip->start, clip->mins2, clip->maxs2, clip->end, clip->hitcontents, &clip->box);
+		else
+			trace = SV_ClipMoveToEntityBox (touch, clip->start, clip->mins, clip->maxs, clip->end, clip->hitcontents, &clip->box);
+	}
+
+	if (trace.allsolid || trace.startsolid ||
+	trace.fraction < clip->trace.fraction)
+	{
+		trace.ent = touch;
+	 	if (clip->trace.startsolid)
+		{
+			clip->trace = trace;
+			clip->trace.startsolid = true;
+		}
+		else
+			clip->trace = trace;
+	}
+	else if (trace.startsolid)
+		clip->trace.startsolid = true;
+}
+
+/*
+====================
+SV_ClipToLinks
+
+Mins and maxs enclose the entire area swept by the move
+====================
+*/
+static void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
+{
+	link_t		*l, *next;
+
+// touch linked edicts
+	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
+	{
+		next = l->next;
+		SV_ClipToEdict (EDICT_FROM_AREA(l), clip);
+	}
+
+// recurse down both sides
+	if (node->axis == -1 || clip->trace.allsolid)
+		return;
+
+	if ( clip->boxmaxs[node->axis] > node->loosedist[0] )
+		SV_ClipToLinks ( node->children[0], clip );
+	if ( clip->boxmins[node->axis] < node->loosedist[1] )
+		SV_ClipToLinks ( node->children[1], clip );
+}
+
+static void World_ClipToNetwork ( moveclip_t *clip )
+{
+	entity_t	*touch;
+	trace_t		trace;
+	int i;
+
+	for (i=1,touch=cl.entities+1 ; i<cl.num_entities ; i++,touch++)
+	{
+		if (!touch->model)
+			continue;
+
+		if (touch->netstate.solidsize == ES_SOLID_NOT)
+			continue;
+//		if (touch == clip->passedict)
+//			continue;
+
+		if (clip->type == MOVE_NOMONSTERS && touch->netstate.solidsize != ES_SOLID_BSP)
+			continue;
+
+/*		if (clip->boxmins[0] > touch->v.absmax[0]
+		|| clip->boxmins[1] > touch->v.absmax[1]
+		|| clip->boxmins[2] > touch->v.absmax[2]
+		|| clip->boxmaxs[0] < touch->v.absmin[0]
+		|| clip->boxmaxs[1] < touch->v.absmin[1]
+		|| clip->boxmaxs[2] < touch->v.absmin[2] )
+			continue;
+*/
+
+	// might intersect, so do an exact clip
+		if (clip->trace.allsolid)
+			return;
+/*		if (clip->passedict)
+		{
+			if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+				continue;	// don't clip against own missiles
+			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+				continue;	// don't clip against owner
+		}
+*/
+
+		//:: trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
+		{
+			vec3_t		offset;
+			vec3_t		start_l, end_l;
+			hull_t		*hull;
+
+		// fill in a default trace
+			memset (&trace, 0, sizeof(trace_t));
+			trace.fraction = 1;
+			trace.allsolid = true;
+			VectorCopy (clip->end, trace.endpos);
 
 		// get the clipping hull
 			//:: hull = SV_HullForEntity (ent, clip->mins, clip->maxs, offset);
@@ -1278,47 +2145,818 @@ boxmaxs[0] = boxmaxs[1] = boxmaxs[2] = 9999;
 
 /*
 ==================
-SV_Move
+SV_MoveHitContents
 ==================
 */
-trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+static unsigned int SV_MoveHitContents (int type)
+{
+	if (type & MOVE_HITALLCONTENTS)
+		return ~0u;
+	return CONTENTMASK_ANYSOLID;
+}
+
+/*
+==================
+SV_InitMoveClip
+
+worldtrace is the result of the world clip if it was done already
+==================
+*/
+static void SV_InitMoveClip (moveclip_t *clip, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, qboolean quiet, trace_t *worldtrace)
 {
-	moveclip_t	clip;
 	int			i;
 
-	memset ( &clip, 0, sizeof ( moveclip_t ) );
+	memset ( clip, 0, sizeof ( moveclip_t ) );
+	SV_InitBoxHullCopy (&clip->box, quiet);
 
-	if (type & MOVE_HITALLCONTENTS)
-		clip.hitcontents = ~0u;
-	else
-		clip.hitcontents = CONTENTMASK_ANYSOLID;
+	clip->hitcontents = SV_MoveHitContents (type);
 
 // clip to world
-	clip.trace = SV_ClipMoveToEntity ( qcvm->edicts, start, mins, maxs, end, clip.hitcontents );
+	if (worldtrace)
+		clip->trace = *worldtrace;
+	else
+		clip->trace = SV_ClipMoveToEntityBox ( qcvm->edicts, start, mins, maxs, end, clip->hitcontents, &clip->box );
 
-	clip.start = start;
-	clip.end = end;
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.type = type&3;
-	clip.passedict = passedict;
+	clip->start = start;
+	clip->end = end;
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->type = type&3;
+	clip->passedict = passedict;
 
 	if (type == MOVE_MISSILE)
 	{
 		for (i=0 ; i<3 ; i++)
 		{
-			clip.mins2[i] = -15;
-			clip.maxs2[i] = 15;
+			clip->mins2[i] = -15;
+			clip->maxs2[i] = 15;
 		}
 	}
 	else
 	{
-		VectorCopy (mins, clip.mins2);
-		VectorCopy (maxs, clip.maxs2);
+		VectorCopy (mins, clip->mins2);
+		VectorCopy (maxs, clip->maxs2);
 	}
 
 // create the bounding box of the entire move
-	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+	SV_MoveBounds ( start, clip->mins2, clip->maxs2, end, clip->boxmins, clip->boxmaxs );
+}
+
+/*
+===============================================================================
+
+TRACE RECORDING
+
+sv_tracerecord captures the SV_Move calls of the running server,
+sv_tracebench replays them against the area tree and a linear scan of all
+edicts, sv_hullbench replays their world clips with and without batching.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	vec3_t	start, mins, maxs, end;
+	int		type;
+	int		passedict;		// edict number, -1 for none
+} tracerecord_t;
+
+#define	MAX_TRACE_RECORDS	65536
+
+static tracerecord_t	*trace_records;
+static int				num_trace_records;
+static qboolean			trace_recording;
+
+/*
+==================
+SV_RecordTrace
+==================
+*/
+static void SV_RecordTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	tracerecord_t	*record;
+
+	if (num_trace_records == MAX_TRACE_RECORDS)
+	{
+		trace_recording = false;
+		Con_Printf ("sv_tracerecord: stopped after %d traces\n", num_trace_records);
+		return;
+	}
+
+	record = &trace_records[num_trace_records++];
+	VectorCopy (start, record->start);
+	VectorCopy (mins, record->mins);
+	VectorCopy (maxs, record->maxs);
+	VectorCopy (end, record->end);
+	record->type = type;
+	record->passedict = passedict ? NUM_FOR_EDICT (passedict) : -1;
+}
+
+/*
+==================
+SV_TraceRecord_f
+==================
+*/
+void SV_TraceRecord_f (void)
+{
+	if (trace_recording)
+	{
+		trace_recording = false;
+		Con_Printf ("Recorded %d traces\n", num_trace_records);
+		return;
+	}
+
+	if (!trace_records)
+	{
+		trace_records = (tracerecord_t *) malloc (MAX_TRACE_RECORDS * sizeof(tracerecord_t));
+		if (!trace_records)
+			Sys_Error ("SV_TraceRecord_f: out of memory");
+	}
+
+	num_trace_records = 0;
+	trace_recording = true;
+	Con_Printf ("Recording server traces, sv_tracerecord again stops\n");
+}
+
+/*
+==================
+SV_MoveLinear
+
+SV_Move without the area tree, every linked solid edict is tested
+==================
+*/
+static trace_t SV_MoveLinear (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	moveclip_t	clip;
+	edict_t		*ent;
+	int			i;
+
+	SV_InitMoveClip (&clip, start, mins, maxs, end, type, passedict, false, NULL);
+
+	for (i = 1, ent = NEXT_EDICT(qcvm->edicts); i < qcvm->num_edicts; i++, ent = NEXT_EDICT(ent))
+	{
+		if (!ent->area.prev || ent->v.solid == SOLID_TRIGGER)
+			continue;
+		SV_ClipToEdict (ent, &clip);
+	}
+
+	return clip.trace;
+}
+
+/*
+==================
+SV_TraceBench_f
+
+usage: sv_tracebench [iterations]
+==================
+*/
+void SV_TraceBench_f (void)
+{
+	const int	iterations = (Cmd_Argc () > 1) ? q_max (1, atoi (Cmd_Argv (1))) : 10;
+	tracerecord_t	*record;
+	trace_t		tree, linear;
+	edict_t		*passedict;
+	double		start, tree_time, linear_time;
+	int			i, j, mismatches, tied, maxnode;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+	if (!num_trace_records || trace_recording)
+	{
+		Con_Printf ("Record traces with sv_tracerecord first\n");
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+	{
+		for (i = 0, record = trace_records; i < num_trace_records; i++, record++)
+		{
+			passedict = (record->passedict >= 0 && record->passedict < qcvm->num_edicts) ? EDICT_NUM (record->passedict) : NULL;
+			SV_Move (record->start, record->mins, record->maxs, record->end, record->type, passedict);
+		}
+	}
+	tree_time = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+	{
+		for (i = 0, record = trace_records; i < num_trace_records; i++, record++)
+		{
+			passedict = (record->passedict >= 0 && record->passedict < qcvm->num_edicts) ? EDICT_NUM (record->passedict) : NULL;
+			SV_MoveLinear (record->start, record->mins, record->maxs, record->end, record->type, passedict);
+		}
+	}
+	linear_time = Sys_DoubleTime () - start;
+
+	// the visiting order differs, so equally close hits may report another edict
+	mismatches = tied = 0;
+	for (i = 0, record = trace_records; i < num_trace_records; i++, record++)
+	{
+		passedict = (record->passedict >= 0 && record->passedict < qcvm->num_edicts) ? EDICT_NUM (record->passedict) : NULL;
+		tree = SV_Move (record->start, record->mins, record->maxs, record->end, record->type, passedict);
+		linear = SV_MoveLinear (record->start, record->mins, record->maxs, record->end, record->type, passedict);
+		if (tree.fraction != linear.fraction || tree.allsolid != linear.allsolid || tree.startsolid != linear.startsolid
+			|| !VectorCompare (tree.endpos, linear.endpos))
+			mismatches++;
+		else if (tree.ent != linear.ent)
+			tied++;
+	}
+
+	for (i = 0, maxnode = 0; i < qcvm->numareanodes; i++)
+		maxnode = q_max (maxnode, qcvm->areanodes[i].numedicts);
+
+	PR_SwitchQCVM (NULL);
+
+	Con_Printf ("%d traces x %d iterations, %d edicts\n", num_trace_records, iterations, sv.qcvm.num_edicts);
+	Con_Printf ("area tree: %8.3f ms (%.2f us/trace), %d nodes, at most %d edicts per node\n",
+		tree_time * 1000.0, tree_time * 1e6 / ((double)num_trace_records * iterations), sv.qcvm.numareanodes, maxnode);
+	Con_Printf ("linear:    %8.3f ms (%.2f us/trace)\n", linear_time * 1000.0, linear_time * 1e6 / ((double)num_trace_records * iterations));
+	Con_Printf ("%d results differ, %d ties resolved to another edict\n", mismatches, tied);
+}
+
+/*
+==================
+SV_HullBench_f
+
+usage: sv_hullbench [iterations]
+
+Replays the world clip of the recorded traces one at a time and in batches,
+and the point contents of their start points
+==================
+*/
+void SV_HullBench_f (void)
+{
+	const int	iterations = (Cmd_Argc () > 1) ? q_max (1, atoi (Cmd_Argv (1))) : 10;
+	tracerecord_t	*record;
+	boxhull_t	box;
+	vec3_t		offset;
+	vec3_t		*start_l, *end_l;
+	hull_t		**hulls;
+	hull_t		*world;
+	unsigned int	*hitcontents;
+	trace_t		*scalar, *batch;
+	int			*contents, *batchcontents;
+	double		start, scalar_time, batch_time, point_time, batchpoint_time;
+	int			i, j, run, mismatches, pointmismatches;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+	if (!num_trace_records || trace_recording)
+	{
+		Con_Printf ("Record traces with sv_tracerecord first\n");
+		return;
+	}
+
+	start_l = (vec3_t *) malloc (num_trace_records * sizeof(vec3_t));
+	end_l = (vec3_t *) malloc (num_trace_records * sizeof(vec3_t));
+	hulls = (hull_t **) malloc (num_trace_records * sizeof(hull_t *));
+	hitcontents = (unsigned int *) malloc (num_trace_records * sizeof(unsigned int));
+	scalar = (trace_t *) malloc (num_trace_records * sizeof(trace_t));
+	batch = (trace_t *) malloc (num_trace_records * sizeof(trace_t));
+	contents = (int *) malloc (num_trace_records * sizeof(int));
+	batchcontents = (int *) malloc (num_trace_records * sizeof(int));
+	if (!start_l || !end_l || !hulls || !hitcontents || !scalar || !batch || !contents || !batchcontents)
+	{
+		Con_Printf ("sv_hullbench: out of memory\n");
+		free (start_l); free (end_l); free (hulls); free (hitcontents);
+		free (scalar); free (batch); free (contents); free (batchcontents);
+		return;
+	}
+
+	PR_SwitchQCVM (&sv.qcvm);
+
+	// point contents of the start points
+	world = &qcvm->worldmodel->hulls[0];
+	for (i = 0, record = trace_records; i < num_trace_records; i++, record++)
+		VectorCopy (record->start, start_l[i]);
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+		for (i = 0; i < num_trace_records; i++)
+			contents[i] = SV_HullPointContents (world, 0, start_l[i]);
+	point_time = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+		SV_HullPointContentsBatch (world, 0, num_trace_records, start_l, batchcontents);
+	batchpoint_time = Sys_DoubleTime () - start;
+
+	// world clips of the moves
+	SV_InitBoxHullCopy (&box, false);
+	for (i = 0, record = trace_records; i < num_trace_records; i++, record++)
+	{
+		hulls[i] = SV_HullForEntityBox (qcvm->edicts, record->mins, record->maxs, offset, &box);
+		hitcontents[i] = SV_MoveHitContents (record->type);
+		VectorSubtract (record->start, offset, start_l[i]);
+		VectorSubtract (record->end, offset, end_l[i]);
+	}
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+	{
+		for (i = 0; i < num_trace_records; i++)
+		{
+			memset (&scalar[i], 0, sizeof(trace_t));
+			scalar[i].fraction = 1;
+			scalar[i].allsolid = true;
+			VectorCopy (end_l[i], scalar[i].endpos);
+			SV_RecursiveHullCheck (hulls[i], start_l[i], end_l[i], &scalar[i], hitcontents[i]);
+		}
+	}
+	scalar_time = Sys_DoubleTime () - start;
+
+	// consecutive traces through the same hull form a batch
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+	{
+		for (i = 0; i < num_trace_records; i++)
+		{
+			memset (&batch[i], 0, sizeof(trace_t));
+			batch[i].fraction = 1;
+			batch[i].allsolid = true;
+			VectorCopy (end_l[i], batch[i].endpos);
+		}
+		for (i = 0; i < num_trace_records; i += run)
+		{
+			for (run = 1; i + run < num_trace_records; run++)
+				if (hulls[i + run] != hulls[i] || hitcontents[i + run] != hitcontents[i])
+					break;
+			SV_RecursiveHullCheckBatch (hulls[i], run, &start_l[i], &end_l[i], &batch[i], hitcontents[i]);
+		}
+	}
+	batch_time = Sys_DoubleTime () - start;
+
+	mismatches = pointmismatches = 0;
+	for (i = 0; i < num_trace_records; i++)
+	{
+		if (scalar[i].allsolid != batch[i].allsolid || scalar[i].startsolid != batch[i].startsolid
+			|| scalar[i].inopen != batch[i].inopen || scalar[i].inwater != batch[i].inwater
+			|| memcmp (&scalar[i].fraction, &batch[i].fraction, sizeof(float) * 8) || scalar[i].contents != batch[i].contents)
+			mismatches++;
+		if (contents[i] != batchcontents[i])
+			pointmismatches++;
+	}
+
+	PR_SwitchQCVM (NULL);
+
+	free (start_l); free (end_l); free (hulls); free (hitcontents);
+	free (scalar); free (batch); free (contents); free (batchcontents);
+
+	Con_Printf ("%d traces x %d iterations, simd %s\n", num_trace_records, iterations,
+#ifdef USE_SSE2
+		use_simd ? "on" : "off");
+#else
+		"not compiled in");
+#endif
+	Con_Printf ("hull traces: %8.3f ms scalar, %8.3f ms batched\n", scalar_time * 1000.0, batch_time * 1000.0);
+	Con_Printf ("point contents: %8.3f ms scalar, %8.3f ms batched\n", point_time * 1000.0, batchpoint_time * 1000.0);
+	Con_Printf ("%d traces and %d point contents differ\n", mismatches, pointmismatches);
+}
+
+/*
+==================
+SV_HullNodeBench_f
+
+usage: sv_hullnodebench [queries]
+
+Times random point contents and traces through the world's hulls on the
+clipnodes, on linear nodes kept in file order, and on the depth first nodes
+==================
+*/
+void SV_HullNodeBench_f (void)
+{
+	const int	count = (Cmd_Argc () > 1) ? q_max (1, atoi (Cmd_Argv (1))) : 100000;
+	struct rhtctx_s	ctx;
+	qmodel_t	*model;
+	hull_t		*hull;
+	mclipnode_t	*in;
+	mplane_t	*plane;
+	mhullnode_t	*filenodes;
+	vec3_t		*points, *ends;
+	trace_t		*traces, *linear;
+	double		start, clip_time, file_time, linear_time, filetrace_time, lineartrace_time;
+	unsigned int	seed;
+	int			h, i, j, numfile, child, sum, mismatches;
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server\n");
+		return;
+	}
+
+	model = sv.qcvm.worldmodel;
+	points = (vec3_t *) malloc (count * sizeof(vec3_t));
+	ends = (vec3_t *) malloc (count * sizeof(vec3_t));
+	traces = (trace_t *) malloc (count * 2 * sizeof(trace_t));
+	if (!points || !ends || !traces)
+	{
+		Con_Printf ("sv_hullnodebench: out of memory\n");
+		free (points); free (ends); free (traces);
+		return;
+	}
+
+	linear = traces + count;
+
+	// the same points for every run, short segments from them
+	seed = 1;
+	for (i = 0; i < count; i++)
+	{
+		for (j = 0; j < 3; j++)
+		{
+			seed = seed * 1103515245u + 12345u;
+			points[i][j] = model->mins[j] + (model->maxs[j] - model->mins[j]) * ((seed >> 8) / 16777216.0f);
+			seed = seed * 1103515245u + 12345u;
+			ends[i][j] = points[i][j] + 256.0f * ((seed >> 8) / 8388608.0f - 1.0f);
+		}
+	}
+
+	Con_Printf ("%d queries per hull, times in ns per query\n", count);
+	for (h = 0; h < 3; h++)
+	{
+		hull = &model->hulls[h];
+		if (!hull->nodes)
+		{
+			Con_Printf ("hull %d: no linear nodes\n", h);
+			continue;
+		}
+
+		numfile = hull->lastclipnode - hull->firstclipnode + 1;
+		filenodes = (mhullnode_t *) malloc (numfile * sizeof(mhullnode_t));
+		if (!filenodes)
+			break;
+		for (i = 0; i < numfile; i++)
+		{
+			in = hull->clipnodes + hull->firstclipnode + i;
+			plane = hull->planes + in->planenum;
+			VectorCopy (plane->normal, filenodes[i].normal);
+			filenodes[i].dist = plane->dist;
+			filenodes[i].type = plane->type;
+			for (j = 0; j < 2; j++)
+			{
+				child = in->children[j];
+				filenodes[i].children[j] = (child < 0) ? child : child - hull->firstclipnode;
+			}
+		}
+
+		start = Sys_DoubleTime ();
+		for (i = 0, j = 0; i < count; i++)
+			j += SV_HullClipnodeContents (hull, hull->firstclipnode, points[i]);
+		clip_time = Sys_DoubleTime () - start;
+		sum = j;
+
+		start = Sys_DoubleTime ();
+		for (i = 0, j = 0; i < count; i++)
+			j += SV_HullNodeContents (filenodes, 0, points[i]);
+		file_time = Sys_DoubleTime () - start;
+		mismatches = (j != sum);
+
+		start = Sys_DoubleTime ();
+		for (i = 0, j = 0; i < count; i++)
+			j += SV_HullNodeContents (hull->nodes, 0, points[i]);
+		linear_time = Sys_DoubleTime () - start;
+		mismatches += (j != sum);
+
+		ctx.hitcontents = CONTENTMASK_ANYSOLID;
+		ctx.nodes = filenodes;
+		start = Sys_DoubleTime ();
+		for (i = 0; i < count; i++)
+		{
+			memset (&traces[i], 0, sizeof(trace_t));
+			traces[i].fraction = 1;
+			traces[i].allsolid = true;
+			VectorCopy (points[i], ctx.start);
+			VectorCopy (ends[i], ctx.end);
+			Q1BSP_RecursiveHullTrace (&ctx, 0, 0, 1, points[i], ends[i], &traces[i]);
+		}
+		filetrace_time = Sys_DoubleTime () - start;
+
+		ctx.nodes = hull->nodes;
+		start = Sys_DoubleTime ();
+		for (i = 0; i < count; i++)
+		{
+			memset (&linear[i], 0, sizeof(trace_t));
+			linear[i].fraction = 1;
+			linear[i].allsolid = true;
+			VectorCopy (points[i], ctx.start);
+			VectorCopy (ends[i], ctx.end);
+			Q1BSP_RecursiveHullTrace (&ctx, 0, 0, 1, points[i], ends[i], &linear[i]);
+		}
+		lineartrace_time = Sys_DoubleTime () - start;
+
+		for (i = 0; i < count; i++)
+			mismatches += (memcmp (&traces[i], &linear[i], sizeof(trace_t)) != 0);
+
+		free (filenodes);
+
+		Con_Printf ("hull %d: %d nodes, %d KB clipnodes+planes, %d KB linear\n", h, hull->numnodes,
+			(int)((numfile * sizeof(mclipnode_t) + model->numplanes * sizeof(mplane_t)) >> 10), (int)((hull->numnodes * sizeof(mhullnode_t)) >> 10));
+		Con_Printf ("  points: %6.1f clipnodes, %6.1f file order, %6.1f depth first\n",
+			clip_time * 1e9 / count, file_time * 1e9 / count, linear_time * 1e9 / count);
+		Con_Printf ("  traces: %6.1f file order, %6.1f depth first, %d results differ\n",
+			filetrace_time * 1e9 / count, lineartrace_time * 1e9 / count, mismatches);
+	}
+
+	free (points);
+	free (ends);
+	free (traces);
+}
+
+/*
+===============================================================================
+
+SPECULATIVE MOVES
+
+SV_Physics can predict the first trace of falling and flying edicts and run
+them on the worker threads before the serial entity loop. SV_Move hands out
+a prediction only if it was made with the same arguments and no area node the
+trace visits was changed since, so the serial loop sees the same results it
+would have computed itself. sv_parallelphysics 2 recomputes every reused
+trace and reports differences.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	int			frame;				// spec_frame the prediction belongs to
+	vec3_t		start, mins, maxs, end;
+	int			type;
+	int			owner;				// fields of the moving edict the result depends on
+	float		size0;
+	vec3_t		boxmins, boxmaxs;
+	trace_t		trace;
+} specmove_t;
+
+typedef struct
+{
+	edict_t			**ents;
+	movepredict_t	predict;
+} specmovetask_t;
+
+static specmove_t	*spec_moves;
+static int			spec_maxmoves;
+static int			spec_frame;
+static qboolean		spec_active;
+static qboolean		spec_verify;
+static unsigned int	spec_stamp;
+
+static int			spec_predicted, spec_reused, spec_stale, spec_missed, spec_mismatched;
+
+/*
+==================
+SV_SpeculateMoveTask
+==================
+*/
+static void SV_SpeculateMoveTask (int index, void *data)
+{
+	specmovetask_t	*task = (specmovetask_t *) data;
+	edict_t			*ent = task->ents[index];
+	specmove_t		*move = &spec_moves[NUM_FOR_EDICT(ent)];
+	moveclip_t		clip;
+	vec3_t			end;
+	int				type;
+
+	if (!task->predict (ent, end, &type))
+		return;
+
+	SV_InitMoveClip (&clip, ent->v.origin, ent->v.mins, ent->v.maxs, end, type, ent, true, NULL);
+	SV_ClipToLinks (qcvm->areanodes, &clip);
+	if (clip.box.failed)
+		return;
+
+	VectorCopy (ent->v.origin, move->start);
+	VectorCopy (ent->v.mins, move->mins);
+	VectorCopy (ent->v.maxs, move->maxs);
+	VectorCopy (end, move->end);
+	move->type = type;
+	move->owner = ent->v.owner;
+	move->size0 = ent->v.size[0];
+	VectorCopy (clip.boxmins, move->boxmins);
+	VectorCopy (clip.boxmaxs, move->boxmaxs);
+	move->trace = clip.trace;
+	move->frame = spec_frame;
+}
+
+/*
+==================
+SV_AllocSpeculativeMoves
+==================
+*/
+static void SV_AllocSpeculativeMoves (void)
+{
+	if (spec_maxmoves < qcvm->max_edicts)
+	{
+		spec_moves = (specmove_t *) realloc (spec_moves, qcvm->max_edicts * sizeof(specmove_t));
+		if (!spec_moves)
+			Sys_Error ("SV_AllocSpeculativeMoves: out of memory");
+		memset (spec_moves + spec_maxmoves, 0, (qcvm->max_edicts - spec_maxmoves) * sizeof(specmove_t));
+		spec_maxmoves = qcvm->max_edicts;
+	}
+}
+
+/*
+==================
+SV_BeginSpeculativeMoves
+
+Predicts and traces the next move of every edict in ents on the worker threads
+==================
+*/
+void SV_BeginSpeculativeMoves (edict_t **ents, int count, movepredict_t predict, qboolean verify)
+{
+	specmovetask_t	task;
+	int				i;
+
+	// the pre-extension hull tracer prints from deep inside the recursion
+	if (!pr_checkextension.value || qcvm != &sv.qcvm)
+		return;
+
+	SV_AllocSpeculativeMoves ();
+
+	spec_frame++;
+	spec_stamp = qcvm->areastamp;
+	spec_verify = verify;
+
+	task.ents = ents;
+	task.predict = predict;
+	Task_ParallelFor (count, SV_SpeculateMoveTask, &task);
+
+	for (i = 0; i < count; i++)
+		if (spec_moves[NUM_FOR_EDICT(ents[i])].frame == spec_frame)
+			spec_predicted++;
+
+	spec_active = true;
+}
+
+/*
+==================
+SV_BenchSpeculativeMoves
+
+Traces the predicted moves of ents iterations times, once one after the other
+on the main thread and once spread over the workers, without touching the
+state the next frame uses. Returns false if speculation is unavailable.
+==================
+*/
+qboolean SV_BenchSpeculativeMoves (edict_t **ents, int count, movepredict_t predict, int iterations, double *serial_time, double *parallel_time)
+{
+	specmovetask_t	task;
+	double			start;
+	int				i, j;
+
+	if (!pr_checkextension.value || qcvm != &sv.qcvm || spec_active)
+		return false;
+
+	SV_AllocSpeculativeMoves ();
+
+	// results are stamped with a frame no SV_Move will look for
+	spec_frame++;
+	task.ents = ents;
+	task.predict = predict;
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+		for (i = 0; i < count; i++)
+			SV_SpeculateMoveTask (i, &task);
+	*serial_time = Sys_DoubleTime () - start;
+
+	start = Sys_DoubleTime ();
+	for (j = 0; j < iterations; j++)
+		Task_ParallelFor (count, SV_SpeculateMoveTask, &task);
+	*parallel_time = Sys_DoubleTime () - start;
+
+	spec_frame++;
+	return true;
+}
+
+/*
+==================
+SV_EndSpeculativeMoves
+==================
+*/
+void SV_EndSpeculativeMoves (void)
+{
+	spec_active = false;
+}
+
+/*
+==================
+SV_AreaUnchanged
+
+True if no node a move with the given bounds visits has changed since the
+speculative moves were traced
+==================
+*/
+static qboolean SV_AreaUnchanged (areanode_t *node, vec3_t boxmins, vec3_t boxmaxs)
+{
+	if (node->stamp > spec_stamp)
+		return false;
+	if (node->axis == -1)
+		return true;
+
+	if ( boxmaxs[node->axis] > node->loosedist[0] && !SV_AreaUnchanged (node->children[0], boxmins, boxmaxs) )
+		return false;
+	if ( boxmins[node->axis] < node->loosedist[1] && !SV_AreaUnchanged (node->children[1], boxmins, boxmaxs) )
+		return false;
+	return true;
+}
+
+/*
+==================
+SV_UseSpeculativeMove
+==================
+*/
+static qboolean SV_UseSpeculativeMove (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, trace_t *trace)
+{
+	specmove_t	*move = &spec_moves[NUM_FOR_EDICT(passedict)];
+
+	if (move->frame != spec_frame)
+		return false;
+	move->frame = 0;
+
+	if (type != move->type
+	|| memcmp (start, move->start, sizeof(vec3_t)) || memcmp (end, move->end, sizeof(vec3_t))
+	|| memcmp (mins, move->mins, sizeof(vec3_t)) || memcmp (maxs, move->maxs, sizeof(vec3_t))
+	|| passedict->v.owner != move->owner || passedict->v.size[0] != move->size0)
+	{
+		spec_missed++;
+		return false;
+	}
+
+	if (!SV_AreaUnchanged (qcvm->areanodes, move->boxmins, move->boxmaxs))
+	{
+		spec_stale++;
+		return false;
+	}
+
+	*trace = move->trace;
+	return true;
+}
+
+/*
+==================
+SV_TracesEqual
+==================
+*/
+static qboolean SV_TracesEqual (trace_t *a, trace_t *b)
+{
+	return a->allsolid == b->allsolid && a->startsolid == b->startsolid
+		&& a->inopen == b->inopen && a->inwater == b->inwater
+		&& !memcmp (&a->fraction, &b->fraction, sizeof(float) * 8)	// fraction, endpos, plane
+		&& a->ent == b->ent && a->contents == b->contents;
+}
+
+/*
+==================
+SV_SpeculativeMoveStats_f
+==================
+*/
+void SV_SpeculativeMoveStats_f (void)
+{
+	Con_Printf ("%d predicted, %d reused, %d stale, %d not matched\n", spec_predicted, spec_reused, spec_stale, spec_missed);
+	if (spec_mismatched)
+		Con_Printf ("%d reused traces differed from serial execution\n", spec_mismatched);
+	spec_predicted = spec_reused = spec_stale = spec_missed = spec_mismatched = 0;
+}
+
+/*
+==================
+SV_Move
+==================
+*/
+trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	moveclip_t	clip;
+	tracekey_t	key;
+	trace_t		speculative;
+	qboolean	reused = false;
+
+	if (trace_recording && qcvm == &sv.qcvm)
+		SV_RecordTrace (start, mins, maxs, end, type, passedict);
+
+	key.active = false;
+	if (spec_active && passedict && qcvm == &sv.qcvm)
+	{
+		reused = SV_UseSpeculativeMove (start, mins, maxs, end, type, passedict, &speculative);
+		if (reused && !spec_verify)
+		{
+			spec_reused++;
+			return speculative;
+		}
+	}
+
+	if (!reused && SV_TraceCacheLookup (&key, start, mins, maxs, end, type, passedict, &speculative))
+		return speculative;
+
+	SV_InitMoveClip (&clip, start, mins, maxs, end, type, passedict, false, NULL);
+	clip.track = key.active;
 
 // clip to entities
 	SV_ClipToLinks ( qcvm->areanodes, &clip );
@@ -1326,6 +2964,115 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 	if (qcvm == &cl.qcvm)
 		World_ClipToNetwork(&clip);
 
+	SV_TraceCacheStore (&key, &clip);
+
+	if (reused)
+	{
+		spec_reused++;
+		if (!SV_TracesEqual (&speculative, &clip.trace))
+		{
+			if (!spec_mismatched++)
+				Con_Printf ("sv_parallelphysics: speculative trace of edict %d differs from serial execution\n", NUM_FOR_EDICT(passedict));
+		}
+	}
+
 	return clip.trace;
 }
 
+/*
+==================
+SV_ClipMoveToWorldBatch
+
+SV_ClipMoveToEntity against the world for count moves with the same box
+==================
+*/
+static void SV_ClipMoveToWorldBatch (int count, vec3_t *start, vec3_t mins, vec3_t maxs, vec3_t *end, unsigned int hitcontents, trace_t *traces)
+{
+	boxhull_t	box;
+	vec3_t		offset;
+	vec3_t		start_l[HULL_PACKET_SIZE], end_l[HULL_PACKET_SIZE];
+	hull_t		*hull;
+	int			i, j, n;
+
+	SV_InitBoxHullCopy (&box, false);
+	hull = SV_HullForEntityBox (qcvm->edicts, mins, maxs, offset, &box);
+
+	for (i = 0; i < count; i += n)
+	{
+		n = q_min (count - i, HULL_PACKET_SIZE);
+		for (j = 0; j < n; j++)
+		{
+			memset (&traces[i + j], 0, sizeof(trace_t));
+			traces[i + j].fraction = 1;
+			traces[i + j].allsolid = true;
+			VectorCopy (end[i + j], traces[i + j].endpos);
+			VectorSubtract (start[i + j], offset, start_l[j]);
+			VectorSubtract (end[i + j], offset, end_l[j]);
+		}
+
+		SV_RecursiveHullCheckBatch (hull, n, start_l, end_l, &traces[i], hitcontents);
+
+		for (j = 0; j < n; j++)
+		{
+			if (traces[i + j].fraction != 1)
+				VectorAdd (traces[i + j].endpos, offset, traces[i + j].endpos);
+			if (traces[i + j].fraction < 1 || traces[i + j].startsolid)
+				traces[i + j].ent = qcvm->edicts;
+		}
+	}
+}
+
+/*
+==================
+SV_MoveBatch
+
+SV_Move for count moves with the same box, type and passedict. The world is
+clipped in packets, the entities one move at a time. Doesn't reuse
+speculative traces.
+==================
+*/
+void SV_MoveBatch (int count, vec3_t *start, vec3_t mins, vec3_t maxs, vec3_t *end, int type, edict_t *passedict, trace_t *traces)
+{
+	moveclip_t	clip;
+	tracekey_t	keys[HULL_PACKET_SIZE];
+	vec3_t		missstart[HULL_PACKET_SIZE], missend[HULL_PACKET_SIZE];
+	trace_t		world[HULL_PACKET_SIZE];
+	int			miss[HULL_PACKET_SIZE];
+	int			i, j, n, misses;
+
+	if (trace_recording && qcvm == &sv.qcvm)
+	{
+		for (i = 0; i < count; i++)
+			SV_RecordTrace (start[i], mins, maxs, end[i], type, passedict);
+	}
+
+	for (i = 0; i < count; i += n)
+	{
+		n = q_min (count - i, HULL_PACKET_SIZE);
+		for (j = 0, misses = 0; j < n; j++)
+		{
+			if (SV_TraceCacheLookup (&keys[misses], start[i + j], mins, maxs, end[i + j], type, passedict, &traces[i + j]))
+				continue;
+			VectorCopy (start[i + j], missstart[misses]);
+			VectorCopy (end[i + j], missend[misses]);
+			miss[misses++] = i + j;
+		}
+
+		SV_ClipMoveToWorldBatch (misses, missstart, mins, maxs, missend, SV_MoveHitContents (type), world);
+
+		for (j = 0; j < misses; j++)
+		{
+			SV_InitMoveClip (&clip, start[miss[j]], mins, maxs, end[miss[j]], type, passedict, false, &world[j]);
+			clip.track = keys[j].active;
+
+		// clip to entities
+			SV_ClipToLinks ( qcvm->areanodes, &clip );
+
+			if (qcvm == &cl.qcvm)
+				World_ClipToNetwork(&clip);
+
+			SV_TraceCacheStore (&keys[j], &clip);
+			traces[miss[j]] = clip.trace;
+		}
+	}
+}
@@ -63,6 +63,19 @@ void SV_LinkEdict (edict_t *ent, qboolean touch_triggers);
 // flags ent->v.modified
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
+// skips the relink when the edict's box, solid and model are unchanged
+
+void SV_LinkCountersFrame (void);
+void SV_LinkStats_f (void);
+// sv_linkstats shows how many links were done and skipped per server frame
+
+void SV_TouchAreaEdict (edict_t *ent);
+// call after changing a field that clipping against the edict reads
+
+void SV_MarkAreaDirty (edict_t *ent);
+int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **list, int maxcount);
+// returns the linked edicts touching the box plus all edicts whose link may be
+// stale because QC or the engine wrote their origin, size or solid since
 
 int SV_PointContentsAllBsps(vec3_t p, edict_t *forent); //check all SOLID_BSP ents
 int SV_PointContents (vec3_t p);
@@ -89,7 +102,36 @@ trace_t SV_Move (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, e
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+void SV_MoveBatch (int count, vec3_t *start, vec3_t mins, vec3_t maxs, vec3_t *end, int type, edict_t *passedict, trace_t *traces);
+// SV_Move for several moves with the same box, type and passedict
+
+void SV_FlushTraceCache (qboolean newframe);
+void SV_TraceCacheCounters (int *lookups, int *hits, int *flushes);
+// sv_tracecache keeps MOVE_NOMONSTERS traces until the next server frame or
+// until a SOLID_BSP edict changes. The counters reset when they are read.
+
+typedef qboolean (*movepredict_t) (edict_t *ent, vec3_t end, int *type);
+void SV_BeginSpeculativeMoves (edict_t **ents, int count, movepredict_t predict, qboolean verify);
+void SV_EndSpeculativeMoves (void);
+qboolean SV_BenchSpeculativeMoves (edict_t **ents, int count, movepredict_t predict, int iterations, double *serial_time, double *parallel_time);
+void SV_SpeculativeMoveStats_f (void);
+// predict receives an edict and returns the end and type of its next SV_Move
+// from its origin, or false. It runs on worker threads. SV_Move reuses the
+// traces until SV_EndSpeculativeMoves when nothing they depend on changed.
+
+void SV_TraceRecord_f (void);
+void SV_TraceBench_f (void);
+void SV_HullBench_f (void);
+void SV_HullNodeBench_f (void);
+// sv_tracerecord captures the server's SV_Move calls, sv_tracebench replays
+// them against the area tree and a linear scan of all edicts, sv_hullbench
+// replays their world clips one at a time and batched, sv_hullnodebench
+// compares the hull node layouts on random queries
+
 qboolean SV_RecursiveHullCheck (hull_t *hull, vec3_t p1, vec3_t p2, trace_t *trace, unsigned int hitcontents);
+void SV_RecursiveHullCheckBatch (hull_t *hull, int count, vec3_t *p1, vec3_t *p2, trace_t *traces, unsigned int hitcontents);
+void SV_HullPointContentsBatch (hull_t *hull, int num, int count, vec3_t *p, int *contents);
+// the batched versions walk the hull with several traces or points at once
 
 #endif	/* _QUAKE_WORLD_H */
 